@@ -1,5 +1,26 @@
 #include "Jomini.hpp"
 
+#if defined(__x86_64__) || defined(_M_X64)
+#include <immintrin.h>
+#define JOMINI_HAS_SSE2 1
+#if defined(__GNUC__)
+#define JOMINI_HAS_AVX2 1
+#endif
+#endif
+
+#include <thread>
+#include <filesystem>
+#include <condition_variable>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#define JOMINI_HAS_MMAP 1
+#endif
+
 namespace Jomini {
 
 //////////////////////////////////////////////////////////
@@ -100,150 +121,558 @@ sf::Color ColorFromHsv(double h, double s, double v, double a) {
     return sf::Color(R, G, B, A);
 }
 
+//////////////////////////////////////////////////////////
+//                   Symbol Table                       //
+//////////////////////////////////////////////////////////
+
+namespace {
+    uint32_t HashName(std::string_view name) {
+        return (uint32_t) std::hash<std::string_view>{}(name);
+    }
+
+    // Names of the symbols of one table are stored once, so their address is compared first.
+    inline bool SameName(std::string_view a, std::string_view b) {
+        return a.size() == b.size() && (a.data() == b.data() || std::memcmp(a.data(), b.data(), a.size()) == 0);
+    }
+
+    struct SharedSymbols {
+        std::mutex mutex;
+        SymbolTable table;
+    };
+
+    SharedSymbols& GetSharedSymbols() {
+        // Never destroyed, so that symbols stay valid in static destructors.
+        static SharedSymbols* symbols = new SharedSymbols();
+        return *symbols;
+    }
+
+    Symbol InternShared(std::string_view name) {
+        SharedSymbols& symbols = GetSharedSymbols();
+        std::lock_guard lock(symbols.mutex);
+        return symbols.table.Intern(name);
+    }
+
+    // Returns the arena of a document from the memory resource of one of its objects.
+    Arena* FindArena(std::pmr::memory_resource* resource) {
+        // Arena is final, so comparing the dynamic type is enough and much
+        // cheaper than a dynamic_cast.
+        if (resource == std::pmr::get_default_resource() || typeid(*resource) != typeid(Arena))
+            return nullptr;
+        return static_cast<Arena*>(resource);
+    }
+}
+
+Symbol::Symbol(std::string_view name)
+: Symbol(InternShared(name))
+{}
+
+Symbol::Symbol(uint32_t id, uint32_t hash, std::string_view name)
+: m_Id(id), m_Hash(hash), m_Name(name)
+{}
+
+uint32_t Symbol::GetId() const {
+    return m_Id;
+}
+
+uint32_t Symbol::GetHash() const {
+    return m_Hash;
+}
+
+std::string_view Symbol::GetName() const {
+    return m_Name;
+}
+
+Symbol::operator std::string_view() const {
+    return m_Name;
+}
+
+bool Symbol::operator==(const Symbol& other) const {
+    return m_Hash == other.m_Hash && SameName(m_Name, other.m_Name);
+}
+
+bool Symbol::operator==(std::string_view other) const {
+    return m_Name == other;
+}
+
+std::ostream& operator<<(std::ostream& os, const Symbol& symbol) {
+    return os << symbol.m_Name;
+}
+
+SymbolTable::SymbolTable()
+: m_NamesSize(0)
+{}
+
+Symbol SymbolTable::Intern(std::string_view name) {
+    return this->Intern(name, HashName(name));
+}
+
+Symbol SymbolTable::Intern(std::string_view name, uint32_t hash) {
+    if (!m_Slots.empty()) {
+        uint32_t id = m_Slots[this->FindSlot(name, hash)];
+        if (id != s_EmptySlot)
+            return m_Symbols[id];
+    }
+    // The last id marks the erased items of maps.
+    if (m_Symbols.size() >= s_EmptySlot - 1)
+        throw std::runtime_error("Too many symbols.");
+
+    // Keep the load factor under one half.
+    if ((m_Symbols.size() + 1) * 2 > m_Slots.size()) {
+        m_Slots.assign(std::max<size_t>(16, m_Slots.size() * 2), s_EmptySlot);
+        size_t mask = m_Slots.size() - 1;
+        for (const Symbol& symbol : m_Symbols) {
+            size_t i = symbol.m_Hash & mask;
+            while (m_Slots[i] != s_EmptySlot)
+                i = (i + 1) & mask;
+            m_Slots[i] = symbol.m_Id;
+        }
+    }
+
+    char* stored = static_cast<char*>(m_Names.allocate(std::max<size_t>(name.size(), 1), 1));
+    std::memcpy(stored, name.data(), name.size());
+    Symbol symbol((uint32_t) m_Symbols.size(), hash, std::string_view(stored, name.size()));
+    m_Slots[this->FindSlot(name, hash)] = symbol.m_Id;
+    m_Symbols.push_back(symbol);
+    m_NamesSize += name.size();
+    return symbol;
+}
+
+std::optional<Symbol> SymbolTable::Find(std::string_view name) const {
+    if (m_Slots.empty())
+        return std::nullopt;
+    uint32_t id = m_Slots[this->FindSlot(name, HashName(name))];
+    if (id == s_EmptySlot)
+        return std::nullopt;
+    return m_Symbols[id];
+}
+
+bool SymbolTable::Contains(Symbol symbol) const {
+    return symbol.m_Id < m_Symbols.size() && m_Symbols[symbol.m_Id].m_Name.data() == symbol.m_Name.data();
+}
+
+size_t SymbolTable::FindSlot(std::string_view name, uint32_t hash) const {
+    size_t mask = m_Slots.size() - 1;
+    for (size_t i = hash & mask;; i = (i + 1) & mask) {
+        uint32_t id = m_Slots[i];
+        if (id == s_EmptySlot || (m_Symbols[id].m_Hash == hash && m_Symbols[id].m_Name == name))
+            return i;
+    }
+}
+
+size_t SymbolTable::GetSize() const {
+    return m_Symbols.size();
+}
+
+size_t SymbolTable::GetNamesSize() const {
+    return m_NamesSize;
+}
+
 //////////////////////////////////////////////////////////
 //                 Ordered Object Map                   //
 //////////////////////////////////////////////////////////
 
 const ObjectMap::Value ObjectMap::s_DefaultValue = { Operator::EQUAL, nullptr };
 
-ObjectMap::ObjectMap() {}
+template <typename T> ObjectMap::BasicIterator<T>::BasicIterator()
+: m_Item(nullptr), m_End(nullptr)
+{}
+
+template <typename T> ObjectMap::BasicIterator<T>::BasicIterator(T* item, T* end)
+: m_Item(item), m_End(end)
+{
+    while (m_Item != m_End && m_Item->first.GetId() == s_ErasedId)
+        m_Item++;
+}
+
+template <typename T> ObjectMap::BasicIterator<T>::operator BasicIterator<const Item>() const {
+    return BasicIterator<const Item>(m_Item, m_End);
+}
+
+template <typename T> T& ObjectMap::BasicIterator<T>::operator*() const {
+    return *m_Item;
+}
+
+template <typename T> T* ObjectMap::BasicIterator<T>::operator->() const {
+    return m_Item;
+}
+
+template <typename T> ObjectMap::BasicIterator<T>& ObjectMap::BasicIterator<T>::operator++() {
+    do {
+        m_Item++;
+    } while (m_Item != m_End && m_Item->first.GetId() == s_ErasedId);
+    return *this;
+}
+
+template <typename T> ObjectMap::BasicIterator<T> ObjectMap::BasicIterator<T>::operator++(int) {
+    BasicIterator copy = *this;
+    ++(*this);
+    return copy;
+}
+
+template <typename T> bool ObjectMap::BasicIterator<T>::operator==(const BasicIterator& other) const {
+    return m_Item == other.m_Item;
+}
+
+template <typename T> bool ObjectMap::BasicIterator<T>::operator!=(const BasicIterator& other) const {
+    return m_Item != other.m_Item;
+}
+
+template class ObjectMap::BasicIterator<ObjectMap::Item>;
+template class ObjectMap::BasicIterator<const ObjectMap::Item>;
+
+ObjectMap::ObjectMap()
+: m_Erased(0), m_ErasedSlots(0)
+{}
+
+ObjectMap::ObjectMap(std::pmr::memory_resource* resource, std::shared_ptr<SymbolTable> symbols)
+: m_Items(resource), m_Index(resource), m_Symbols(std::move(symbols)), m_Erased(0), m_ErasedSlots(0)
+{}
 
-ObjectMap::ObjectMap(const std::unordered_map<std::string, Value>& entries) {
-    // m_Items.resize(entries.size());
+ObjectMap::ObjectMap(const std::unordered_map<std::string, Value>& entries)
+: m_Erased(0), m_ErasedSlots(0)
+{
+    this->reserve(entries.size());
     for (const auto& [key, value] : entries)
         this->insert(key, value);
 }
 
-ObjectMap::ObjectMap(const ObjectMap& other) {
-    m_Items = other.m_Items;
-    for (auto it = m_Items.begin(); it != m_Items.end(); it++) {
-        m_Index.emplace(it->first, it);
-    }
+ObjectMap::ObjectMap(const ObjectMap& other)
+: m_Erased(0), m_ErasedSlots(0)
+{
+    // The table of an arena is not owned by its maps, so their copies get their own.
+    if (other.m_Symbols.use_count() > 0)
+        m_Symbols = other.m_Symbols;
+    this->reserve(other.size());
+    for (const auto& [key, value] : other)
+        this->insert_missing(key, value);
+}
+
+ObjectMap::ObjectMap(ObjectMap&& other)
+: m_Items(std::move(other.m_Items)), m_Index(std::move(other.m_Index)), m_Symbols(std::move(other.m_Symbols)),
+  m_Erased(other.m_Erased), m_ErasedSlots(other.m_ErasedSlots)
+{
+    other.clear();
 }
 
-ObjectMap& ObjectMap::operator=(ObjectMap other) {
-    std::swap(m_Items, other.m_Items);
-    std::swap(m_Index, other.m_Index);
+ObjectMap& ObjectMap::operator=(const ObjectMap& other) {
+    if (this == &other)
+        return *this;
+    if (m_Symbols == nullptr && other.m_Symbols.use_count() > 0 && FindArena(this->resource()) == nullptr)
+        m_Symbols = other.m_Symbols;
+    this->clear();
+    this->reserve(other.size());
+    for (const auto& [key, value] : other)
+        this->insert_missing(key, value);
     return *this;
 }
 
-void ObjectMap::insert(const std::string& key, const Value& value) {
-    auto it = m_Index.find(key);
-    if (it == m_Index.end()) {
-        m_Items.emplace_back(key, value);
-        m_Index.emplace(key, std::prev(m_Items.end()));
+ObjectMap& ObjectMap::operator=(ObjectMap&& other) {
+    // Items can only be stolen from a map using the same memory resource.
+    if (this->resource() != other.resource())
+        return *this = static_cast<const ObjectMap&>(other);
+    m_Items = std::move(other.m_Items);
+    m_Index = std::move(other.m_Index);
+    m_Symbols = std::move(other.m_Symbols);
+    m_Erased = other.m_Erased;
+    m_ErasedSlots = other.m_ErasedSlots;
+    other.clear();
+    return *this;
+}
+
+SymbolTable& ObjectMap::symbols() {
+    if (m_Symbols == nullptr) {
+        // Maps of a document never outlive its arena, so they don't own its table.
+        Arena* arena = FindArena(this->resource());
+        if (arena != nullptr)
+            m_Symbols = std::shared_ptr<SymbolTable>(std::shared_ptr<SymbolTable>(), arena->GetSymbols().get());
+        else
+            m_Symbols = std::make_shared<SymbolTable>();
+    }
+    return *m_Symbols;
+}
+
+size_t ObjectMap::find_position(std::string_view key) const {
+    // Small maps compare the names directly, which is cheaper than hashing the key.
+    // They have no tombstones, so every item has a name, and the length and the
+    // first and last bytes rule out most of them.
+    if (m_Index.empty()) {
+        for (size_t position = 0; position < m_Items.size(); position++) {
+            std::string_view name = m_Items[position].first.m_Name;
+            if (name.size() == key.size() && (key.empty() || (name.front() == key.front() && name.back() == key.back()
+                && std::memcmp(name.data(), key.data(), key.size()) == 0)))
+                return position;
+        }
+        return m_Items.size();
+    }
+    return this->find_position(key, HashName(key));
+}
+
+size_t ObjectMap::find_position(std::string_view key, uint32_t hash) const {
+    if (m_Index.empty()) {
+        for (size_t position = 0; position < m_Items.size(); position++) {
+            const Symbol& symbol = m_Items[position].first;
+            if (symbol.m_Hash == hash && SameName(symbol.m_Name, key))
+                return position;
+        }
+        return m_Items.size();
+    }
+    size_t slot = this->find_slot(key, hash);
+    return (slot != m_Index.size()) ? m_Index[slot].position : m_Items.size();
+}
+
+size_t ObjectMap::find_slot(std::string_view key, uint32_t hash) const {
+    if (m_Index.empty())
+        return 0;
+    size_t mask = m_Index.size() - 1;
+    for (size_t i = hash & mask;; i = (i + 1) & mask) {
+        const Slot& slot = m_Index[i];
+        if (slot.position == s_EmptySlot)
+            return m_Index.size();
+        if (slot.hash == hash && slot.position != s_ErasedSlot && SameName(m_Items[slot.position].first.m_Name, key))
+            return i;
+    }
+}
+
+void ObjectMap::insert_slot(uint32_t hash, uint32_t position) {
+    size_t size = m_Items.size() - m_Erased + 1;
+    if (m_Index.empty() && size <= s_SmallMapSize)
+        return;
+    // Keep at least half of the slots empty, counting the erased ones as used.
+    if ((size + m_ErasedSlots) * 2 > m_Index.size())
+        this->rebuild_index(size);
+    size_t mask = m_Index.size() - 1;
+    size_t i = hash & mask;
+    while (m_Index[i].position != s_EmptySlot && m_Index[i].position != s_ErasedSlot)
+        i = (i + 1) & mask;
+    if (m_Index[i].position == s_ErasedSlot)
+        m_ErasedSlots--;
+    m_Index[i] = Slot{ hash, position };
+}
+
+void ObjectMap::rebuild_index(size_t size) {
+    size_t capacity = s_MinIndexSize;
+    while (capacity < size * 2)
+        capacity *= 2;
+    m_Index.assign(capacity, Slot{ 0, s_EmptySlot });
+    m_ErasedSlots = 0;
+    size_t mask = capacity - 1;
+    for (size_t position = 0; position < m_Items.size(); position++) {
+        const Symbol& symbol = m_Items[position].first;
+        if (symbol.m_Id == s_ErasedId)
+            continue;
+        size_t i = symbol.m_Hash & mask;
+        while (m_Index[i].position != s_EmptySlot)
+            i = (i + 1) & mask;
+        m_Index[i] = Slot{ symbol.m_Hash, (uint32_t) position };
+    }
+}
+
+void ObjectMap::compact() {
+    // Remove the tombstones while keeping the order of the items.
+    auto end = std::remove_if(m_Items.begin(), m_Items.end(), [](const Item& item) {
+        return item.first.GetId() == s_ErasedId;
+    });
+    m_Items.erase(end, m_Items.end());
+    m_Erased = 0;
+    if (m_Items.size() > s_SmallMapSize) {
+        this->rebuild_index(m_Items.size());
     } else {
-        it->second->second = value;
+        m_Index.clear();
+        m_ErasedSlots = 0;
     }
 }
 
+void ObjectMap::insert(const std::string& key, const Value& value) {
+    this->insert(std::string_view(key), value);
+}
+
 void ObjectMap::insert(std::string_view key, const Value& value) {
-    auto it = m_Index.find(key);
-    if (it == m_Index.end()) {
-        std::string str(key);
-        m_Items.emplace_back(str, value);
-        m_Index.emplace(str, std::prev(m_Items.end()));
+    uint32_t hash = HashName(key);
+    size_t position = this->find_position(key, hash);
+    if (position == m_Items.size()) {
+        this->insert_missing(this->symbols().Intern(key, hash), value);
+    } else {
+        m_Items[position].second = value;
+    }
+}
+
+void ObjectMap::insert(Symbol key, const Value& value) {
+    size_t position = this->find_position(key.m_Name, key.m_Hash);
+    if (position == m_Items.size()) {
+        this->insert_missing(key, value);
     } else {
-        it->second->second = value;
+        m_Items[position].second = value;
     }
 }
 
 void ObjectMap::insert_missing(std::string_view key, const Value& value) {
-    std::string str(key);    
-    m_Items.emplace_back(str, value);
-    m_Index.emplace(str, std::prev(m_Items.end()));
+    this->insert_missing(this->symbols().Intern(key), value);
+}
+
+void ObjectMap::insert_missing(Symbol key, const Value& value) {
+    // Keys of another table are interned in the one of the map, which keeps their names alive.
+    SymbolTable& symbols = this->symbols();
+    if (!symbols.Contains(key))
+        key = symbols.Intern(key.m_Name, key.m_Hash);
+    this->insert_slot(key.m_Hash, (uint32_t) m_Items.size());
+    m_Items.emplace_back(key, value);
+}
+
+void ObjectMap::erase(std::string_view key) {
+    size_t position = this->find_position(key);
+    if (position != m_Items.size())
+        this->erase(m_Items[position].first);
 }
 
-template <typename K> void ObjectMap::erase(const K& key) {
-    auto it = m_Index.find(key);
-    if (it != m_Index.end()) {
-        m_Items.erase(it->second);
-        m_Index.erase(it);
+void ObjectMap::erase(Symbol key) {
+    // Small maps have no index to keep up to date, so the item is removed at once.
+    if (m_Index.empty()) {
+        size_t position = this->find_position(key.m_Name, key.m_Hash);
+        if (position != m_Items.size())
+            m_Items.erase(m_Items.begin() + position);
+        return;
     }
+    size_t slot = this->find_slot(key.m_Name, key.m_Hash);
+    if (slot == m_Index.size())
+        return;
+    Item& item = m_Items[m_Index[slot].position];
+    item.first = Symbol(s_ErasedId, 0, std::string_view());
+    item.second = Value();
+    m_Index[slot].position = s_ErasedSlot;
+    m_Erased++;
+    m_ErasedSlots++;
+    if (m_Erased * 2 > m_Items.size())
+        this->compact();
 }
 
 void ObjectMap::clear() {
     m_Items.clear();
     m_Index.clear();
+    m_Erased = 0;
+    m_ErasedSlots = 0;
+}
+
+ObjectMap::Value& ObjectMap::at(std::string_view key) {
+    size_t position = this->find_position(key);
+    if (position == m_Items.size())
+        throw std::out_of_range("ObjectMap::at: key not found");
+    return m_Items[position].second;
 }
 
-template <typename K> ObjectMap::Value& ObjectMap::at(const K& key) {
-    auto it = m_Index.find(key);
-    if (it == m_Index.end())
+ObjectMap::Value& ObjectMap::at(Symbol key) {
+    size_t position = this->find_position(key.m_Name, key.m_Hash);
+    if (position == m_Items.size())
         throw std::out_of_range("ObjectMap::at: key not found");
-    return it->second->second;
+    return m_Items[position].second;
 }
 
-template <typename K> const ObjectMap::Value& ObjectMap::at(const K& key) const {
-    auto it = m_Index.find(key);
-    if (it == m_Index.end())
+const ObjectMap::Value& ObjectMap::at(std::string_view key) const {
+    size_t position = this->find_position(key);
+    if (position == m_Items.size())
         throw std::out_of_range("ObjectMap::at: key not found");
-    return it->second->second;
+    return m_Items[position].second;
+}
+
+const ObjectMap::Value& ObjectMap::at(Symbol key) const {
+    size_t position = this->find_position(key.m_Name, key.m_Hash);
+    if (position == m_Items.size())
+        throw std::out_of_range("ObjectMap::at: key not found");
+    return m_Items[position].second;
 }
 
 ObjectMap::Value& ObjectMap::operator[](std::string_view key) {
-    auto it = m_Index.find(key);
-    if (it == m_Index.end()) {
-        std::string str = std::string(key);
-        m_Items.emplace_back(str, s_DefaultValue);
-        m_Index.emplace(str, std::prev(m_Items.end()));
+    uint32_t hash = HashName(key);
+    size_t position = this->find_position(key, hash);
+    if (position == m_Items.size()) {
+        this->insert_missing(this->symbols().Intern(key, hash), s_DefaultValue);
+        return m_Items.back().second;
+    }
+    return m_Items[position].second;
+}
+
+ObjectMap::Value& ObjectMap::operator[](Symbol key) {
+    size_t position = this->find_position(key.m_Name, key.m_Hash);
+    if (position == m_Items.size()) {
+        this->insert_missing(key, s_DefaultValue);
         return m_Items.back().second;
     }
-    return it->second->second;
+    return m_Items[position].second;
+}
+
+const ObjectMap::Value& ObjectMap::operator[](std::string_view key) const {
+    size_t position = this->find_position(key);
+    return (position != m_Items.size()) ? m_Items[position].second : s_DefaultValue;
+}
+
+const ObjectMap::Value& ObjectMap::operator[](Symbol key) const {
+    size_t position = this->find_position(key.m_Name, key.m_Hash);
+    return (position != m_Items.size()) ? m_Items[position].second : s_DefaultValue;
+}
+
+ObjectMap::Iterator ObjectMap::find(std::string_view key) {
+    return Iterator(m_Items.data() + this->find_position(key), m_Items.data() + m_Items.size());
+}
+
+ObjectMap::Iterator ObjectMap::find(Symbol key) {
+    return Iterator(m_Items.data() + this->find_position(key.m_Name, key.m_Hash), m_Items.data() + m_Items.size());
 }
 
-template <typename K> const ObjectMap::Value& ObjectMap::operator[](const K& key) const {
-    auto it = m_Index.find(key);
-    return (it != m_Index.end()) ? it->second->second : s_DefaultValue;
+ObjectMap::ConstIterator ObjectMap::find(std::string_view key) const {
+    return ConstIterator(m_Items.data() + this->find_position(key), m_Items.data() + m_Items.size());
 }
 
-template <typename K> ObjectMap::Iterator ObjectMap::find(const K& key) {
-    auto it = m_Index.find(key);
-    return (it != m_Index.end()) ? it->second : m_Items.end();
+ObjectMap::ConstIterator ObjectMap::find(Symbol key) const {
+    return ConstIterator(m_Items.data() + this->find_position(key.m_Name, key.m_Hash), m_Items.data() + m_Items.size());
 }
 
-template <typename K> ObjectMap::ConstIterator ObjectMap::find(const K& key) const {
-    auto it = m_Index.find(key);
-    return (it != m_Index.end()) ? it->second : m_Items.cend();
+bool ObjectMap::contains(std::string_view key) const {
+    return this->find_position(key) != m_Items.size();
 }
 
-template <typename K> bool ObjectMap::contains(const K& key) const {
-    return m_Index.contains(key);
+bool ObjectMap::contains(Symbol key) const {
+    return this->find_position(key.m_Name, key.m_Hash) != m_Items.size();
 }
 
 ObjectMap::Iterator ObjectMap::begin() {
-    return m_Items.begin();
+    return Iterator(m_Items.data(), m_Items.data() + m_Items.size());
 }
 
 ObjectMap::Iterator ObjectMap::end() {
-    return m_Items.end();
+    return Iterator(m_Items.data() + m_Items.size(), m_Items.data() + m_Items.size());
 }
 
 ObjectMap::ConstIterator ObjectMap::begin() const {
-    return m_Items.cbegin();
+    return ConstIterator(m_Items.data(), m_Items.data() + m_Items.size());
 }
 
 ObjectMap::ConstIterator ObjectMap::end() const {
-    return m_Items.cend();
+    return ConstIterator(m_Items.data() + m_Items.size(), m_Items.data() + m_Items.size());
 }
 
 std::vector<std::string_view> ObjectMap::keys() const {
     std::vector<std::string_view> keys;
-    for (const auto& [key, value] : m_Items)
-        keys.push_back(std::string_view(key));
+    keys.reserve(this->size());
+    for (const auto& [key, value] : *this)
+        keys.push_back(key.GetName());
     return keys;
 }
 
 std::size_t ObjectMap::size() const {
-    return m_Items.size();
+    return m_Items.size() - m_Erased;
 }
 
 bool ObjectMap::empty() const {
-    return m_Items.empty();
+    return this->size() == 0;
 }
 
 void ObjectMap::reserve(size_t size) {
-    m_Index.reserve(size);
+    m_Items.reserve(size);
+    if (size > s_SmallMapSize && m_Index.size() < size * 2)
+        this->rebuild_index(size);
+}
+
+std::pmr::memory_resource* ObjectMap::resource() const {
+    return m_Items.get_allocator().resource();
 }
 
 //////////////////////////////////////////////////////////
@@ -271,47 +700,60 @@ Flags& operator&=(Flags& a, Flags b) {
 }
 
 Object::Object()
-: m_Value(ObjectMap{}), m_Type(Type::OBJECT), m_Flags(Flags::NONE)
+: m_Value(ObjectMap{}), m_Type(Type::OBJECT), m_Flags(Flags::NONE), m_ScalarType(ScalarType::STRING), m_Scale(0), m_Number(0)
 {}
 
 Object::Object(Type type)
-: m_Type(type), m_Flags(Flags::NONE)
+: m_Type(type), m_Flags(Flags::NONE), m_ScalarType(ScalarType::STRING), m_Scale(0), m_Number(0)
 {
-    if (type == Type::SCALAR) m_Value = std::string();
-    else if (type == Type::OBJECT) m_Value = ObjectMap{};
-    else if (type == Type::ARRAY) m_Value = ObjectArray{};
+    if (type == Type::OBJECT) m_Value.emplace<ObjectMap>();
+    else if (type == Type::ARRAY) m_Value.emplace<ObjectArray>();
 }
 
 Object::Object(const std::string& scalar)
-: m_Value(scalar), m_Type(Type::SCALAR), m_Flags(Flags::NONE)
-{}
+: m_Value(std::pmr::string(scalar)), m_Type(Type::SCALAR), m_Flags(Flags::NONE), m_ScalarType(ScalarType::STRING), m_Scale(0), m_Number(0)
+{
+    this->ClassifyScalar();
+}
 
 Object::Object(std::string_view view)
-: m_Value(std::string(view)), m_Type(Type::SCALAR), m_Flags(Flags::NONE)
-{}
+: m_Value(std::pmr::string(view)), m_Type(Type::SCALAR), m_Flags(Flags::NONE), m_ScalarType(ScalarType::STRING), m_Scale(0), m_Number(0)
+{
+    this->ClassifyScalar();
+}
 
 Object::Object(const char* scalar)
-: m_Value(std::string(scalar)), m_Type(Type::SCALAR), m_Flags(Flags::NONE)
-{}
+: m_Value(std::pmr::string(scalar)), m_Type(Type::SCALAR), m_Flags(Flags::NONE), m_ScalarType(ScalarType::STRING), m_Scale(0), m_Number(0)
+{
+    this->ClassifyScalar();
+}
 
 Object::Object(int scalar)
-: m_Value(std::to_string(scalar)), m_Type(Type::SCALAR), m_Flags(Flags::NONE)
-{}
+: m_Value(std::pmr::string(std::to_string(scalar))), m_Type(Type::SCALAR), m_Flags(Flags::NONE), m_ScalarType(ScalarType::STRING), m_Scale(0), m_Number(0)
+{
+    this->ClassifyScalar();
+}
 
 Object::Object(double scalar)
-: m_Value(std::to_string(scalar)), m_Type(Type::SCALAR), m_Flags(Flags::NONE)
-{}
+: m_Value(std::pmr::string(std::to_string(scalar))), m_Type(Type::SCALAR), m_Flags(Flags::NONE), m_ScalarType(ScalarType::STRING), m_Scale(0), m_Number(0)
+{
+    this->ClassifyScalar();
+}
 
 Object::Object(bool scalar)
-: m_Value((scalar ? "yes" : "no")), m_Type(Type::SCALAR), m_Flags(Flags::NONE)
-{}
+: m_Value(std::pmr::string(scalar ? "yes" : "no")), m_Type(Type::SCALAR), m_Flags(Flags::NONE), m_ScalarType(ScalarType::STRING), m_Scale(0), m_Number(0)
+{
+    this->ClassifyScalar();
+}
 
 Object::Object(const Date& scalar)
-: m_Value((std::string) scalar), m_Type(Type::SCALAR), m_Flags(Flags::NONE)
-{}
+: m_Value(std::pmr::string((std::string) scalar)), m_Type(Type::SCALAR), m_Flags(Flags::NONE), m_ScalarType(ScalarType::STRING), m_Scale(0), m_Number(0)
+{
+    this->ClassifyScalar();
+}
 
 Object::Object(const sf::Color& scalar)
-: m_Value(ObjectArray{}), m_Type(Type::ARRAY), m_Flags(Flags::RGB)
+: m_Value(ObjectArray{}), m_Type(Type::ARRAY), m_Flags(Flags::RGB), m_ScalarType(ScalarType::STRING), m_Scale(0), m_Number(0)
 {
     ObjectArray& array = std::get<ObjectArray>(m_Value);
     array.push_back(std::make_shared<Object>(scalar.r));
@@ -321,7 +763,7 @@ Object::Object(const sf::Color& scalar)
 }
 
 template <typename T> Object::Object(const std::vector<T>& array)
-: m_Value(ObjectArray{}), m_Type(Type::ARRAY), m_Flags(Flags::NONE)
+: m_Value(ObjectArray{}), m_Type(Type::ARRAY), m_Flags(Flags::NONE), m_ScalarType(ScalarType::STRING), m_Scale(0), m_Number(0)
 {
     for (const auto& value : array)
         std::get<ObjectArray>(m_Value).push_back(std::make_shared<Object>(value));
@@ -332,22 +774,51 @@ template Object::Object(const std::vector<double>& array);
 template Object::Object(const std::vector<bool>& array);
 template Object::Object(const std::vector<Date>& array);
 
+Object::Object(const std::vector<std::shared_ptr<Object>>& array)
+: m_Value(ObjectArray(array.begin(), array.end())), m_Type(Type::ARRAY), m_Flags(Flags::NONE), m_ScalarType(ScalarType::STRING), m_Scale(0), m_Number(0)
+{}
+
 Object::Object(const ObjectMap& objects)
-: m_Value(objects), m_Type(Type::OBJECT), m_Flags(Flags::NONE)
+: m_Value(objects), m_Type(Type::OBJECT), m_Flags(Flags::NONE), m_ScalarType(ScalarType::STRING), m_Scale(0), m_Number(0)
 {}
 
 Object::Object(const ObjectArray& array)
-: m_Value(array), m_Type(Type::ARRAY), m_Flags(Flags::NONE)
+: m_Value(array), m_Type(Type::ARRAY), m_Flags(Flags::NONE), m_ScalarType(ScalarType::STRING), m_Scale(0), m_Number(0)
 {}
 
-Object::Object(const std::variant<std::string, ObjectMap, ObjectArray>& value)
-: m_Value(value), m_Type((Type) value.index()), m_Flags(Flags::NONE)
-{}
+Object::Object(const std::variant<std::pmr::string, ObjectMap, ObjectArray, ScalarView, LazyBlock, PackedArray>& value)
+: m_Value(value), m_Flags(Flags::NONE), m_ScalarType(ScalarType::STRING), m_Scale(0), m_Number(0)
+{
+    if (std::holds_alternative<ScalarView>(value))
+        m_Type = Type::SCALAR;
+    else if (std::holds_alternative<LazyBlock>(value))
+        m_Type = std::get<LazyBlock>(value).type;
+    else if (std::holds_alternative<PackedArray>(value))
+        m_Type = Type::ARRAY;
+    else
+        m_Type = (Type) value.index();
+    if (m_Type == Type::SCALAR)
+        this->ClassifyScalar();
+}
+
+Object::Object(Type type, std::pmr::memory_resource* resource)
+: m_Type(type), m_Flags(Flags::NONE), m_ScalarType(ScalarType::STRING), m_Scale(0), m_Number(0)
+{
+    if (type == Type::OBJECT) m_Value.emplace<ObjectMap>(resource);
+    else if (type == Type::ARRAY) m_Value.emplace<ObjectArray>(resource);
+    else m_Value.emplace<std::pmr::string>(resource);
+}
 
-Object::Object(const Object& object) {
+Object::Object(const Object& object)
+: m_Flags(Flags::NONE), m_ScalarType(ScalarType::STRING), m_Scale(0), m_Number(0)
+{
     std::shared_ptr<Object> copy = object.Copy();
     m_Type = copy->m_Type;
     m_Value = std::move(copy->m_Value);
+    m_Flags = copy->m_Flags;
+    m_ScalarType = copy->m_ScalarType;
+    m_Scale = copy->m_Scale;
+    m_Number = copy->m_Number;
 }
 
 Object::Object(const std::shared_ptr<Object>& object)
@@ -364,40 +835,320 @@ bool Object::Is(Type type) const {
     return m_Type == type;
 }
 
+ScalarType Object::GetScalarType() const {
+    return m_ScalarType;
+}
+
+// Powers of ten below 2^53, by which the digits of a float are divided exactly.
+static const double s_PowersOfTen[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9 };
+
+// Decodes a scalar into the number read by the conversions instead of its text,
+// which is stored like Object::m_Scale and Object::m_Number.
+static ScalarType DecodeScalar(std::string_view scalar, uint8_t& scale, int32_t& number) {
+    scale = 0;
+    number = 0;
+    if (scalar == "yes" || scalar == "no") {
+        number = (scalar == "yes");
+        return ScalarType::BOOL;
+    }
+
+    // Reads the digits of up to three parts separated by dots: an integer, the
+    // integer and decimals of a float, or the year, month and day of a date.
+    size_t i = 0;
+    bool negative = (!scalar.empty() && scalar[0] == '-');
+    if (negative)
+        i++;
+    int64_t parts[3] = { 0, 0, 0 };
+    size_t digits[3] = { 0, 0, 0 };
+    size_t count = 0;
+    for (; count < 3; count++) {
+        while (i < scalar.size() && scalar[i] >= '0' && scalar[i] <= '9' && digits[count] < 10) {
+            parts[count] = parts[count] * 10 + (scalar[i] - '0');
+            digits[count]++;
+            i++;
+        }
+        if (digits[count] == 0 || digits[count] == 10)
+            return ScalarType::STRING;
+        if (i == scalar.size() || scalar[i] != '.')
+            break;
+        i++;
+    }
+    if (i != scalar.size())
+        return ScalarType::STRING;
+
+    if (count == 0 && digits[0] <= 9) {
+        scale = (negative ? 0x80 : 0);
+        number = (int32_t) (negative ? -parts[0] : parts[0]);
+        return ScalarType::INT;
+    }
+    if (count == 1 && digits[0] + digits[1] <= 9) {
+        scale = (negative ? 0x80 : 0) | (uint8_t) digits[1];
+        number = (int32_t) (parts[0] * (int64_t) s_PowersOfTen[digits[1]] + parts[1]);
+        if (negative)
+            number = -number;
+        return ScalarType::FLOAT;
+    }
+    if (count == 2) {
+        int64_t year = (negative ? -parts[0] : parts[0]);
+        if (year < INT16_MIN || year > INT16_MAX || parts[1] > 255 || parts[2] > 255)
+            return ScalarType::STRING;
+        number = (int32_t) (year * 65536 + parts[1] * 256 + parts[2]);
+        return ScalarType::DATE;
+    }
+    return ScalarType::STRING;
+}
+
+// Writes a decoded number back as text, without redundant zeros. The buffer must
+// hold at least 16 characters, and the number of characters written is returned.
+static size_t FormatScalar(char* buffer, ScalarType type, uint8_t scale, int32_t number) {
+    char* end = buffer + 16;
+    char* it = buffer;
+    if (type == ScalarType::DATE) {
+        it = std::to_chars(it, end, number >> 16).ptr;
+        *it++ = '.';
+        it = std::to_chars(it, end, (number >> 8) & 0xFF).ptr;
+        *it++ = '.';
+        it = std::to_chars(it, end, number & 0xFF).ptr;
+        return it - buffer;
+    }
+    if (scale & 0x80)
+        *it++ = '-';
+    uint32_t magnitude = (uint32_t) std::abs(number);
+    uint8_t decimals = (scale & 0x7F);
+    if (decimals == 0)
+        return std::to_chars(it, end, magnitude).ptr - buffer;
+    uint32_t divisor = (uint32_t) s_PowersOfTen[decimals];
+    it = std::to_chars(it, end, magnitude / divisor).ptr;
+    *it++ = '.';
+    // Decimals are written with their leading zeros.
+    for (uint32_t remainder = magnitude % divisor; divisor > 1; divisor /= 10, remainder %= divisor)
+        *it++ = (char) ('0' + remainder / (divisor / 10));
+    return it - buffer;
+}
+
+// Returns the digits of a decimal of a packed array, which are exactly those it was decoded from.
+static int32_t GetPackedNumber(double value, uint8_t scale) {
+    int32_t number = (int32_t) std::llround(std::abs(value) * s_PowersOfTen[scale & 0x7F]);
+    return (scale & 0x80) ? -number : number;
+}
+
+static size_t GetPackedSize(const PackedArray& packed) {
+    return std::visit([](const auto& values) { return values.size(); }, packed.values);
+}
+
+// Writes the text of an element of a packed array, which is the text it was parsed from.
+static size_t FormatPacked(char* buffer, const PackedArray& packed, size_t i) {
+    if (const auto* ints = std::get_if<std::pmr::vector<int>>(&packed.values))
+        return FormatScalar(buffer, ScalarType::INT, ((*ints)[i] < 0 ? 0x80 : 0), (*ints)[i]);
+    if (const auto* floats = std::get_if<std::pmr::vector<double>>(&packed.values))
+        return FormatScalar(buffer, ScalarType::FLOAT, packed.scales[i], GetPackedNumber((*floats)[i], packed.scales[i]));
+    const Date& date = std::get<std::pmr::vector<Date>>(packed.values)[i];
+    return FormatScalar(buffer, ScalarType::DATE, 0, date.year * 65536 + date.month * 256 + date.day);
+}
+
+static PackedArray CopyPackedArray(const PackedArray& packed, std::pmr::memory_resource* resource) {
+    PackedArray copy{ std::pmr::vector<int>(resource), std::pmr::vector<uint8_t>(packed.scales, resource) };
+    std::visit([&](const auto& values) {
+        copy.values.emplace<std::decay_t<decltype(values)>>(values, resource);
+    }, packed.values);
+    return copy;
+}
+
 std::shared_ptr<Object> Object::Copy() const {
+    std::shared_ptr<SymbolTable> symbols;
+    return this->Copy(symbols);
+}
+
+std::shared_ptr<Object> Object::Copy(std::shared_ptr<SymbolTable>& symbols) const {
     std::shared_ptr<Object> copy = std::make_shared<Object>(m_Type);
     if (m_Type == Type::NONE) {
 
     }
-    else if (m_Type == Type::SCALAR) {
+    // Copies of a lazy block share its source, which is never modified.
+    else if (std::holds_alternative<LazyBlock>(m_Value)) {
         copy->m_Value = m_Value;
         copy->m_Flags = m_Flags;
     }
+    else if (m_Type == Type::SCALAR) {
+        copy->m_Value.emplace<std::pmr::string>(this->GetScalar());
+        copy->m_Flags = m_Flags;
+        copy->m_ScalarType = m_ScalarType;
+        copy->m_Scale = m_Scale;
+        copy->m_Number = m_Number;
+    }
     else if (m_Type == Type::OBJECT) {
         // Make a deep copy of each objects in the original map.
         const ObjectMap& originalObjects = std::get<ObjectMap>(m_Value);
-        ObjectMap objects;
+        if (symbols == nullptr)
+            symbols = std::make_shared<SymbolTable>();
+        ObjectMap objects(std::pmr::get_default_resource(), symbols);
         objects.reserve(originalObjects.size());
         for (auto [key, pair] : originalObjects) {
             auto [op, value] = pair;
-            objects.insert_missing(key, std::make_pair(op, value->Copy()));
+            objects.insert_missing(key, std::make_pair(op, value->Copy(symbols)));
         }
         copy->m_Value = std::move(objects);
         copy->m_Flags = m_Flags;
     }
+    // Packed arrays are copied without boxing their elements.
+    else if (std::holds_alternative<PackedArray>(m_Value)) {
+        copy->m_Value = CopyPackedArray(std::get<PackedArray>(m_Value), std::pmr::get_default_resource());
+        copy->m_Flags = m_Flags;
+    }
     else if (m_Type == Type::ARRAY) {
         // Make a deep copy of each objects in the original array.
         const ObjectArray& originalArray = std::get<ObjectArray>(m_Value);
         ObjectArray array;
         array.reserve(originalArray.size());
         for (auto object : originalArray)
-            array.push_back(object->Copy());
+            array.push_back(object->Copy(symbols));
         copy->m_Value = std::move(array);
         copy->m_Flags = m_Flags;
     }
     return copy;
 }
 
+std::pmr::memory_resource* Object::GetResource() const {
+    if (std::holds_alternative<ObjectMap>(m_Value))
+        return std::get<ObjectMap>(m_Value).resource();
+    if (std::holds_alternative<ObjectArray>(m_Value))
+        return std::get<ObjectArray>(m_Value).get_allocator().resource();
+    if (std::holds_alternative<ScalarView>(m_Value))
+        return std::get<ScalarView>(m_Value).resource;
+    if (std::holds_alternative<LazyBlock>(m_Value))
+        return std::pmr::get_default_resource();
+    if (std::holds_alternative<PackedArray>(m_Value))
+        return std::get<PackedArray>(m_Value).scales.get_allocator().resource();
+    return std::get<std::pmr::string>(m_Value).get_allocator().resource();
+}
+
+template <typename T> std::shared_ptr<Object> Object::CreateChild(T value) const {
+    // Objects of a document allocate their children in its arena.
+    Arena* arena = FindArena(this->GetResource());
+    if (arena == nullptr)
+        return std::make_shared<Object>(value);
+    return arena->Adopt(Object(value));
+}
+
+template <> std::shared_ptr<Object> Object::CreateChild(std::string_view value) const {
+    Arena* arena = FindArena(this->GetResource());
+    if (arena == nullptr)
+        return std::make_shared<Object>(value);
+    return arena->CreateScalar(value);
+}
+
+template <> std::shared_ptr<Object> Object::CreateChild(Type value) const {
+    Arena* arena = FindArena(this->GetResource());
+    if (arena == nullptr)
+        return std::make_shared<Object>(value);
+    return arena->Create(value);
+}
+
+std::shared_ptr<Object> Object::AdoptChild(const std::shared_ptr<Object>& value) const {
+    // Objects of a document cannot own their children, so the arena keeps
+    // the objects created outside of it alive instead.
+    if (value == nullptr || value.use_count() == 0)
+        return value;
+    Arena* arena = FindArena(this->GetResource());
+    if (arena == nullptr)
+        return value;
+    return arena->Retain(value);
+}
+
+struct LazySource {
+    std::shared_ptr<Buffer> buffer;
+    std::string filePath;
+    // Table of the tree the block was deferred from.
+    std::shared_ptr<SymbolTable> symbols;
+};
+
+void Object::Materialize(bool unpack) const {
+    Object* self = const_cast<Object*>(this);
+    if (std::holds_alternative<LazyBlock>(m_Value)) {
+        // The block is parsed again as the only entry of a root object. If it is invalid,
+        // the error is raised and the object stays lazy.
+        Parser parser;
+        std::shared_ptr<Object> object = parser.ParseLazyBlock(std::get<LazyBlock>(m_Value));
+        self->m_Type = object->m_Type;
+        self->m_Value = std::move(object->m_Value);
+    }
+    if (!unpack || !std::holds_alternative<PackedArray>(m_Value))
+        return;
+    // Each element is boxed into a scalar of the text it was parsed from.
+    const PackedArray& packed = std::get<PackedArray>(m_Value);
+    ObjectArray array(this->GetResource());
+    array.reserve(GetPackedSize(packed));
+    char buffer[16];
+    for (size_t i = 0; i < GetPackedSize(packed); i++)
+        array.push_back(this->CreateChild(std::string_view(buffer, FormatPacked(buffer, packed, i))));
+    self->m_Value = std::move(array);
+}
+
+bool Object::PushPacked(std::string_view scalar, bool convertToArray) {
+    uint8_t scale = 0;
+    int32_t number = 0;
+    ScalarType type = DecodeScalar(scalar, scale, number);
+    if (type != ScalarType::INT && type != ScalarType::FLOAT && type != ScalarType::DATE)
+        return false;
+    // Integers are stored without their sign bit, so -0 is not packed either.
+    if (type == ScalarType::INT && number == 0)
+        scale = 0;
+    char buffer[16];
+    if (std::string_view(buffer, FormatScalar(buffer, type, scale, number)) != scalar)
+        return false;
+
+    if (!std::holds_alternative<PackedArray>(m_Value)) {
+        bool empty = (m_Type == Type::ARRAY && std::holds_alternative<ObjectArray>(m_Value) && std::get<ObjectArray>(m_Value).empty());
+        if (convertToArray && m_Type == Type::OBJECT && std::holds_alternative<ObjectMap>(m_Value))
+            empty = std::get<ObjectMap>(m_Value).empty();
+        if (!empty)
+            return false;
+        std::pmr::memory_resource* resource = this->GetResource();
+        PackedArray packed{ std::pmr::vector<int>(resource), std::pmr::vector<uint8_t>(resource) };
+        if (type == ScalarType::FLOAT)
+            packed.values.emplace<std::pmr::vector<double>>(resource);
+        else if (type == ScalarType::DATE)
+            packed.values.emplace<std::pmr::vector<Date>>(resource);
+        m_Value = std::move(packed);
+        m_Type = Type::ARRAY;
+    }
+
+    PackedArray& packed = std::get<PackedArray>(m_Value);
+    if (type == ScalarType::DATE) {
+        auto* dates = std::get_if<std::pmr::vector<Date>>(&packed.values);
+        if (dates == nullptr)
+            return false;
+        dates->emplace_back(number >> 16, (number >> 8) & 0xFF, number & 0xFF);
+        return true;
+    }
+    if (auto* ints = std::get_if<std::pmr::vector<int>>(&packed.values)) {
+        if (type == ScalarType::INT) {
+            ints->push_back(number);
+            return true;
+        }
+        // Integers followed by a decimal are converted to decimals without decimals.
+        std::pmr::vector<double> floats(ints->size(), ints->get_allocator().resource());
+        packed.scales.resize(ints->size());
+        for (size_t i = 0; i < ints->size(); i++) {
+            floats[i] = (*ints)[i];
+            packed.scales[i] = ((*ints)[i] < 0 ? 0x80 : 0);
+        }
+        packed.values = std::move(floats);
+    }
+    auto* floats = std::get_if<std::pmr::vector<double>>(&packed.values);
+    if (floats == nullptr)
+        return false;
+    // Same value as the conversion of the scalar to a double.
+    double value = std::abs(number) / s_PowersOfTen[scale & 0x7F];
+    floats->push_back((scale & 0x80) ? -value : value);
+    packed.scales.push_back(scale);
+    return true;
+}
+
+void Object::ClassifyScalar() {
+    m_ScalarType = DecodeScalar(this->GetScalar(), m_Scale, m_Number);
+}
+
 Flags Object::GetFlags() const {
     return m_Flags;
 }
@@ -418,20 +1169,28 @@ void Object::SetFlag(Flags flag, bool enabled) {
 void Object::ConvertToArray() {
     if (m_Type == Type::ARRAY)
         return;
+    std::pmr::memory_resource* resource = this->GetResource();
     // If it is currently a scalar, then create an array with it.
     if (m_Type == Type::SCALAR) {
-        m_Value = ObjectArray{std::make_shared<Object>(m_Value)};
+        std::shared_ptr<Object> formerScalar = this->CreateChild(this->GetScalar());
+        m_Value.emplace<ObjectArray>(resource);
         m_Type = Type::ARRAY;
+        std::get<ObjectArray>(m_Value).push_back(formerScalar);
     }
     // If it is an object, then turn it into an array with the former object as the only value.
     else if (m_Type == Type::OBJECT) {
-        std::shared_ptr<Object> formerObject = std::make_shared<Object>(m_Value);
-            
-        m_Value = ObjectArray{};
-        m_Type = Type::ARRAY;
+        std::shared_ptr<Object> formerObject = nullptr;
+
+        // If the former object was not empty, then move it to the array. Lazy blocks
+        // are never empty, and are moved without being parsed.
+        if (std::holds_alternative<LazyBlock>(m_Value) || !std::get<ObjectMap>(m_Value).empty()) {
+            formerObject = this->CreateChild(Type::OBJECT);
+            formerObject->m_Value = std::move(m_Value);
+        }
 
-        // If the former object was not empty, then add it to the array.
-        if (!formerObject->GetMapUnsafe().empty())
+        m_Value.emplace<ObjectArray>(resource);
+        m_Type = Type::ARRAY;
+        if (formerObject != nullptr)
             std::get<ObjectArray>(m_Value).push_back(formerObject);
     }
 }
@@ -446,9 +1205,10 @@ void Object::ConvertToObject() {
     // If it is an empty array, then turn it into an object.
     // Otherwise, raise an exception.
     else if (m_Type == Type::ARRAY) {
+        this->Materialize();
         if (!std::get<ObjectArray>(m_Value).empty())
             throw std::runtime_error("Invalid conversion of non-empty array to object.");
-        m_Value = ObjectMap{};
+        m_Value.emplace<ObjectMap>(this->GetResource());
         m_Type = Type::OBJECT;
     }
 }
@@ -457,97 +1217,264 @@ template <typename T> T Object::As() const {
     if (m_Type != Type::SCALAR)
         throw std::runtime_error("Invalid conversion of object to " + std::string(typeid(T).name()));
     try {
-        return (T) std::get<std::string>(m_Value);
+        return (T) std::string(this->GetScalar());
     }
     catch (std::exception& e) {
         throw std::runtime_error(std::string(e.what()) + " Invalid conversion of object to " + std::string(typeid(T).name()));
     }
 }
 
-template <> std::string Object::As() const {
-    if (m_Type != Type::SCALAR)
-        throw std::runtime_error("Invalid conversion of object to std::string.");
-    return std::get<std::string>(m_Value);
+// Reads an integer like std::stoi: leading blanks and a plus sign are skipped, and the
+// conversion stops at the first character which is not a digit.
+static ConversionError ParseInt(std::string_view text, int& value) {
+    size_t i = 0;
+    while (i < text.size() && std::isspace((unsigned char) text[i]))
+        i++;
+    if (i < text.size() && text[i] == '+' && (i + 1 == text.size() || text[i + 1] != '-'))
+        i++;
+    auto [ptr, ec] = std::from_chars(text.data() + i, text.data() + text.size(), value);
+    if (ec == std::errc::result_out_of_range)
+        return ConversionError::OUT_OF_RANGE;
+    if (ec != std::errc())
+        return ConversionError::INVALID_FORMAT;
+    return ConversionError::NONE;
 }
 
-template <> int Object::As() const {
-    if (m_Type != Type::SCALAR)
-        throw std::runtime_error("Invalid conversion of object to int.");
-    try {
-        return std::stoi(std::get<std::string>(m_Value));
-    }
-    catch (std::exception& e) {
-        throw std::runtime_error(std::string(e.what()) + " Invalid conversion of object to int.");
+// Reads a decimal number like std::stod, without its hexadecimal forms.
+static ConversionError ParseDouble(std::string_view text, double& value) {
+    size_t i = 0;
+    while (i < text.size() && std::isspace((unsigned char) text[i]))
+        i++;
+    if (i < text.size() && text[i] == '+' && (i + 1 == text.size() || text[i + 1] != '-'))
+        i++;
+    auto [ptr, ec] = std::from_chars(text.data() + i, text.data() + text.size(), value);
+    if (ec == std::errc::result_out_of_range)
+        return ConversionError::OUT_OF_RANGE;
+    if (ec != std::errc())
+        return ConversionError::INVALID_FORMAT;
+    return ConversionError::NONE;
+}
+
+// Converts an element of a packed array like Object::TryAs converts the scalar it was parsed from.
+template <typename T> static ConversionError ConvertPacked(const PackedArray& packed, size_t i, T& value);
+
+template <> ConversionError ConvertPacked(const PackedArray& packed, size_t i, std::string& value) {
+    char buffer[16];
+    value.assign(buffer, FormatPacked(buffer, packed, i));
+    return ConversionError::NONE;
+}
+
+template <> ConversionError ConvertPacked(const PackedArray& packed, size_t i, int& value) {
+    if (const auto* ints = std::get_if<std::pmr::vector<int>>(&packed.values))
+        value = (*ints)[i];
+    else if (const auto* floats = std::get_if<std::pmr::vector<double>>(&packed.values))
+        value = GetPackedNumber((*floats)[i], packed.scales[i]) / (int32_t) s_PowersOfTen[packed.scales[i] & 0x7F];
+    else
+        value = std::get<std::pmr::vector<Date>>(packed.values)[i].year;
+    return ConversionError::NONE;
+}
+
+template <> ConversionError ConvertPacked(const PackedArray& packed, size_t i, double& value) {
+    if (const auto* ints = std::get_if<std::pmr::vector<int>>(&packed.values))
+        value = (*ints)[i];
+    else if (const auto* floats = std::get_if<std::pmr::vector<double>>(&packed.values))
+        value = (*floats)[i];
+    else {
+        char buffer[16];
+        return ParseDouble(std::string_view(buffer, FormatPacked(buffer, packed, i)), value);
     }
+    return ConversionError::NONE;
 }
 
-template <> double Object::As() const {
+template <> ConversionError ConvertPacked(const PackedArray& packed, size_t i, bool& value) {
+    return ConversionError::INVALID_FORMAT;
+}
+
+template <> ConversionError ConvertPacked(const PackedArray& packed, size_t i, Date& value) {
+    const auto* dates = std::get_if<std::pmr::vector<Date>>(&packed.values);
+    if (dates == nullptr)
+        return ConversionError::INVALID_FORMAT;
+    value = (*dates)[i];
+    return ConversionError::NONE;
+}
+
+template <> ConversionError Object::TryAs(std::string& value) const {
+    if (m_Type == Type::NONE)
+        return ConversionError::MISSING;
     if (m_Type != Type::SCALAR)
-        throw std::runtime_error("Invalid conversion of object to double.");
-    try {
-        return std::stod(std::get<std::string>(m_Value));
-    }
-    catch (std::exception& e) {
-        throw std::runtime_error(std::string(e.what()) + " Invalid conversion of object to double.");
-    }
+        return ConversionError::INVALID_TYPE;
+    value = this->GetScalar();
+    return ConversionError::NONE;
 }
 
-template <> bool Object::As() const {
+template <> ConversionError Object::TryAs(int& value) const {
+    if (m_Type == Type::NONE)
+        return ConversionError::MISSING;
     if (m_Type != Type::SCALAR)
-        throw std::runtime_error("Invalid conversion of object to boolean.");
-    if (std::get<std::string>(m_Value) == "yes")
-        return true;
-    else if (std::get<std::string>(m_Value) == "no")
-        return false;
-    throw std::runtime_error("Invalid conversion of object to boolean.");
+        return ConversionError::INVALID_TYPE;
+    if (m_ScalarType == ScalarType::INT)
+        value = m_Number;
+    // Like std::stoi, the conversion stops at the first dot.
+    else if (m_ScalarType == ScalarType::FLOAT)
+        value = m_Number / (int32_t) s_PowersOfTen[m_Scale & 0x7F];
+    else if (m_ScalarType == ScalarType::DATE)
+        value = m_Number >> 16;
+    else
+        return ParseInt(this->GetScalar(), value);
+    return ConversionError::NONE;
 }
 
-template <> Date Object::As() const {
+template <> ConversionError Object::TryAs(double& value) const {
+    if (m_Type == Type::NONE)
+        return ConversionError::MISSING;
     if (m_Type != Type::SCALAR)
-        throw std::runtime_error("Invalid conversion of object to date.");
-    try {
-        return Date(std::get<std::string>(m_Value));
+        return ConversionError::INVALID_TYPE;
+    if (m_ScalarType == ScalarType::INT || m_ScalarType == ScalarType::FLOAT) {
+        // Both operands are exact, so the quotient is rounded as by std::stod.
+        value = std::abs(m_Number) / s_PowersOfTen[m_Scale & 0x7F];
+        if (m_Scale & 0x80)
+            value = -value;
+        return ConversionError::NONE;
     }
-    catch (std::exception& e) {
-        throw std::runtime_error(std::string(e.what()) + " Invalid conversion of object to date.");
+    return ParseDouble(this->GetScalar(), value);
+}
+
+template <> ConversionError Object::TryAs(bool& value) const {
+    if (m_Type == Type::NONE)
+        return ConversionError::MISSING;
+    if (m_Type != Type::SCALAR)
+        return ConversionError::INVALID_TYPE;
+    if (m_ScalarType == ScalarType::BOOL)
+        value = m_Number;
+    else if (this->GetScalar() == "yes")
+        value = true;
+    else if (this->GetScalar() == "no")
+        value = false;
+    else
+        return ConversionError::INVALID_FORMAT;
+    return ConversionError::NONE;
+}
+
+template <> ConversionError Object::TryAs(Date& value) const {
+    if (m_Type == Type::NONE)
+        return ConversionError::MISSING;
+    if (m_Type != Type::SCALAR)
+        return ConversionError::INVALID_TYPE;
+    if (m_ScalarType == ScalarType::DATE) {
+        value = Date(m_Number >> 16, (m_Number >> 8) & 0xFF, m_Number & 0xFF);
+        return ConversionError::NONE;
     }
+    // Same format as the constructor of Date from a string.
+    std::string_view scalar = this->GetScalar();
+    size_t dot1 = scalar.find('.');
+    if (dot1 == std::string_view::npos || dot1 == 0)
+        return ConversionError::INVALID_FORMAT;
+    size_t dot2 = scalar.find('.', dot1 + 1);
+    if (dot2 == std::string_view::npos || dot2 == dot1 + 1 || dot2 == scalar.size() - 1)
+        return ConversionError::INVALID_FORMAT;
+    Date date;
+    ConversionError error = ParseInt(scalar.substr(0, dot1), date.year);
+    if (error == ConversionError::NONE)
+        error = ParseInt(scalar.substr(dot1 + 1, dot2 - dot1), date.month);
+    if (error == ConversionError::NONE)
+        error = ParseInt(scalar.substr(dot2 + 1), date.day);
+    if (error == ConversionError::NONE)
+        value = date;
+    return error;
 }
 
-template <> sf::Color Object::As() const {
+template <> ConversionError Object::TryAs(sf::Color& value) const {
+    if (m_Type == Type::NONE)
+        return ConversionError::MISSING;
     if (m_Type != Type::ARRAY)
-        throw std::runtime_error("Invalid conversion of object to sf::Color.");
-    const ObjectArray& array = std::get<ObjectArray>(m_Value);
-    if (array.size() < 3)
-        throw std::runtime_error("Invalid conversion of object to sf::Color.");
-    try {
-        if (this->HasFlag(Flags::HSV) || array.at(0)->GetString().find('.') != std::string::npos) {
-            #define CLAMP(v) std::min(1.0, std::max(0.0, v))
-            double h = CLAMP(array.at(0)->As<double>());
-            double s = CLAMP(array.at(1)->As<double>());
-            double v = CLAMP(array.at(2)->As<double>());
-            double a = (array.size() > 3) ? CLAMP(array.at(3)->As<double>()) : 1.0;
-            return ColorFromHsv(h, s, v, a);
-        }
-        else {
-            int r = array.at(0)->As<int>();
-            int g = array.at(1)->As<int>();
-            int b = array.at(2)->As<int>();
-            int a = (array.size() > 3) ? array.at(3)->As<int>() : 255;
-            return sf::Color(r, g, b, a);
+        return ConversionError::INVALID_TYPE;
+    // The components of a packed color are read without boxing them.
+    this->Materialize(false);
+    const PackedArray* packed = std::get_if<PackedArray>(&m_Value);
+    const ObjectArray* array = std::get_if<ObjectArray>(&m_Value);
+    size_t size = (packed != nullptr ? GetPackedSize(*packed) : array->size());
+    if (size < 3)
+        return ConversionError::INVALID_FORMAT;
+    if (packed == nullptr && array->at(0)->GetType() != Type::SCALAR)
+        return ConversionError::INVALID_TYPE;
+    const auto Convert = [&](size_t i, auto& component) {
+        return (packed != nullptr ? ConvertPacked(*packed, i, component) : array->at(i)->TryAs(component));
+    };
+    std::string first;
+    Convert(0, first);
+    ConversionError error = ConversionError::NONE;
+    if (this->HasFlag(Flags::HSV) || first.find('.') != std::string::npos) {
+        double hsva[4] = { 0.0, 0.0, 0.0, 1.0 };
+        for (size_t i = 0; i < 4 && i < size && error == ConversionError::NONE; i++) {
+            error = Convert(i, hsva[i]);
+            hsva[i] = std::min(1.0, std::max(0.0, hsva[i]));
         }
+        if (error == ConversionError::NONE)
+            value = ColorFromHsv(hsva[0], hsva[1], hsva[2], hsva[3]);
     }
-    catch (std::exception& e) {
-        throw std::runtime_error(std::string(e.what()) + " Invalid conversion of object to sf::Color.");
+    else {
+        int rgba[4] = { 0, 0, 0, 255 };
+        for (size_t i = 0; i < 4 && i < size && error == ConversionError::NONE; i++)
+            error = Convert(i, rgba[i]);
+        if (error == ConversionError::NONE)
+            value = sf::Color(rgba[0], rgba[1], rgba[2], rgba[3]);
     }
+    return error;
+}
+
+template <> std::string Object::As() const {
+    std::string value;
+    ConversionError error = this->TryAs(value);
+    if (error != ConversionError::NONE)
+        throw std::runtime_error(ConversionErrorsLabels.at(error) + " Invalid conversion of object to std::string.");
+    return value;
+}
+
+template <> int Object::As() const {
+    int value = 0;
+    ConversionError error = this->TryAs(value);
+    if (error != ConversionError::NONE)
+        throw std::runtime_error(ConversionErrorsLabels.at(error) + " Invalid conversion of object to int.");
+    return value;
+}
+
+template <> double Object::As() const {
+    double value = 0.0;
+    ConversionError error = this->TryAs(value);
+    if (error != ConversionError::NONE)
+        throw std::runtime_error(ConversionErrorsLabels.at(error) + " Invalid conversion of object to double.");
+    return value;
+}
+
+template <> bool Object::As() const {
+    bool value = false;
+    ConversionError error = this->TryAs(value);
+    if (error != ConversionError::NONE)
+        throw std::runtime_error(ConversionErrorsLabels.at(error) + " Invalid conversion of object to boolean.");
+    return value;
+}
+
+template <> Date Object::As() const {
+    Date value;
+    ConversionError error = this->TryAs(value);
+    if (error != ConversionError::NONE)
+        throw std::runtime_error(ConversionErrorsLabels.at(error) + " Invalid conversion of object to date.");
+    return value;
+}
+
+template <> sf::Color Object::As() const {
+    sf::Color value;
+    ConversionError error = this->TryAs(value);
+    if (error != ConversionError::NONE)
+        throw std::runtime_error(ConversionErrorsLabels.at(error) + " Invalid conversion of object to sf::Color.");
+    return value;
 }
 
 template <typename T> std::optional<T> Object::AsOpt() const {
-    try {
-        std::optional<T> value = std::optional<T>{this->As<T>()};
-        return value;
-    }
-    catch (std::exception& e) {}
-    return std::nullopt;
+    T value;
+    if (this->TryAs(value) != ConversionError::NONE)
+        return std::nullopt;
+    return value;
 }
 template std::optional<std::string> Object::AsOpt() const;
 template std::optional<int> Object::AsOpt() const;
@@ -557,12 +1484,10 @@ template std::optional<Date> Object::AsOpt() const;
 template std::optional<sf::Color> Object::AsOpt() const;
 
 template <typename T> T Object::As(const T& defaultValue) const {
-    try {
-        T value = this->As<T>();
-        return value;
-    }
-    catch (std::exception& e) {}
-    return defaultValue;
+    T value = defaultValue;
+    if (this->TryAs(value) != ConversionError::NONE)
+        return defaultValue;
+    return value;
 }
 template std::string Object::As(const std::string& defaultValue) const;
 template int Object::As(const int& defaultValue) const;
@@ -571,20 +1496,76 @@ template bool Object::As(const bool& defaultValue) const;
 template Date Object::As(const Date& defaultValue) const;
 template sf::Color Object::As(const sf::Color& defaultValue) const;
 
-template <typename T> std::vector<T> Object::AsArray() const {
+template <typename T> ConversionError Object::TryAsArray(std::vector<T>& values) const {
+    if (m_Type == Type::NONE)
+        return ConversionError::MISSING;
     if (m_Type != Type::ARRAY)
-        throw std::runtime_error("Invalid conversion of object to array of " + std::string(typeid(T).name()));
-    ObjectArray array = std::get<ObjectArray>(m_Value);
-    std::vector<T> newArray;
-    newArray.reserve(array.size());
-    try {
-        for (auto obj : array)
-            newArray.push_back(obj->As<T>());
+        return ConversionError::INVALID_TYPE;
+    this->Materialize(false);
+    if (const PackedArray* packed = std::get_if<PackedArray>(&m_Value)) {
+        // Elements already stored as T are copied at once.
+        if constexpr (std::is_same_v<T, int> || std::is_same_v<T, double> || std::is_same_v<T, Date>) {
+            if (const auto* same = std::get_if<std::pmr::vector<T>>(&packed->values)) {
+                values.assign(same->begin(), same->end());
+                return ConversionError::NONE;
+            }
+        }
+        std::vector<T> newArray(GetPackedSize(*packed));
+        for (size_t i = 0; i < newArray.size(); i++) {
+            T value = T();
+            ConversionError error = ConvertPacked(*packed, i, value);
+            if (error != ConversionError::NONE)
+                return error;
+            newArray[i] = std::move(value);
+        }
+        values = std::move(newArray);
+        return ConversionError::NONE;
     }
-    catch (std::exception& e) {
-        throw std::runtime_error(std::string(e.what()) + " Invalid conversion of object to array of " + std::string(typeid(T).name()));
+    const ObjectArray& array = std::get<ObjectArray>(m_Value);
+    std::vector<T> newArray(array.size());
+    for (size_t i = 0; i < array.size(); i++) {
+        // Elements of std::vector<bool> are not addressable, so they are converted through a copy.
+        T value = T();
+        ConversionError error = array[i]->TryAs(value);
+        if (error != ConversionError::NONE)
+            return error;
+        newArray[i] = std::move(value);
     }
-    return newArray;
+    values = std::move(newArray);
+    return ConversionError::NONE;
+}
+template ConversionError Object::TryAsArray(std::vector<std::string>& values) const;
+template ConversionError Object::TryAsArray(std::vector<int>& values) const;
+template ConversionError Object::TryAsArray(std::vector<double>& values) const;
+template ConversionError Object::TryAsArray(std::vector<bool>& values) const;
+template ConversionError Object::TryAsArray(std::vector<Date>& values) const;
+
+bool Object::IsPacked() const {
+    if (m_Type != Type::ARRAY)
+        return false;
+    this->Materialize(false);
+    return std::holds_alternative<PackedArray>(m_Value);
+}
+
+template <typename T> std::optional<std::span<const T>> Object::GetPacked() const {
+    if (m_Type != Type::ARRAY)
+        return std::nullopt;
+    this->Materialize(false);
+    const PackedArray* packed = std::get_if<PackedArray>(&m_Value);
+    if (packed == nullptr || !std::holds_alternative<std::pmr::vector<T>>(packed->values))
+        return std::nullopt;
+    return std::span<const T>(std::get<std::pmr::vector<T>>(packed->values));
+}
+template std::optional<std::span<const int>> Object::GetPacked() const;
+template std::optional<std::span<const double>> Object::GetPacked() const;
+template std::optional<std::span<const Date>> Object::GetPacked() const;
+
+template <typename T> std::vector<T> Object::AsArray() const {
+    std::vector<T> values;
+    ConversionError error = this->TryAsArray(values);
+    if (error != ConversionError::NONE)
+        throw std::runtime_error(ConversionErrorsLabels.at(error) + " Invalid conversion of object to array of " + std::string(typeid(T).name()));
+    return values;
 }
 template std::vector<std::string> Object::AsArray() const;
 template std::vector<int> Object::AsArray() const;
@@ -595,16 +1576,15 @@ template std::vector<Date> Object::AsArray() const;
 template <> std::vector<std::shared_ptr<Object>> Object::AsArray() const {
     if (m_Type != Type::ARRAY)
         throw std::runtime_error("Invalid conversion of object to array of object");
-    return this->Copy()->GetArray();
+    const ObjectArray& array = this->Copy()->GetArray();
+    return std::vector<std::shared_ptr<Object>>(array.begin(), array.end());
 }
 
 template <typename T> std::optional<std::vector<T>> Object::AsArrayOpt() const {
-    try {
-        std::optional<std::vector<T>> value = std::optional<std::vector<T>>{this->AsArray<T>()};
-        return value;
-    }
-    catch (std::exception& e) {}
-    return std::nullopt;
+    std::vector<T> values;
+    if (this->TryAsArray(values) != ConversionError::NONE)
+        return std::nullopt;
+    return values;
 }
 template std::optional<std::vector<std::string>> Object::AsArrayOpt() const;
 template std::optional<std::vector<int>> Object::AsArrayOpt() const;
@@ -613,12 +1593,10 @@ template std::optional<std::vector<bool>> Object::AsArrayOpt() const;
 template std::optional<std::vector<Date>> Object::AsArrayOpt() const;
 
 template <typename T> std::vector<T> Object::AsArray(const std::vector<T>& defaultValue) const {
-    try {
-        std::vector<T> value = this->AsArray<T>();
-        return value;
-    }
-    catch (std::exception& e) {}
-    return defaultValue;
+    std::vector<T> values;
+    if (this->TryAsArray(values) != ConversionError::NONE)
+        return defaultValue;
+    return values;
 }
 template std::vector<std::string> Object::AsArray(const std::vector<std::string>& defaultValue) const;
 template std::vector<int> Object::AsArray(const std::vector<int>& defaultValue) const;
@@ -633,6 +1611,7 @@ bool Object::Contains(std::string_view key) const {
         throw std::runtime_error("Cannot use Contains on array.");
     if (m_Type == Type::NONE)
         return false;
+    this->Materialize();
     return std::get<ObjectMap>(m_Value).contains(key);
 }
 
@@ -641,6 +1620,7 @@ std::shared_ptr<Object> Object::Get(std::string_view key) {
         throw std::runtime_error("Cannot use Get on scalar.");
     if (m_Type == Type::ARRAY)
         throw std::runtime_error("Cannot use Get on array.");
+    this->Materialize();
     auto it = std::get<ObjectMap>(m_Value).find(key);
     if (m_Type == Type::NONE || it == std::get<ObjectMap>(m_Value).end())
         return std::make_shared<Object>(Type::NONE);
@@ -652,11 +1632,13 @@ std::shared_ptr<Object> Object::GetFirst(std::string_view key) {
         throw std::runtime_error("Cannot use Get on scalar.");
     if (m_Type == Type::ARRAY)
         throw std::runtime_error("Cannot use Get on array.");
+    this->Materialize();
     auto it = std::get<ObjectMap>(m_Value).find(key);
     if (m_Type == Type::NONE || it == std::get<ObjectMap>(m_Value).end())
         return std::make_shared<Object>(Type::NONE);
     if (it->second.second->GetType() == Type::ARRAY) {
-        ObjectArray array = std::get<ObjectArray>(it->second.second->m_Value);
+        it->second.second->Materialize();
+        const ObjectArray& array = std::get<ObjectArray>(it->second.second->m_Value);
         if (!array.empty())
             return array.front();
         else
@@ -670,19 +1652,98 @@ Operator Object::GetOperator(std::string_view key) {
         throw std::runtime_error("Cannot use GetOperator on scalar.");
     if (m_Type == Type::ARRAY)
         throw std::runtime_error("Cannot use GetOperator on array.");
+    this->Materialize();
+    auto it = std::get<ObjectMap>(m_Value).find(key);
+    if (m_Type == Type::NONE || it == std::get<ObjectMap>(m_Value).end())
+        return Operator::EQUAL;
+    return it->second.first;
+}
+
+bool Object::Contains(Symbol key) const {
+    if (m_Type == Type::SCALAR)
+        throw std::runtime_error("Cannot use Contains on scalar.");
+    if (m_Type == Type::ARRAY)
+        throw std::runtime_error("Cannot use Contains on array.");
+    if (m_Type == Type::NONE)
+        return false;
+    this->Materialize();
+    return std::get<ObjectMap>(m_Value).contains(key);
+}
+
+std::shared_ptr<Object> Object::Get(Symbol key) {
+    if (m_Type == Type::SCALAR)
+        throw std::runtime_error("Cannot use Get on scalar.");
+    if (m_Type == Type::ARRAY)
+        throw std::runtime_error("Cannot use Get on array.");
+    this->Materialize();
+    auto it = std::get<ObjectMap>(m_Value).find(key);
+    if (m_Type == Type::NONE || it == std::get<ObjectMap>(m_Value).end())
+        return std::make_shared<Object>(Type::NONE);
+    return it->second.second;
+}
+
+std::shared_ptr<Object> Object::GetFirst(Symbol key) {
+    if (m_Type == Type::SCALAR)
+        throw std::runtime_error("Cannot use Get on scalar.");
+    if (m_Type == Type::ARRAY)
+        throw std::runtime_error("Cannot use Get on array.");
+    this->Materialize();
+    auto it = std::get<ObjectMap>(m_Value).find(key);
+    if (m_Type == Type::NONE || it == std::get<ObjectMap>(m_Value).end())
+        return std::make_shared<Object>(Type::NONE);
+    if (it->second.second->GetType() == Type::ARRAY) {
+        it->second.second->Materialize();
+        const ObjectArray& array = std::get<ObjectArray>(it->second.second->m_Value);
+        if (!array.empty())
+            return array.front();
+        else
+            return std::make_shared<Object>(Type::NONE);
+	}
+    return it->second.second;
+}
+
+Operator Object::GetOperator(Symbol key) {
+    if (m_Type == Type::SCALAR)
+        throw std::runtime_error("Cannot use GetOperator on scalar.");
+    if (m_Type == Type::ARRAY)
+        throw std::runtime_error("Cannot use GetOperator on array.");
+    this->Materialize();
     auto it = std::get<ObjectMap>(m_Value).find(key);
     if (m_Type == Type::NONE || it == std::get<ObjectMap>(m_Value).end())
         return Operator::EQUAL;
     return it->second.first;
 }
 
+std::shared_ptr<Object> Object::TryGet(std::string_view key) {
+    if (m_Type != Type::OBJECT)
+        return nullptr;
+    this->Materialize();
+    const ObjectMap& map = std::get<ObjectMap>(m_Value);
+    auto it = map.find(key);
+    if (it == map.end())
+        return nullptr;
+    return it->second.second;
+}
+
+std::shared_ptr<Object> Object::TryGet(Symbol key) {
+    if (m_Type != Type::OBJECT)
+        return nullptr;
+    this->Materialize();
+    const ObjectMap& map = std::get<ObjectMap>(m_Value);
+    auto it = map.find(key);
+    if (it == map.end())
+        return nullptr;
+    return it->second.second;
+}
+
 template <typename T> void Object::Set(T value) {
     if (m_Type == Type::OBJECT)
         throw std::runtime_error("Cannot use Set on object.");
     if (m_Type == Type::ARRAY)
         throw std::runtime_error("Cannot use Set on array.");
     m_Type = Type::SCALAR;
-    m_Value = (std::string) value;
+    m_Value.emplace<std::pmr::string>((std::string) value, this->GetResource());
+    this->ClassifyScalar();
 }
 template void Object::Set(std::string value);
 template void Object::Set(Date value);
@@ -693,7 +1754,8 @@ template <> void Object::Set(std::string_view value) {
     if (m_Type == Type::ARRAY)
         throw std::runtime_error("Cannot use Set on array.");
     m_Type = Type::SCALAR;
-    m_Value = std::string(value);
+    m_Value.emplace<std::pmr::string>(value, this->GetResource());
+    this->ClassifyScalar();
 }
 
 template <> void Object::Set(const char* value) {
@@ -702,7 +1764,8 @@ template <> void Object::Set(const char* value) {
     if (m_Type == Type::ARRAY)
         throw std::runtime_error("Cannot use Set on array.");
     m_Type = Type::SCALAR;
-    m_Value = std::string(value);
+    m_Value.emplace<std::pmr::string>(value, this->GetResource());
+    this->ClassifyScalar();
 }
 
 template <> void Object::Set(int value) {
@@ -711,7 +1774,8 @@ template <> void Object::Set(int value) {
     if (m_Type == Type::ARRAY)
         throw std::runtime_error("Cannot use Set on array.");
     m_Type = Type::SCALAR;
-    m_Value = std::to_string(value);
+    m_Value.emplace<std::pmr::string>(std::to_string(value), this->GetResource());
+    this->ClassifyScalar();
 }
 
 template <> void Object::Set(double value) {
@@ -720,7 +1784,8 @@ template <> void Object::Set(double value) {
     if (m_Type == Type::ARRAY)
         throw std::runtime_error("Cannot use Set on array.");
     m_Type = Type::SCALAR;
-    m_Value = std::to_string(value);
+    m_Value.emplace<std::pmr::string>(std::to_string(value), this->GetResource());
+    this->ClassifyScalar();
 }
 
 template <> void Object::Set(bool value) {
@@ -729,31 +1794,34 @@ template <> void Object::Set(bool value) {
     if (m_Type == Type::ARRAY)
         throw std::runtime_error("Cannot use Set on array.");
     m_Type = Type::SCALAR;
-    m_Value = (value ? "yes" : "false");
+    m_Value.emplace<std::pmr::string>((value ? "yes" : "false"), this->GetResource());
+    this->ClassifyScalar();
 }
 
 template <> void Object::Set(sf::Color value) {
+    std::pmr::memory_resource* resource = this->GetResource();
     m_Type = Type::ARRAY;
     m_Flags = Flags::RGB;
-    m_Value = ObjectArray{};
+    m_Value.emplace<ObjectArray>(resource);
     ObjectArray& array = std::get<ObjectArray>(m_Value);
-    array.push_back(std::make_shared<Object>(value.r));
-    array.push_back(std::make_shared<Object>(value.g));
-    array.push_back(std::make_shared<Object>(value.b));
-    if (value.a != 255) array.push_back(std::make_shared<Object>(value.a));
+    array.push_back(this->CreateChild((int) value.r));
+    array.push_back(this->CreateChild((int) value.g));
+    array.push_back(this->CreateChild((int) value.b));
+    if (value.a != 255) array.push_back(this->CreateChild((int) value.a));
 }
 
 template <typename T> void Object::Push(T value, bool convertToArray) {
     if (m_Type == Type::NONE) {
         m_Type = Type::ARRAY;
-        m_Value = ObjectArray{};
+        m_Value.emplace<ObjectArray>(this->GetResource());
     }
     else if (m_Type != Type::ARRAY) {
         if (!convertToArray)
             throw std::runtime_error("Cannot use Push on scalar or object.");
         this->ConvertToArray();
     }
-    std::get<ObjectArray>(m_Value).push_back(std::make_shared<Object>(value));
+    this->Materialize();
+    std::get<ObjectArray>(m_Value).push_back(this->CreateChild(value));
 }
 template void Object::Push(std::string value, bool convertToArray);
 template void Object::Push(int value, bool convertToArray);
@@ -764,14 +1832,15 @@ template void Object::Push(Date value, bool convertToArray);
 template <> void Object::Push(std::shared_ptr<Object> value, bool convertToArray) {
     if (m_Type == Type::NONE) {
         m_Type = Type::ARRAY;
-        m_Value = ObjectArray{};
+        m_Value.emplace<ObjectArray>(this->GetResource());
     }
     else if (m_Type != Type::ARRAY) {
         if (!convertToArray)
             throw std::runtime_error("Cannot use Push on scalar or object.");
         this->ConvertToArray();
     }
-    std::get<ObjectArray>(m_Value).push_back(value);
+    this->Materialize();
+    std::get<ObjectArray>(m_Value).push_back(this->AdoptChild(value));
 }
 
 void Object::Remove(std::string_view key) {
@@ -781,6 +1850,7 @@ void Object::Remove(std::string_view key) {
         throw std::runtime_error("Cannot use Remove on array.");
     if (m_Type == Type::NONE)
         return;
+    this->Materialize();
     std::get<ObjectMap>(m_Value).erase(key);
 }
 
@@ -791,9 +1861,10 @@ template <typename T> void Object::Put(std::string_view key, T value, Operator o
         throw std::runtime_error("Cannot use Put on array.");
     if (m_Type == Type::NONE) {
         m_Type = Type::OBJECT;
-        m_Value = ObjectMap{};
+        m_Value.emplace<ObjectMap>(this->GetResource());
     }
-    std::get<ObjectMap>(m_Value).insert(key, std::make_pair(op, std::make_shared<Object>(value)));
+    this->Materialize();
+    std::get<ObjectMap>(m_Value).insert(key, std::make_pair(op, this->CreateChild(value)));
 }
 template void Object::Put(std::string_view key, std::string value, Operator op);
 template void Object::Put(std::string_view key, const char* value, Operator op);
@@ -815,9 +1886,10 @@ template <> void Object::Put(std::string_view key, std::shared_ptr<Object> value
         throw std::runtime_error("Cannot use Put on array.");
     if (m_Type == Type::NONE) {
         m_Type = Type::OBJECT;
-        m_Value = ObjectMap{};
+        m_Value.emplace<ObjectMap>(this->GetResource());
     }
-    std::get<ObjectMap>(m_Value).insert(key, std::make_pair(op, value));
+    this->Materialize();
+    std::get<ObjectMap>(m_Value).insert(key, std::make_pair(op, this->AdoptChild(value)));
 }
 
 template <typename T> void Object::Merge(std::string_view key, T value, Operator op) {
@@ -827,29 +1899,34 @@ template <typename T> void Object::Merge(std::string_view key, T value, Operator
         throw std::runtime_error("Cannot use Merge on array.");
     if (m_Type == Type::NONE) {
         m_Type = Type::OBJECT;
-        m_Value = ObjectMap{};
+        m_Value.emplace<ObjectMap>(this->GetResource());
     }
+    this->Materialize();
     ObjectMap& map = std::get<ObjectMap>(m_Value);
-    auto it = map.find(key);
+    Symbol symbol = map.symbols().Intern(key);
+    auto it = map.find(symbol);
     if (it != map.end()) {
-        it->second.second->Push(std::make_shared<Object>(value), true);
+        it->second.second->Push(this->CreateChild(value), true);
     }
     else {
-        map.insert_missing(key, ObjectMap::Value(op, std::make_shared<Object>(value)));
+        map.insert_missing(symbol, ObjectMap::Value(op, this->CreateChild(value)));
     }
 }
 
 template <> void Object::Merge(std::string_view key, std::shared_ptr<Object> value, Operator op) {
+    value = this->AdoptChild(value);
     if (m_Type == Type::SCALAR)
         throw std::runtime_error("Cannot use Merge on scalar.");
     if (m_Type == Type::ARRAY)
         throw std::runtime_error("Cannot use Merge on array.");
     if (m_Type == Type::NONE) {
         m_Type = Type::OBJECT;
-        m_Value = ObjectMap{};
+        m_Value.emplace<ObjectMap>(this->GetResource());
     }
+    this->Materialize();
     ObjectMap& map = std::get<ObjectMap>(m_Value);
-    auto it = map.find(key);
+    Symbol symbol = map.symbols().Intern(key);
+    auto it = map.find(symbol);
     if (it != map.end()) {
         if (it->second.second->HasFlag(Flags::LIST | Flags::RANGE) && value->Is(Type::ARRAY)) {
             for (auto v : value->GetArray())
@@ -860,25 +1937,30 @@ template <> void Object::Merge(std::string_view key, std::shared_ptr<Object> val
         }
     }
     else {
-        map.insert_missing(key, ObjectMap::Value(op, value));
+        map.insert_missing(symbol, ObjectMap::Value(op, value));
     }
 }
 
 template <typename T> void Object::MergeUnsafe(std::string_view key, T value, Operator op) {
+    this->Materialize();
     ObjectMap& map = std::get<ObjectMap>(m_Value);
-    auto it = map.find(key);
+    Symbol symbol = map.symbols().Intern(key);
+    auto it = map.find(symbol);
 
     if (it != map.end()) {
-        it->second.second->Push(std::make_shared<Object>(value), true);
+        it->second.second->Push(this->CreateChild(value), true);
     }
     else {
-        map.insert_missing(key, ObjectMap::Value(op, std::make_shared<Object>(value)));
+        map.insert_missing(symbol, ObjectMap::Value(op, this->CreateChild(value)));
     }
 }
 
 template <> void Object::MergeUnsafe(std::string_view key, std::shared_ptr<Object> value, Operator op) {
+    value = this->AdoptChild(value);
+    this->Materialize();
     ObjectMap& map = std::get<ObjectMap>(m_Value);
-    auto it = map.find(key);
+    Symbol symbol = map.symbols().Intern(key);
+    auto it = map.find(symbol);
 
     if (it != map.end()) {
         if (it->second.second->HasFlag(Flags::LIST | Flags::RANGE) && value->Is(Type::ARRAY)) {
@@ -891,7 +1973,7 @@ template <> void Object::MergeUnsafe(std::string_view key, std::shared_ptr<Objec
         }
     }
     else {
-        map.insert_missing(key, ObjectMap::Value(op, value));
+        map.insert_missing(symbol, ObjectMap::Value(op, value));
     }
 }
 
@@ -901,6 +1983,7 @@ std::shared_ptr<Object> Object::Flatten(bool ignoreDuplicate) const {
     if (m_Type != Type::ARRAY)
         return this->Copy();
         
+    this->Materialize();
     std::shared_ptr<Object> merged = std::make_shared<Object>(ObjectMap{});
     const ObjectArray& array = std::get<ObjectArray>(m_Value);
 
@@ -927,16 +2010,35 @@ std::shared_ptr<Object> Object::Flatten(bool ignoreDuplicate) const {
     return merged;
 }
 
-std::string& Object::GetString() {
+std::string_view Object::GetScalar() const {
+    if (m_Type == Type::OBJECT)
+        throw std::runtime_error("Cannot use GetScalar on object.");
+    if (m_Type == Type::ARRAY)
+        throw std::runtime_error("Cannot use GetScalar on array.");
+    if (m_Type == Type::NONE)
+        return std::string_view();
+    if (std::holds_alternative<ScalarView>(m_Value))
+        return std::get<ScalarView>(m_Value).view;
+    return std::get<std::pmr::string>(m_Value);
+}
+
+std::pmr::string& Object::GetString() {
     if (m_Type == Type::OBJECT)
         throw std::runtime_error("Cannot use GetString on object.");
     if (m_Type == Type::ARRAY)
         throw std::runtime_error("Cannot use GetString on array.");
     if (m_Type == Type::NONE) {
         m_Type = Type::SCALAR;
-        m_Value = std::string();
+        m_Value.emplace<std::pmr::string>(this->GetResource());
     }
-    return std::get<std::string>(m_Value);
+    // The string is modifiable, so a scalar viewing the source must own a copy.
+    if (std::holds_alternative<ScalarView>(m_Value)) {
+        ScalarView scalar = std::get<ScalarView>(m_Value);
+        m_Value.emplace<std::pmr::string>(scalar.view, scalar.resource);
+    }
+    // The string may be modified through the reference, so it can no longer be read as a number.
+    m_ScalarType = ScalarType::STRING;
+    return std::get<std::pmr::string>(m_Value);
 }
 
 ObjectMap& Object::GetMap() {
@@ -946,8 +2048,9 @@ ObjectMap& Object::GetMap() {
         throw std::runtime_error("Cannot use GetMap on array.");
     if (m_Type == Type::NONE) {
         m_Type = Type::OBJECT;
-        m_Value = ObjectMap{};
+        m_Value.emplace<ObjectMap>(this->GetResource());
     }
+    this->Materialize();
     return std::get<ObjectMap>(m_Value);
 }
 
@@ -958,16 +2061,19 @@ ObjectArray& Object::GetArray() {
         throw std::runtime_error("Cannot use GetArray on object.");
     if (m_Type == Type::NONE) {
         m_Type = Type::ARRAY;
-        m_Value = ObjectMap{};
+        m_Value.emplace<ObjectArray>(this->GetResource());
     }
+    this->Materialize();
     return std::get<ObjectArray>(m_Value);
 }
 
 ObjectMap& Object::GetMapUnsafe() {
+    this->Materialize();
     return std::get<ObjectMap>(m_Value);
 }
 
 ObjectArray& Object::GetArrayUnsafe() {
+    this->Materialize();
     return std::get<ObjectArray>(m_Value);
 }
 
@@ -984,12 +2090,13 @@ std::string Object::Serialize(uint32_t depth, bool isRoot, bool isInline) const
 std::string Object::SerializeScalar(uint32_t depth) const {
     if (m_Type != Type::SCALAR)
         return "";
-    return std::get<std::string>(m_Value);
+    return std::string(this->GetScalar());
 }
 
 std::string Object::SerializeObject(uint32_t depth, bool isRoot, bool isInline) const {
     if (m_Type != Type::OBJECT)
         return "";  
+    this->Materialize();
     const ObjectMap& map = std::get<ObjectMap>(m_Value);
 
     // An empty object is an empty-string on first depth, { } otherwise.
@@ -1034,6 +2141,19 @@ std::string Object::SerializeObject(uint32_t depth, bool isRoot, bool isInline)
 std::string Object::SerializeArray(uint32_t depth) const {
     if (m_Type != Type::ARRAY)
         return "";
+    this->Materialize(false);
+
+    // Packed arrays only hold scalars, which are written on a single line.
+    if (const PackedArray* packed = std::get_if<PackedArray>(&m_Value)) {
+        std::string lines = (this->HasFlag(Flags::HSV) ? "hsv { " : this->HasFlag(Flags::RGB) ? "rgb { " : "{ ");
+        char buffer[16];
+        for (size_t i = 0; i < GetPackedSize(*packed); i++) {
+            lines.append(buffer, FormatPacked(buffer, *packed, i));
+            lines.append(" ");
+        }
+        lines.append("}");
+        return lines;
+    }
     const ObjectArray& array = std::get<ObjectArray>(m_Value);
 
     if (array.empty())
@@ -1067,7 +2187,7 @@ std::string Object::SerializeArray(uint32_t depth) const {
     return lines;
 }
 
-std::string Object::SerializeArrayRange(const std::string& key, Operator op, uint32_t depth) const {
+std::string Object::SerializeArrayRange(std::string_view key, Operator op, uint32_t depth) const {
     std::vector<int> l = this->AsArray<int>();
     std::vector<int> loneNumbers;
     std::string indent = std::string(depth, '\t');
@@ -1111,8 +2231,9 @@ std::string Object::SerializeArrayRange(const std::string& key, Operator op, uin
     return lines;
 }
 
-std::string Object::SerializeArrayMultiline(const std::string& key, Operator op, uint32_t depth) const {
-    std::vector<std::shared_ptr<Object>> objects = std::get<ObjectArray>(m_Value);
+std::string Object::SerializeArrayMultiline(std::string_view key, Operator op, uint32_t depth) const {
+    this->Materialize();
+    const ObjectArray& objects = std::get<ObjectArray>(m_Value);
     std::string indent = std::string(depth, '\t');
     std::string lines = "";
 
@@ -1124,508 +2245,3785 @@ std::string Object::SerializeArrayMultiline(const std::string& key, Operator op,
 }
 
 //////////////////////////////////////////////////////////
-//                      Reader                          //
+//                      Buffer                          //
 //////////////////////////////////////////////////////////
 
-Reader::Reader() {}
-
-Reader::Reader(std::string filePath) : Reader() {}
-
-Reader::~Reader() {}
+Buffer::Buffer()
+: m_Mapping(nullptr), m_MappingSize(0)
+{}
 
-void Reader::OpenFile(std::string filePath) {
-    std::ifstream file(filePath, std::ios::binary);
-    if (!file.is_open())
-        return;
-    this->Open(file);
-    file.close();
-}
+Buffer::Buffer(std::string content)
+: m_Storage(std::move(content)), m_Mapping(nullptr), m_MappingSize(0)
+{}
 
-void Reader::OpenString(std::string content) {
-    std::istringstream stream(content);
-    this->Open(stream);
+Buffer::~Buffer() {
+    this->Unmap();
 }
 
-void Reader::Open(std::istream& stream) {
-    // Initialize member variables.
-    m_Buffer.clear();
-    m_View = std::string_view{};
-    m_CurrentLine = 0;
-    m_CurrentCursor = 0;
-    m_CurrentGlobalCursor = 0;
+bool Buffer::MapFile(const std::string& filePath) {
+    this->Unmap();
+    m_Storage.clear();
+#ifdef JOMINI_HAS_MMAP
+    int fd = ::open(filePath.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
 
-    // Copy the whole file into the buffer.
-    stream.seekg(0, std::ios::end);
-    std::streamsize size = stream.tellg();
-    stream.seekg(0, std::ios::beg);
-    m_Buffer.resize(static_cast<size_t>(size));
-    stream.read(m_Buffer.data(), size);
+    struct stat info;
+    if (::fstat(fd, &info) != 0 || !S_ISREG(info.st_mode)) {
+        ::close(fd);
+        return false;
+    }
 
-    // Ignore first three UTF8 BOM bytes.
-    if (m_Buffer.size() > 2 && m_Buffer.at(0) == '\xEF' && m_Buffer.at(1) == '\xBB' && m_Buffer.at(2) == '\xBF') {
-        m_Buffer = m_Buffer.substr(3, m_Buffer.size()-3);
+    // Empty files cannot be mapped, but they are still valid sources.
+    if (info.st_size == 0) {
+        ::close(fd);
+        return true;
     }
 
-    // Initialize the string view using the buffer.
-    m_View = std::string_view(m_Buffer);
-}
+    void* mapping = ::mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (mapping == MAP_FAILED)
+        return false;
 
-bool Reader::IsEmpty() {
-    return m_CurrentGlobalCursor >= m_View.size();
-}
+    // The parser reads the file front to back only once, so let the kernel
+    // read ahead aggressively and drop pages behind the cursor.
+    ::madvise(mapping, info.st_size, MADV_SEQUENTIAL);
+    ::madvise(mapping, info.st_size, MADV_WILLNEED);
 
-char Reader::Read() {
-    if (m_CurrentGlobalCursor >= m_View.size())
-        throw std::out_of_range("tried to read character outside of buffer bounds.");
-    this->IncrementLine();
-    return m_View[m_CurrentGlobalCursor++];
+    m_Mapping = static_cast<char*>(mapping);
+    m_MappingSize = static_cast<size_t>(info.st_size);
+    return true;
+#else
+    return false;
+#endif
 }
 
-char Reader::Peek() {
-    if (m_CurrentGlobalCursor >= m_View.size())
-        return '\0';
-    this->IncrementLine();
-    return m_View[m_CurrentGlobalCursor++];
-}
+bool Buffer::ReadFile(const std::string& filePath) {
+    this->Unmap();
+    m_Storage.clear();
 
-bool Reader::Match(char expected) {
-    if (m_CurrentGlobalCursor < m_View.size() && m_View[m_CurrentGlobalCursor] == expected) {
-        this->IncrementLine();
-        m_CurrentGlobalCursor++;
-        return true;
+    // Directories and special files have no size, and a short read would leave zeros in the source.
+    std::error_code error;
+    if (!std::filesystem::is_regular_file(filePath, error))
+        return false;
+    std::ifstream file(filePath, std::ios::binary | std::ios::ate);
+    if (!file.is_open())
+        return false;
+    std::streamsize size = file.tellg();
+    if (size < 0)
+        return false;
+    file.seekg(0, std::ios::beg);
+    m_Storage.resize(static_cast<size_t>(size));
+    file.read(m_Storage.data(), size);
+    if (file.gcount() != size) {
+        m_Storage.clear();
+        return false;
     }
-    return false;
+    return true;
 }
 
-std::string_view Reader::ReadUntil(const std::function<bool(char)>& predicate, bool includePrevious, bool includeLast) {
-    if (m_CurrentGlobalCursor >= m_View.size()+includePrevious)
-        return std::string_view{};
-    size_t start = m_CurrentGlobalCursor - (size_t) includePrevious;
-    size_t end = start + (size_t) includePrevious;
-    while (end < m_View.size() && !predicate(m_View[end]))
-        end++;
-    if (includeLast)
-        end++;
-    m_CurrentGlobalCursor = end;
-    m_CurrentCursor += end-start;
-    return m_View.substr(start, end - start);
+bool Buffer::IsMapped() const {
+    return m_Mapping != nullptr;
 }
 
-void Reader::SkipUntil(const std::function<bool(char)>& predicate) {
-    if (m_CurrentGlobalCursor >= m_View.size())
-        return;
-    size_t pos = m_CurrentGlobalCursor;
-    while (pos < m_View.size() && !predicate(m_View[pos])) {
-        pos++;
-        m_CurrentCursor++;
-    }
-    m_CurrentGlobalCursor = pos;
-    return;
+std::string_view Buffer::GetView() const {
+    if (m_Mapping != nullptr)
+        return std::string_view(m_Mapping, m_MappingSize);
+    return std::string_view(m_Storage);
 }
 
-std::string_view Reader::GetView() const {
-    return m_View;
+void Buffer::Unmap() {
+#ifdef JOMINI_HAS_MMAP
+    if (m_Mapping != nullptr)
+        ::munmap(m_Mapping, m_MappingSize);
+#endif
+    m_Mapping = nullptr;
+    m_MappingSize = 0;
 }
 
-std::string_view Reader::GetLine(uint32_t line) const {
-    // This code does not need to be performant as
-    // it is only used if an exception is raised.
-    size_t start = 0;
-    for (uint32_t n = 0; n < line; n++) {
-        size_t pos = m_View.find('\n', start);
-        if (pos == std::string_view::npos)
-            return {};
-        start = pos + 1;
-    }
-    size_t end = m_View.find('\n', start);
-    return m_View.substr(start, (end == std::string_view::npos ? m_View.size() : end) - start);
-}
+//////////////////////////////////////////////////////////
+//                      Scanner                         //
+//////////////////////////////////////////////////////////
 
-uint32_t Reader::GetCurrentLine() const {
-    return m_CurrentLine;
+// Classes of the characters of the grammar. Quotes are not delimiters, so they
+// belong to the other characters and are handled when reading tokens.
+enum class CharClass : uint8_t {
+    OTHER,
+    BLANK,
+    OPERATOR,
+    OPEN_BRACE,
+    CLOSE_BRACE,
+    COMMENT,
+};
+
+static constexpr auto s_CharClasses = []() {
+    std::array<CharClass, 256> table{};
+    for (unsigned char c : std::string_view(" \t\r\n"))
+        table[c] = CharClass::BLANK;
+    for (unsigned char c : std::string_view("=<>!?"))
+        table[c] = CharClass::OPERATOR;
+    table['{'] = CharClass::OPEN_BRACE;
+    table['}'] = CharClass::CLOSE_BRACE;
+    table['#'] = CharClass::COMMENT;
+    return table;
+}();
+
+static constexpr CharClass GetCharClass(char c) {
+    return s_CharClasses[(unsigned char) c];
 }
 
-uint32_t Reader::GetCurrentCursor() const {
-    return m_CurrentCursor;
+// Characters ending a token: blanks, operators, braces and comments.
+static constexpr auto s_Delimiters = []() {
+    std::array<bool, 256> table{};
+    for (size_t c = 0; c < table.size(); c++)
+        table[c] = (s_CharClasses[c] != CharClass::OTHER);
+    return table;
+}();
+
+static const char* ScanDelimiterScalar(const char* begin, const char* end) {
+    while (begin < end && !s_Delimiters[(unsigned char) *begin])
+        begin++;
+    return begin;
 }
 
-void Reader::IncrementLine() {
-    if (m_View[m_CurrentGlobalCursor] == '\n') {
-        m_CurrentLine++;
-        m_CurrentCursor = 0;
-        return;
+#ifdef JOMINI_HAS_SSE2
+static const char* ScanDelimiterSSE2(const char* begin, const char* end) {
+    #define MATCH(c) _mm_cmpeq_epi8(block, _mm_set1_epi8(c))
+    for (; begin + 16 <= end; begin += 16) {
+        __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(begin));
+        __m128i blanks = _mm_or_si128(_mm_or_si128(MATCH(' '), MATCH('\t')), _mm_or_si128(MATCH('\r'), MATCH('\n')));
+        __m128i operators = _mm_or_si128(_mm_or_si128(MATCH('='), MATCH('<')), _mm_or_si128(MATCH('>'), _mm_or_si128(MATCH('!'), MATCH('?'))));
+        __m128i others = _mm_or_si128(_mm_or_si128(MATCH('{'), MATCH('}')), MATCH('#'));
+        int mask = _mm_movemask_epi8(_mm_or_si128(_mm_or_si128(blanks, operators), others));
+        if (mask != 0)
+            return begin + __builtin_ctz(mask);
     }
-    if (m_CurrentGlobalCursor < m_View.size()-1)
-        m_CurrentCursor++;
+    #undef MATCH
+    return ScanDelimiterScalar(begin, end);
+}
+#endif
+
+#ifdef JOMINI_HAS_AVX2
+__attribute__((target("avx2")))
+static const char* ScanDelimiterAVX2(const char* begin, const char* end) {
+    #define MATCH(c) _mm256_cmpeq_epi8(block, _mm256_set1_epi8(c))
+    for (; begin + 32 <= end; begin += 32) {
+        __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(begin));
+        __m256i blanks = _mm256_or_si256(_mm256_or_si256(MATCH(' '), MATCH('\t')), _mm256_or_si256(MATCH('\r'), MATCH('\n')));
+        __m256i operators = _mm256_or_si256(_mm256_or_si256(MATCH('='), MATCH('<')), _mm256_or_si256(MATCH('>'), _mm256_or_si256(MATCH('!'), MATCH('?'))));
+        __m256i others = _mm256_or_si256(_mm256_or_si256(MATCH('{'), MATCH('}')), MATCH('#'));
+        unsigned int mask = (unsigned int) _mm256_movemask_epi8(_mm256_or_si256(_mm256_or_si256(blanks, operators), others));
+        if (mask != 0)
+            return begin + __builtin_ctz(mask);
+    }
+    #undef MATCH
+    return ScanDelimiterSSE2(begin, end);
+}
+#endif
+
+using ScanFunction = const char* (*)(const char*, const char*);
+
+static std::pair<ScanFunction, std::string_view> SelectScanner() {
+#ifdef JOMINI_HAS_AVX2
+    if (__builtin_cpu_supports("avx2"))
+        return { ScanDelimiterAVX2, "avx2" };
+#endif
+#ifdef JOMINI_HAS_SSE2
+    return { ScanDelimiterSSE2, "sse2" };
+#else
+    return { ScanDelimiterScalar, "scalar" };
+#endif
 }
 
-//////////////////////////////////////////////////////////
-//                      Parser                          //
-//////////////////////////////////////////////////////////
-
-Parser::Parser()
-: m_FilePath(""), m_Reader(Reader()), m_PreviousLine(0), m_PreviousCursor(0), m_LastBraceLine(0)
-{}
-
-void Parser::ThrowError(const std::string& error, const std::string& cursorError, int cursorOffset, std::string sourceFile, int sourceFileLine) {
-    std::string message = std::format(
-        "{}:{}: an exception has been raised.\n",
-        sourceFile,
-        sourceFileLine
-    );
-
-    message += std::format(
-        "{}:{}:{}: error: {}\n",
-        m_FilePath,
-        m_PreviousLine+1,
-        std::max(1, m_PreviousCursor+cursorOffset+1),
-        error
-    );
-
-    std::string tab1 = std::string(std::to_string(m_PreviousLine).length(), ' ');
-    std::string tab2 = std::string(std::max(0, m_PreviousCursor+cursorOffset), ' ');
-
-    // Add the last line with an opening brace if relevent to the exception.
-    if (m_LastBraceLine != m_PreviousLine) {
-        message += std::format(
-            "\t{} | {}\n",
-            m_LastBraceLine+1, m_Reader.GetLine(m_LastBraceLine)
-        );
-
-        if (m_LastBraceLine != m_PreviousLine-1)
-            message += std::format("\t{} | ...\n", tab1);
-    }
-    
-    // Add the last relevent line and the error arrow.
-    message += std::format(
-        "\t{} | {}\n"
-        "\t{} | {}^\n"
-        "\t{} | {}|\n"
-        "\t{} | {}{}",
-        m_PreviousLine+1, m_Reader.GetLine(m_PreviousLine),
-        tab1, tab2,
-        tab1, tab2,
-        tab1, tab2, cursorError
-    );
-
-    throw std::runtime_error(message);
+// The scanner is selected on first use, so that sources can be parsed from static
+// initializers of other translation units.
+static const std::pair<ScanFunction, std::string_view>& GetScanner() {
+    static const std::pair<ScanFunction, std::string_view> scanner = SelectScanner();
+    return scanner;
 }
 
-std::shared_ptr<Object> Parser::ParseFile(const std::string& filePath) {
-    // Initialize the reader with the file.
-    m_FilePath = filePath;
-    m_Reader.OpenFile(filePath);
-
-    // Initialize the line number on the first function call.
-    m_PreviousLine = 0;
-    m_PreviousCursor = 0;
-    m_LastBraceLine = 0;
-
-    // Parse the file recursively from the root.
-    std::shared_ptr<Object> obj = this->Parse(0);
-    return obj;
+const char* ScanDelimiter(const char* begin, const char* end) {
+    return GetScanner().first(begin, end);
 }
 
-std::shared_ptr<Object> Parser::ParseString(const std::string& content) {
-    // Initialize the reader with the string.
-    m_FilePath = "";
-    m_Reader.OpenString(content);
-
-    // Initialize the line number on the first function call.
-    m_PreviousLine = 0;
-    m_PreviousCursor = 0;
-    m_LastBraceLine = 0;
-
-    // Parse the file recursively from the root.
-    std::shared_ptr<Object> obj = this->Parse(0);
-    return obj;
+const char* ScanChar(const char* begin, const char* end, char c) {
+    // memchr is already vectorized by the standard library.
+    if (begin >= end)
+        return end;
+    const void* found = std::memchr(begin, c, end - begin);
+    return (found != nullptr) ? static_cast<const char*>(found) : end;
 }
 
-#define IS_BLANK(ch) (ch == ' ' || ch == '\t' || ch == '\r' || ch == '\n')
-#define IS_OPERATOR(ch) (ch == '=' || ch == '<' || ch == '>' || ch == '!' || ch == '?')
-#define IS_BRACE(ch) (ch == '{' || ch == '}')
-#define IS_COMMENT(ch) (ch == '#')
-
-const auto newLinePredicate = [](char c){ return c == '\n'; };
-const auto blankPredicate = [](char c){ return IS_BLANK(c) || IS_OPERATOR(c) || IS_BRACE(c) || IS_COMMENT(c); };
-const auto quotePredicate = [](char c){ return c == '"'; };
-
-std::shared_ptr<Object> Parser::Parse(int depth) {
-    // Initialize the main object, key and operator.
-    // Depending on what is read, the object can be an scalar, an object (map) or an array.
-    // Key and operator are not used if it isn't parsing a map object.
-    std::shared_ptr<Object> mainObject = std::make_shared<Object>(ObjectMap{});
-    std::string_view key = "";
-    Operator op = Operator::EQUAL;
-    Flags flags = Flags::NONE;
-
-    // Initialize the current parsing state:
-    int state = 1;
+std::string_view GetScannerName() {
+    return GetScanner().second;
+}
 
-    // Loop over one character at a time, until the stream is empty.
-    while (!m_Reader.IsEmpty()) {
-        char ch = m_Reader.Read();
+//////////////////////////////////////////////////////////
+//                       Lexer                          //
+//////////////////////////////////////////////////////////
 
-        if (IS_BLANK(ch))
-            continue;
-        if (IS_COMMENT(ch)) {
-            m_Reader.SkipUntil(newLinePredicate);
-            continue;
+namespace {
+    // Compares a token to a lowercase literal, ignoring the case of the token.
+    constexpr bool EqualsIgnoreCase(std::string_view sv, std::string_view lit) {
+        if (sv.size() != lit.size())
+            return false;
+        for (std::size_t i = 0; i < sv.size(); i++) {
+            if (sv[i] != lit[i] && char(sv[i] + ('a' - 'A')) != lit[i])
+                return false;
         }
+        return true;
+    }
 
-        m_PreviousLine = m_Reader.GetCurrentLine();
-        m_PreviousCursor = m_Reader.GetCurrentCursor()-1;
+    // Returns the flag named by a token, or NONE if it is not a flag keyword.
+    Flags GetFlag(std::string_view token) {
+        // Ignore tokens larger than 'RANGE' (i.e 5 characters).
+        if (token.size() > 5)
+            return Flags::NONE;
+        if (EqualsIgnoreCase(token, "rgb"))
+            return Flags::RGB;
+        if (EqualsIgnoreCase(token, "hsv"))
+            return Flags::HSV;
+        if (EqualsIgnoreCase(token, "list"))
+            return Flags::LIST;
+        if (EqualsIgnoreCase(token, "range"))
+            return Flags::RANGE;
+        return Flags::NONE;
+    }
+}
 
-        // State #1a: stop reading return the current main object.
-        //  - from: initial, state #3
-        //  - next: terminal
-        //  - accepts: }
-        if (state == 1 && ch == '}') {
-            if (depth == 0)
-                THROW_ERROR("unexpected closing brace '}'", "unmatched closing brace", -1);
-            return mainObject;
-        }
-        // State #1b: parsing object in array.
-        //  - from: initial, state #3
-        //  - next: state #4
-        //  - accepts: {
-        else if (state == 1 && ch == '{') {
-            if (mainObject->Is(Type::OBJECT) && !mainObject->GetMapUnsafe().empty())
-                THROW_ERROR("unexpected opening brace '{' inside key-value block", "stray opening brace", 0);
-            int lastBrace = m_Reader.GetCurrentLine();
-            m_LastBraceLine = lastBrace;
-            std::shared_ptr<Object> object = this->Parse(depth+1);
-            m_LastBraceLine = lastBrace;
+Lexer::Lexer(std::string_view input)
+: m_Input(input), m_Offset(0), m_AfterOperator(false)
+{
+    // Ignore first three UTF8 BOM bytes, like the reader.
+    if (m_Input.size() > 2 && m_Input[0] == '\xEF' && m_Input[1] == '\xBB' && m_Input[2] == '\xBF')
+        m_Offset = 3;
+}
 
-            mainObject->Push(object, true);
+Token Lexer::Next() {
+    const char* begin = m_Input.data();
+    const char* end = begin + m_Input.size();
+    const char* it = begin + m_Offset;
+    while (it < end && GetCharClass(*it) == CharClass::BLANK)
+        it++;
+
+    Token token = { TokenType::END, std::string_view(), (size_t) (it - begin), Operator::EQUAL, Flags::NONE };
+    if (it == end) {
+        m_Offset = token.offset;
+        return token;
+    }
 
-            key = "";
-            state = 4;
-        }
-        // State #1c: parsing key.
-        //  - from: initial, state #3
-        //  - next: state #2
-        //  - accepts: non-blank, non-operator
-        else if (state == 1) {
-            if (IS_OPERATOR(ch))
-                THROW_ERROR(std::format("expected key before '{}'", OperatorsLabels.at(op)), "missing key", 0);
-            key = m_Reader.ReadUntil((ch == '"' ? quotePredicate : blankPredicate), true, ch == '"');
-            state = 2;
-        }
-        // State #2a: parsing operator after #1.
-        //  - from: state #1c
-        //  - next: state #3
-        //  - accepts: =, <, >, !, ?
-        else if (state == 2 && IS_OPERATOR(ch)) {
-            if (ch == '!' && !m_Reader.Match('='))
-                THROW_ERROR("unexpected token '!'", "unexpected exclamation mark; did you mean '!='?", -1);
-            if (ch == '?' && !m_Reader.Match('='))
-                THROW_ERROR("unexpected token '?'", "unexpected question mark; did you mean '?='?", -1);
+    const char* start = it;
+    switch (GetCharClass(*it)) {
+        case CharClass::COMMENT:
+            it = ScanChar(it, end, '\n');
+            token.type = TokenType::COMMENT;
+            break;
+        case CharClass::OPEN_BRACE:
+            it++;
+            token.type = TokenType::OPEN_BRACE;
+            break;
+        case CharClass::CLOSE_BRACE:
+            it++;
+            token.type = TokenType::CLOSE_BRACE;
+            break;
+        case CharClass::OPERATOR: {
+            char ch = *it++;
+            bool equal = (ch != '=' && it < end && *it == '=');
+            if (equal)
+                it++;
+            token.type = TokenType::OPERATOR;
             switch (ch) {
                 case '=':
-                    op = Operator::EQUAL;
+                    token.op = Operator::EQUAL;
                     break;
                 case '<':
-                    op = (m_Reader.Match('=') ? Operator::LESS_EQUAL : Operator::LESS);
+                    token.op = (equal ? Operator::LESS_EQUAL : Operator::LESS);
                     break;
                 case '>':
-                    op = (m_Reader.Match('=') ? Operator::GREATER_EQUAL : Operator::GREATER);
+                    token.op = (equal ? Operator::GREATER_EQUAL : Operator::GREATER);
                     break;
                 case '!':
-                    op = Operator::NOT_EQUAL;
+                    token.op = Operator::NOT_EQUAL;
+                    token.type = (equal ? TokenType::OPERATOR : TokenType::INVALID);
                     break;
                 case '?':
-                    op = Operator::NOT_NULL;
+                    token.op = Operator::NOT_NULL;
+                    token.type = (equal ? TokenType::OPERATOR : TokenType::INVALID);
                     break;
             }
-            state = 3;
-        }
-        // State #2b: parsing an object after a scalar and create an array.
-        //  - from: state #1c
-        //  - next: state #4
-        //  - accepts: {
-        else if (state == 2 && ch == '{') {
-            if (mainObject->Is(Type::OBJECT) && !mainObject->GetMapUnsafe().empty())
-                THROW_ERROR("unexpected opening brace '{' inside key-value block; expected operator", "stray opening brace; did you mean '='?", -1);
-            int lastBrace = m_Reader.GetCurrentLine();
-            m_LastBraceLine = lastBrace;
-            std::shared_ptr<Object> object = this->Parse(depth+1);
-            m_LastBraceLine = lastBrace;
-            mainObject->Push(key, true);
-            mainObject->Push(object);
-            key = "";
-            state = 4;
+            break;
         }
-        // State #2c: stop parsing a single value array.
-        //  - from: state #1c
-        //  - next: terminal
-        //  - accepts: }
-        else if (state == 2 && ch == '}') {
-            if (mainObject->Is(Type::OBJECT) && !mainObject->GetMapUnsafe().empty())
-                THROW_ERROR("unexpected closing brace '}'; expected '=' or another operator", "unexpected closing brace; did you mean '='?", 0);
-            mainObject->Push(key, true);
-            return mainObject;
+        default:
+            if (*it == '"') {
+                it = ScanChar(it + 1, end, '"');
+                token.type = (it < end ? TokenType::STRING : TokenType::INVALID);
+                if (it < end)
+                    it++;
+                break;
+            }
+            it = ScanDelimiter(it, end);
+            token.type = TokenType::SCALAR;
+            if (m_AfterOperator) {
+                token.flag = GetFlag(std::string_view(start, it - start));
+                if (token.flag != Flags::NONE)
+                    token.type = TokenType::FLAG;
+            }
+            break;
+    }
+
+    token.text = std::string_view(start, it - start);
+    m_Offset = it - begin;
+    if (token.type != TokenType::COMMENT)
+        m_AfterOperator = (token.type == TokenType::OPERATOR || token.type == TokenType::FLAG);
+    return token;
+}
+
+std::string_view Lexer::GetInput() const {
+    return m_Input;
+}
+
+size_t Lexer::GetOffset() const {
+    return m_Offset;
+}
+
+//////////////////////////////////////////////////////////
+//                  Structural Index                    //
+//////////////////////////////////////////////////////////
+
+namespace {
+
+    // Bitmasks of the characters of a 64-byte block, one bit per byte.
+    struct BlockMasks {
+        uint64_t quotes;
+        uint64_t comments;
+        uint64_t newlines;
+        uint64_t blanks;
+        uint64_t structurals;
+    };
+
+    void ClassifyBlock(const char* block, BlockMasks& masks) {
+#ifdef JOMINI_HAS_SSE2
+        masks = BlockMasks{};
+        #define MATCH(c) _mm_cmpeq_epi8(chunk, _mm_set1_epi8(c))
+        #define MASK(v) ((uint64_t) (uint16_t) _mm_movemask_epi8(v) << (16 * i))
+        for (int i = 0; i < 4; i++) {
+            __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(block + 16 * i));
+            __m128i newlines = MATCH('\n');
+            __m128i blanks = _mm_or_si128(_mm_or_si128(MATCH(' '), MATCH('\t')), _mm_or_si128(MATCH('\r'), newlines));
+            __m128i operators = _mm_or_si128(_mm_or_si128(MATCH('='), MATCH('<')), _mm_or_si128(MATCH('>'), _mm_or_si128(MATCH('!'), MATCH('?'))));
+            __m128i structurals = _mm_or_si128(operators, _mm_or_si128(MATCH('{'), MATCH('}')));
+            masks.quotes |= MASK(MATCH('"'));
+            masks.comments |= MASK(MATCH('#'));
+            masks.newlines |= MASK(newlines);
+            masks.blanks |= MASK(blanks);
+            masks.structurals |= MASK(structurals);
         }
-        // State #2d: parsing an array.
-        //  - from: state #1c
-        //  - next: state #4
-        //  - accepts: non-blank
-        else if (state == 2) {
-            if (mainObject->Is(Type::OBJECT) && !mainObject->GetMapUnsafe().empty())
-                THROW_ERROR("unexpected value after key inside key-value block; expected operator", "unexpected value", -1);
-            std::string_view buffer = m_Reader.ReadUntil((ch == '"' ? quotePredicate : blankPredicate), true, ch == '"');
-            mainObject->Push(key, true);
-            mainObject->Push(buffer);
-            key = "";
-            state = 4;
+        #undef MASK
+        #undef MATCH
+#else
+        masks = BlockMasks{};
+        for (int i = 0; i < 64; i++) {
+            uint64_t bit = 1ull << i;
+            switch (block[i]) {
+                case '"': masks.quotes |= bit; break;
+                case '#': masks.comments |= bit; break;
+                case '\n': masks.newlines |= bit; masks.blanks |= bit; break;
+                case ' ': case '\t': case '\r': masks.blanks |= bit; break;
+                case '=': case '<': case '>': case '!': case '?': case '{': case '}': masks.structurals |= bit; break;
+            }
         }
-        // State #3a: parsing object value.
-        //  - from: state #2a, state #3b
-        //  - next: state #1
-        //  - accepts: {
-        else if (state == 3 && ch == '{') {
-            int lastBrace = m_Reader.GetCurrentLine();
-            m_LastBraceLine = lastBrace;
-            std::shared_ptr<Object> object = this->Parse(depth+1);
-            m_LastBraceLine = lastBrace;
+#endif
+    }
 
-            // Empty object are by default all map objects, so if there is
-            // a list flags attached, the convert it to an array.
-            if (object->Is(Type::OBJECT) && ((bool) (flags & (Flags::LIST | Flags::RANGE))))
-                object->ConvertToArray();
+    // Returns a mask with the bits from..to (inclusive) set.
+    uint64_t RangeMask(int from, int to) {
+        if (to < from)
+            return 0;
+        uint64_t upper = (to == 63) ? ~0ull : ((1ull << (to + 1)) - 1);
+        return upper & ~((1ull << from) - 1);
+    }
 
-            // Convert range to an array.
-            if ((bool) (flags & Flags::RANGE)) {
-                if (!object->Is(Type::ARRAY))
-                    THROW_ERROR("expected 2-number-array in RANGE block", "expected array", 0);
-                ObjectArray& array = object->GetArray();
-                if (array.size() != 2 || !array.at(0)->Is(Type::SCALAR) || !array.at(1)->Is(Type::SCALAR))
-                    THROW_ERROR("expected 2-number-array in RANGE block", "expected 2 numbers", 0);
-                int a = array.at(0)->As<int>();
-                int b = array.at(1)->As<int>();
-                array.clear();
-                if (a <= b) for (int i = a; i <= b; i++)
-                    array.push_back(std::make_shared<Object>(i));
-                else for (int i = a; i >= b; i--)
-                    array.push_back(std::make_shared<Object>(i));
-            }
-            mainObject->MergeUnsafe(key, object, op);
-            mainObject->Get(key)->SetFlag(flags, true);
-            flags = Flags::NONE;
-            key = "";
-            state = 1;
+}
+
+StructuralIndex::StructuralIndex() {}
+
+bool StructuralIndex::Build(std::string_view view) {
+    m_View = view;
+    m_Positions.clear();
+    if (view.size() > UINT32_MAX)
+        return false;
+    m_Positions.reserve(view.size() / 4);
+
+    // State carried from one block to the next.
+    bool inString = false;
+    bool inComment = false;
+    uint64_t previousDelimiter = 1; // The start of the input delimits the first token.
+    uint64_t previousAtom = 0;
+    uint64_t lastStringEnd = UINT64_MAX;
+
+    char padded[64];
+    for (uint64_t base = 0; base < view.size(); base += 64) {
+        // The last block is padded with blanks, which never produce tokens.
+        const char* block = view.data() + base;
+        size_t length = std::min<size_t>(64, view.size() - base);
+        if (length < 64) {
+            std::memset(padded, ' ', sizeof(padded));
+            std::memcpy(padded, block, length);
+            block = padded;
         }
-        // State #3b: parsing scalar value.
-        //  - from: state #2a, state #3b
-        //  - next: state #1, state #3
-        //  - accepts: non-blank, non-operator
-        else if (state == 3) {
-            if (IS_OPERATOR(ch))
-                THROW_ERROR(std::format("unexpected '{}' after operator inside key-value block", (char) ch), "unexpected operator", 0);
-            if (IS_BRACE(ch))
-                THROW_ERROR("unexpected closing brace '}' after operator inside key-value block", "unexpected closing brace", 0);
-            std::string_view buffer = m_Reader.ReadUntil((ch == '"' ? quotePredicate : blankPredicate), true, ch == '"');
-            
-            // Ignore flags if the buffer is larger than 'RANGE' (i.e 5 characters).
-            if (buffer.size() > 5) {
-                mainObject->MergeUnsafe(key, std::make_shared<Object>(buffer), op);
-                key = "";
-                state = 1;
-                continue;
-            }
 
-            constexpr auto EqualsIgnoreCase = [](std::string_view sv, std::string_view lit) {
-                if (sv.size() != lit.size())
-                    return false;
-                for (std::size_t i = 0; i < sv.size(); i++) {
-                    if (sv[i] != lit[i] && char(sv[i] + ('a' - 'A')) != lit[i])
-                        return false;
+        BlockMasks masks;
+        ClassifyBlock(block, masks);
+        uint64_t delimiters = masks.blanks | masks.structurals;
+
+        // Quotes, comments and newlines are rare enough to be handled one by one.
+        // A quote only opens a string at the start of a token, a comment runs until
+        // the end of the line and neither can start inside the other.
+        uint64_t inside = 0;
+        uint64_t openings = 0;
+        int regionStart = 0;
+        uint64_t special = masks.quotes | masks.comments | masks.newlines;
+        while (special != 0) {
+            int bit = __builtin_ctzll(special);
+            uint64_t flag = 1ull << bit;
+            special &= special - 1;
+
+            if (inString) {
+                if (masks.quotes & flag) {
+                    inside |= RangeMask(regionStart, bit);
+                    inString = false;
+                    lastStringEnd = base + bit;
+                }
+            }
+            else if (inComment) {
+                if (masks.newlines & flag) {
+                    inside |= RangeMask(regionStart, bit - 1);
+                    inComment = false;
+                }
+            }
+            else if (masks.comments & flag) {
+                inComment = true;
+                regionStart = bit;
+            }
+            else if (masks.quotes & flag) {
+                bool afterDelimiter = (bit == 0) ? previousDelimiter : ((delimiters >> (bit - 1)) & 1);
+                if (afterDelimiter || base + bit == lastStringEnd + 1) {
+                    inString = true;
+                    regionStart = bit;
+                    openings |= flag;
                 }
-                return true;
-            };
-
-            // Check if the value correspond to an array flag.
-            if (EqualsIgnoreCase(buffer, "rgb"))
-                flags = Flags::RGB;
-            else if (EqualsIgnoreCase(buffer, "hsv"))
-                flags = Flags::HSV;
-            else if (EqualsIgnoreCase(buffer, "list"))
-                flags = Flags::LIST;
-            else if (EqualsIgnoreCase(buffer, "range"))
-                flags = Flags::RANGE;
-            else {
-                mainObject->MergeUnsafe(key, std::make_shared<Object>(buffer), op);
-                key = "";
-                state = 1;
-                continue;
             }
-            state = 3;
-        }
-        // State #4a: stop parsing an array.
-        //  - from: state #2b, state #2d
-        //  - next: terminal
-        //  - accepts: }
-        else if (state == 4 && ch == '}') {
-            if (depth == 0)
-                THROW_ERROR("unexpected closing brace '}'", "unmatched closing brace", 0);
-            return mainObject;
-        }
-        // State #4b: start parsing an object inside an array.
-        //  - from: state #2b, state #2d
-        //  - next: state #4
-        //  - accepts: {
-        else if (state == 4 && ch == '{') {
-            int lastBrace = m_Reader.GetCurrentLine();
-            m_LastBraceLine = lastBrace;
-            std::shared_ptr<Object> object = this->Parse(depth+1);
-            m_LastBraceLine = lastBrace;
-            mainObject->Push(object);
-            key = "";
-            state = 4;
         }
-        // State #4c: continue parsing an array.
-        //  - from: state #2b, state #2d
-        //  - next: state #4
-        //  - accepts: non-blank
-        else if (state == 4) {
-            if (IS_OPERATOR(ch))
-                THROW_ERROR(std::format("unexpected '{}' inside array block", (char) ch), "unexpected operator", 0);
-            std::string_view buffer = m_Reader.ReadUntil((ch == '"' ? quotePredicate : blankPredicate), true, ch == '"');
-            mainObject->Push(buffer);
-            state = 4;
+        if (inString || inComment)
+            inside |= RangeMask(regionStart, 63);
+
+        // Scalars start on characters which are neither delimiters nor inside a
+        // string or a comment, and which do not follow another scalar character.
+        uint64_t atoms = ~inside & ~delimiters;
+        uint64_t starts = atoms & ~((atoms << 1) | previousAtom);
+        uint64_t tokens = (masks.structurals & ~inside) | starts | openings;
+        if (length < 64)
+            tokens &= RangeMask(0, length - 1);
+
+        while (tokens != 0) {
+            m_Positions.push_back((uint32_t) (base + __builtin_ctzll(tokens)));
+            tokens &= tokens - 1;
         }
 
-        // Update the previous line and cursor number to take into account
-        // strings and operators that have been read in the states.
-        m_PreviousLine = m_Reader.GetCurrentLine();
-        m_PreviousCursor = m_Reader.GetCurrentCursor();
+        previousDelimiter = delimiters >> 63;
+        previousAtom = atoms >> 63;
+        regionStart = 0;
     }
+    return true;
+}
 
-    if (depth == 0 && mainObject->Is(Type::SCALAR))
-        THROW_ERROR("unexpected value at root level", "unexpected standalone value", -INT_MAX);
-    if (depth == 0 && mainObject->Is(Type::ARRAY))
-        THROW_ERROR("unexpected array at root level", "unexpected standalone value", -INT_MAX);
+std::string_view StructuralIndex::GetView() const {
+    return m_View;
+}
 
-    if (!key.empty() && state == 3)
-        THROW_ERROR(std::format("expected a value after '{}'", OperatorsLabels.at(op)), "missing value", 0);
-    if (!key.empty() && state == 2)
-        THROW_ERROR(std::format("expected an operator after '{}'", key), "missing operator", -1);
-    if (state == 4)
-        THROW_ERROR("expected closing brace '}'", "unmatched closing brace", -1);
-    if (depth > 0 && mainObject->Is(Type::OBJECT))
-        THROW_ERROR("expected closing brace '}'", "unmatched closing brace", 2);
+const std::vector<uint32_t>& StructuralIndex::GetPositions() const {
+    return m_Positions;
+}
 
-    return mainObject;
+std::string_view StructuralIndex::GetToken(uint32_t position) const {
+    const char* begin = m_View.data() + position;
+    const char* end = m_View.data() + m_View.size();
+    if (*begin == '{' || *begin == '}' || *begin == '=' || *begin == '<' || *begin == '>' || *begin == '!' || *begin == '?')
+        return std::string_view(begin, 1);
+    // A quoted string ends with the next quote, included.
+    if (*begin == '"')
+        return std::string_view(begin, std::min(ScanChar(begin + 1, end, '"') + 1, end) - begin);
+    return std::string_view(begin, ScanDelimiter(begin, end) - begin);
 }
 
-std::shared_ptr<Object> ParseFile(const std::string& filePath) {
-    Parser parser;
-    return parser.ParseFile(filePath);
+//////////////////////////////////////////////////////////
+//                      Reader                          //
+//////////////////////////////////////////////////////////
+
+const size_t Reader::s_DefaultWindowSize = 64 * 1024;
+
+Reader::Reader()
+: m_EndOfStream(true), m_OriginOffset(0), m_OriginLine(0), m_OriginCursor(0), m_IndexedSize(0), m_CurrentGlobalCursor(0)
+{}
+
+Reader::Reader(std::string filePath) : Reader() {}
+
+Reader::~Reader() {}
+
+void Reader::OpenFile(std::string filePath) {
+    // Map the file directly when the platform allows it, and only
+    // fall back to copying it into memory otherwise.
+    std::shared_ptr<Buffer> buffer = std::make_shared<Buffer>();
+    if (!buffer->MapFile(filePath))
+        buffer->ReadFile(filePath);
+    this->OpenBuffer(buffer);
 }
 
-std::shared_ptr<Object> ParseString(const std::string& content) {
-    Parser parser;
-    return parser.ParseString(content);
+void Reader::OpenString(std::string content) {
+    this->OpenBuffer(std::make_shared<Buffer>(std::move(content)));
+}
+
+void Reader::OpenBuffer(std::shared_ptr<Buffer> buffer) {
+    // Initialize member variables.
+    m_Buffer = std::move(buffer);
+    m_View = m_Buffer->GetView();
+    m_Source = nullptr;
+    m_Window.clear();
+    m_EndOfStream = true;
+    m_CurrentGlobalCursor = 0;
+
+    // Ignore first three UTF8 BOM bytes.
+    if (m_View.size() > 2 && m_View[0] == '\xEF' && m_View[1] == '\xBB' && m_View[2] == '\xBF')
+        m_View.remove_prefix(3);
+
+    m_Origin = m_View;
+    m_OriginOffset = 0;
+    m_OriginLine = 0;
+    m_OriginCursor = 0;
+    m_LineStarts.clear();
+    m_IndexedSize = 0;
+}
+
+void Reader::OpenBuffer(std::shared_ptr<Buffer> buffer, std::string_view view, uint32_t line, uint32_t cursor) {
+    this->OpenBuffer(std::move(buffer));
+    m_View = view;
+    m_OriginLine = line;
+    m_OriginCursor = cursor;
+}
+
+void Reader::Open(std::istream& stream) {
+    // Copy the whole stream into the buffer. It is read in chunks
+    // rather than by seeking to the end, so that pipes work too.
+    std::string content;
+    char chunk[16 * 1024];
+    while (stream.read(chunk, sizeof(chunk)) || stream.gcount() > 0)
+        content.append(chunk, static_cast<size_t>(stream.gcount()));
+    if (stream.bad())
+        throw std::runtime_error("Reader::Open: failed to read the stream.");
+    this->OpenBuffer(std::make_shared<Buffer>(std::move(content)));
+}
+
+void Reader::OpenStream(std::istream& stream, size_t windowSize) {
+    this->OpenWindow([&stream](char* destination, size_t size) {
+        stream.read(destination, size);
+        // A read error is raised instead of ending the input early.
+        if (stream.bad())
+            throw std::runtime_error("Reader::OpenStream: failed to read the stream.");
+        return static_cast<size_t>(stream.gcount());
+    }, windowSize);
+}
+
+void Reader::OpenDescriptor(int fd, size_t windowSize) {
+#ifdef JOMINI_HAS_MMAP
+    this->OpenWindow([fd](char* destination, size_t size) {
+        ssize_t count;
+        do {
+            count = ::read(fd, destination, size);
+        } while (count < 0 && errno == EINTR);
+        if (count < 0)
+            throw std::runtime_error(std::format("Reader::OpenDescriptor: failed to read file descriptor {} ({}).", fd, std::strerror(errno)));
+        return static_cast<size_t>(count);
+    }, windowSize);
+#else
+    throw std::runtime_error("Reader::OpenDescriptor: file descriptors are not supported on this platform.");
+#endif
+}
+
+bool Reader::IsStreaming() const {
+    return m_Source != nullptr;
+}
+
+void Reader::OpenWindow(std::function<size_t(char*, size_t)> source, size_t windowSize) {
+    // Initialize member variables.
+    m_Buffer = nullptr;
+    m_View = std::string_view{};
+    m_Source = std::move(source);
+    m_Window.assign(std::max<size_t>(windowSize, 16), '\0');
+    m_EndOfStream = false;
+    m_Origin = m_View;
+    m_OriginOffset = 0;
+    m_OriginLine = 0;
+    m_OriginCursor = 0;
+    m_LineStarts.clear();
+    m_IndexedSize = 0;
+    m_CurrentGlobalCursor = 0;
+
+    // Fill the window a first time, then ignore first three UTF8 BOM bytes.
+    while (m_View.size() < 3 && this->Refill(0));
+    if (m_View.size() > 2 && m_View[0] == '\xEF' && m_View[1] == '\xBB' && m_View[2] == '\xBF') {
+        m_View.remove_prefix(3);
+        m_Origin = m_View;
+    }
+}
+
+bool Reader::Refill(size_t keepFrom) {
+    if (m_EndOfStream)
+        return false;
+
+    // Keep the position of the first character left in the window, so that GetLine
+    // can still find the lines that are left in it.
+    uint64_t keptOffset = m_OriginOffset + (m_View.data() - m_Origin.data()) + keepFrom;
+    Position kept = this->GetPosition(keptOffset);
+
+    // Move the bytes that must be kept to the front of the window, and grow
+    // the window if a single token does not fit in it.
+    size_t keptSize = m_View.size() - keepFrom;
+    if (keptSize > 0)
+        std::memmove(m_Window.data(), m_View.data() + keepFrom, keptSize);
+    if (keptSize == m_Window.size())
+        m_Window.resize(m_Window.size() * 2);
+
+    size_t count = m_Source(m_Window.data() + keptSize, m_Window.size() - keptSize);
+    if (count == 0)
+        m_EndOfStream = true;
+
+    m_View = std::string_view(m_Window.data(), keptSize + count);
+    m_CurrentGlobalCursor -= keepFrom;
+    m_Origin = m_View;
+    m_OriginOffset = keptOffset;
+    m_OriginLine = kept.line;
+    m_OriginCursor = kept.cursor;
+    m_LineStarts.clear();
+    m_IndexedSize = 0;
+    return count > 0;
+}
+
+bool Reader::IsEmpty() {
+    if (m_CurrentGlobalCursor < m_View.size())
+        return false;
+    return !this->Refill(m_CurrentGlobalCursor);
+}
+
+char Reader::Read() {
+    if (m_CurrentGlobalCursor >= m_View.size() && !this->Refill(m_CurrentGlobalCursor))
+        throw std::out_of_range("tried to read character outside of buffer bounds.");
+    return m_View[m_CurrentGlobalCursor++];
+}
+
+char Reader::Peek() {
+    if (m_CurrentGlobalCursor >= m_View.size() && !this->Refill(m_CurrentGlobalCursor))
+        return '\0';
+    return m_View[m_CurrentGlobalCursor++];
+}
+
+bool Reader::Match(char expected) {
+    if (m_CurrentGlobalCursor >= m_View.size())
+        this->Refill(m_CurrentGlobalCursor);
+    if (m_CurrentGlobalCursor < m_View.size() && m_View[m_CurrentGlobalCursor] == expected) {
+        m_CurrentGlobalCursor++;
+        return true;
+    }
+    return false;
+}
+
+std::string_view Reader::ReadUntil(const std::function<bool(char)>& predicate, bool includePrevious, bool includeLast) {
+    return this->ReadUntilImpl([&predicate](const char* begin, const char* end) {
+        while (begin < end && !predicate(*begin))
+            begin++;
+        return begin;
+    }, includePrevious, includeLast);
+}
+
+void Reader::SkipUntil(const std::function<bool(char)>& predicate) {
+    this->SkipUntilImpl([&predicate](const char* begin, const char* end) {
+        while (begin < end && !predicate(*begin))
+            begin++;
+        return begin;
+    });
+}
+
+std::string_view Reader::ReadUntilDelimiter(bool includePrevious) {
+    return this->ReadUntilImpl(ScanDelimiter, includePrevious, false);
+}
+
+std::string_view Reader::ReadUntilChar(char c, bool includePrevious, bool includeLast) {
+    return this->ReadUntilImpl([c](const char* begin, const char* end) {
+        return ScanChar(begin, end, c);
+    }, includePrevious, includeLast);
+}
+
+void Reader::SkipUntilChar(char c) {
+    this->SkipUntilImpl([c](const char* begin, const char* end) {
+        return ScanChar(begin, end, c);
+    });
+}
+
+void Reader::SkipUntilAny(std::string_view characters) {
+    std::array<bool, 256> stops = {};
+    for (char c : characters)
+        stops[(unsigned char) c] = true;
+    this->SkipUntilImpl([&stops](const char* begin, const char* end) {
+        while (begin < end && !stops[(unsigned char) *begin])
+            begin++;
+        return begin;
+    });
+}
+
+void Reader::SkipTo(size_t offset) {
+    m_CurrentGlobalCursor = offset;
+}
+
+template <typename Finder> std::string_view Reader::ReadUntilImpl(const Finder& find, bool includePrevious, bool includeLast) {
+    if (m_CurrentGlobalCursor >= m_View.size()+includePrevious && !this->Refill(m_CurrentGlobalCursor))
+        return std::string_view{};
+    size_t start = m_CurrentGlobalCursor - (size_t) includePrevious;
+    size_t end = start + (size_t) includePrevious;
+    while (true) {
+        end = find(m_View.data() + end, m_View.data() + m_View.size()) - m_View.data();
+        // When streaming, a token may continue past the end of the window.
+        if (end < m_View.size() || m_EndOfStream)
+            break;
+        bool refilled = this->Refill(start);
+        end -= start;
+        start = 0;
+        if (!refilled)
+            break;
+    }
+    if (includeLast)
+        end++;
+    m_CurrentGlobalCursor = end;
+    return m_View.substr(start, end - start);
+}
+
+template <typename Finder> void Reader::SkipUntilImpl(const Finder& find) {
+    if (m_CurrentGlobalCursor >= m_View.size() && !this->Refill(m_CurrentGlobalCursor))
+        return;
+    size_t pos = m_CurrentGlobalCursor;
+    while (true) {
+        pos = find(m_View.data() + pos, m_View.data() + m_View.size()) - m_View.data();
+        if (pos < m_View.size() || m_EndOfStream)
+            break;
+        bool refilled = this->Refill(pos);
+        pos = 0;
+        if (!refilled)
+            break;
+    }
+    m_CurrentGlobalCursor = pos;
+}
+
+std::shared_ptr<Buffer> Reader::GetBuffer() const {
+    return m_Buffer;
+}
+
+std::string_view Reader::GetView() const {
+    return m_View;
+}
+
+std::string_view Reader::GetLine(uint32_t line) const {
+    // When streaming, only the lines left in the window can be retrieved.
+    if (line < m_OriginLine)
+        return {};
+    line -= m_OriginLine;
+    while (m_LineStarts.size() < line && m_IndexedSize < m_Origin.size())
+        this->IndexLines(m_IndexedSize + 1);
+    if (m_LineStarts.size() < line)
+        return {};
+    size_t start = (line == 0) ? 0 : m_LineStarts[line - 1];
+    size_t end = m_Origin.find('\n', start);
+    return m_Origin.substr(start, (end == std::string_view::npos ? m_Origin.size() : end) - start);
 }
 
-}
\ No newline at end of file
+uint32_t Reader::GetCurrentLine() const {
+    return this->GetPosition(this->GetSourceOffset()).line;
+}
+
+uint32_t Reader::GetCurrentCursor() const {
+    return this->GetPosition(this->GetSourceOffset()).cursor;
+}
+
+Reader::Position Reader::GetPosition(uint64_t sourceOffset) const {
+    // Only the line the window starts with is known before it.
+    if (sourceOffset < m_OriginOffset)
+        return Position{ m_OriginLine, (uint32_t) (m_OriginCursor - std::min<uint64_t>(m_OriginOffset - sourceOffset, m_OriginCursor)) };
+    size_t offset = std::min<uint64_t>(sourceOffset - m_OriginOffset, m_Origin.size());
+    this->IndexLines(offset);
+    // Find the last line starting at or before the offset.
+    size_t line = std::upper_bound(m_LineStarts.begin(), m_LineStarts.end(), offset) - m_LineStarts.begin();
+    if (line == 0)
+        return Position{ m_OriginLine, (uint32_t) (m_OriginCursor + offset) };
+    return Position{ (uint32_t) (m_OriginLine + line), (uint32_t) (offset - m_LineStarts[line - 1]) };
+}
+
+size_t Reader::GetOffset() const {
+    return m_CurrentGlobalCursor;
+}
+
+uint64_t Reader::GetSourceOffset() const {
+    return m_OriginOffset + (m_View.data() - m_Origin.data()) + m_CurrentGlobalCursor;
+}
+
+void Reader::IndexLines(size_t offset) const {
+    // Index the line starts up to the offset, looking for the newlines with memchr.
+    const char* begin = m_Origin.data();
+    const char* end = begin + m_Origin.size();
+    while (m_IndexedSize < offset && m_IndexedSize < m_Origin.size()) {
+        const char* newline = ScanChar(begin + m_IndexedSize, end, '\n');
+        if (newline == end) {
+            m_IndexedSize = m_Origin.size();
+            break;
+        }
+        m_IndexedSize = newline - begin + 1;
+        m_LineStarts.push_back(m_IndexedSize);
+    }
+}
+
+//////////////////////////////////////////////////////////
+//                      Parser                          //
+//////////////////////////////////////////////////////////
+
+namespace {
+    std::atomic<Engine> s_DefaultEngine = Engine::STATE_MACHINE;
+
+    // Projection states of the blocks whose path matched a whole pattern, and of those
+    // whose path cannot match any.
+    const int s_ProjectAll = -1;
+    const int s_ProjectNone = -2;
+
+    // Matches a path against a pattern where '*' matches any characters but separators,
+    // '**' any characters and '?' a single character.
+    bool MatchPattern(std::string_view pattern, std::string_view path) {
+        size_t p = 0, s = 0;
+        size_t starPattern = std::string_view::npos, starPath = 0;
+        bool starSeparators = false;
+        while (s < path.size()) {
+            if (p < pattern.size() && pattern[p] == '*') {
+                starSeparators = (p + 1 < pattern.size() && pattern[p + 1] == '*');
+                p += starSeparators ? 2 : 1;
+                starPattern = p;
+                starPath = s;
+            }
+            else if (p < pattern.size() && (pattern[p] == path[s] || (pattern[p] == '?' && path[s] != '/'))) {
+                p++;
+                s++;
+            }
+            else if (starPattern != std::string_view::npos && (starSeparators || path[starPath] != '/')) {
+                p = starPattern;
+                s = ++starPath;
+            }
+            else
+                return false;
+        }
+        while (p < pattern.size() && pattern[p] == '*')
+            p++;
+        return p == pattern.size();
+    }
+
+    // Offset of the brace closing the blocks opened before the offset, ignoring those
+    // in quoted strings and comments, or npos if they are not closed.
+    size_t FindClosingBrace(std::string_view view, size_t offset, int depth = 1) {
+        const char* begin = view.data();
+        const char* end = begin + view.size();
+        for (const char* it = begin + offset; it < end; it++) {
+            switch (*it) {
+                case '{':
+                    depth++;
+                    break;
+                case '}':
+                    if (--depth == 0)
+                        return it - begin;
+                    break;
+                case '"':
+                    it = ScanChar(it + 1, end, '"');
+                    break;
+                case '#':
+                    it = ScanChar(it + 1, end, '\n');
+                    break;
+            }
+            if (it == end)
+                break;
+        }
+        return std::string_view::npos;
+    }
+
+    // Message of a syntax error, with the line where it was found and the line of the last
+    // opening brace before it. Lines and columns are only computed now, from the offsets
+    // kept while parsing.
+    std::string FormatParseError(const Reader& reader, const std::string& filePath, const ParseError& parseError) {
+        std::string message = std::format(
+            "{}:{}: an exception has been raised.\n",
+            parseError.sourceFile,
+            parseError.sourceFileLine
+        );
+
+        int previousLine = reader.GetPosition(parseError.offset).line;
+        int previousCursor = reader.GetPosition(parseError.offset).cursor;
+        int lastBraceLine = reader.GetPosition(parseError.lastBraceOffset).line;
+        int cursorOffset = parseError.cursorOffset;
+
+        message += std::format(
+            "{}:{}:{}: error: {}\n",
+            filePath,
+            previousLine+1,
+            std::max(1, previousCursor+cursorOffset+1),
+            parseError.error
+        );
+
+        std::string tab1 = std::string(std::to_string(previousLine).length(), ' ');
+        std::string tab2 = std::string(std::max(0, previousCursor+cursorOffset), ' ');
+
+        // Add the last line with an opening brace if relevent to the exception.
+        if (lastBraceLine != previousLine) {
+            message += std::format(
+                "\t{} | {}\n",
+                lastBraceLine+1, reader.GetLine(lastBraceLine)
+            );
+
+            if (lastBraceLine != previousLine-1)
+                message += std::format("\t{} | ...\n", tab1);
+        }
+
+        // Add the last relevent line and the error arrow.
+        message += std::format(
+            "\t{} | {}\n"
+            "\t{} | {}^\n"
+            "\t{} | {}|\n"
+            "\t{} | {}{}",
+            previousLine+1, reader.GetLine(previousLine),
+            tab1, tab2,
+            tab1, tab2,
+            tab1, tab2, parseError.cursorError
+        );
+        return message;
+    }
+}
+
+void SetDefaultEngine(Engine engine) {
+    s_DefaultEngine = engine;
+}
+
+Engine GetDefaultEngine() {
+    return s_DefaultEngine;
+}
+
+EventAction EventHandler::OnKey(std::string_view key, Operator op) {
+    return EventAction::CONTINUE;
+}
+
+void EventHandler::OnScalar(std::string_view scalar) {}
+
+void EventHandler::OnFlag(Flags flag) {}
+
+EventAction EventHandler::OnObjectBegin() {
+    return EventAction::CONTINUE;
+}
+
+void EventHandler::OnObjectEnd() {}
+
+EventAction EventHandler::OnArrayBegin() {
+    return EventAction::CONTINUE;
+}
+
+void EventHandler::OnArrayEnd() {}
+
+ParseResult::ParseResult()
+: m_Object(nullptr), m_Truncated(false), m_FilePath(""), m_Buffer(nullptr), m_Reader(nullptr)
+{}
+
+std::shared_ptr<Object> ParseResult::GetObject() const {
+    return m_Object;
+}
+
+const std::vector<ParseError>& ParseResult::GetErrors() const {
+    return m_Errors;
+}
+
+bool ParseResult::HasErrors() const {
+    return !m_Errors.empty();
+}
+
+bool ParseResult::IsTruncated() const {
+    return m_Truncated;
+}
+
+const Reader& ParseResult::GetReader() const {
+    if (m_Reader == nullptr) {
+        m_Reader = std::make_shared<Reader>();
+        m_Reader->OpenBuffer(m_Buffer);
+    }
+    return *m_Reader;
+}
+
+Reader::Position ParseResult::GetPosition(size_t index) const {
+    const ParseError& error = m_Errors.at(index);
+    Reader::Position position = this->GetReader().GetPosition(error.offset);
+    position.cursor = std::max(0, (int) position.cursor + error.cursorOffset);
+    return position;
+}
+
+std::string ParseResult::FormatError(size_t index) const {
+    return FormatParseError(this->GetReader(), m_FilePath, m_Errors.at(index));
+}
+
+const int Parser::s_DefaultMaxDepth = 1024;
+const size_t Parser::s_DefaultMaxErrors = 100;
+
+Parser::Parser()
+: m_Engine(GetDefaultEngine()), m_MaxDepth(s_DefaultMaxDepth), m_MaxErrors(s_DefaultMaxErrors), m_Errors(nullptr), m_Lazy(false), m_LazyDepth(0), m_LazySource(nullptr), m_Arena(nullptr), m_FilePath(""), m_Reader(Reader()), m_PreviousOffset(0), m_LastBraceOffset(0)
+{}
+
+void Parser::SetEngine(Engine engine) {
+    m_Engine = engine;
+}
+
+Engine Parser::GetEngine() const {
+    return m_Engine;
+}
+
+void Parser::SetMaxDepth(int maxDepth) {
+    m_MaxDepth = maxDepth;
+}
+
+int Parser::GetMaxDepth() const {
+    return m_MaxDepth;
+}
+
+void Parser::SetMaxErrors(size_t maxErrors) {
+    m_MaxErrors = maxErrors;
+}
+
+size_t Parser::GetMaxErrors() const {
+    return m_MaxErrors;
+}
+
+void Parser::SetLazy(bool lazy) {
+    m_Lazy = lazy;
+}
+
+bool Parser::IsLazy() const {
+    return m_Lazy;
+}
+
+void Parser::SetProjection(const std::vector<std::string>& patterns) {
+    m_Projection.clear();
+    for (const std::string& pattern : patterns) {
+        std::vector<std::string>& segments = m_Projection.emplace_back();
+        size_t start = 0;
+        while (true) {
+            size_t end = pattern.find('/', start);
+            segments.push_back(pattern.substr(start, end - start));
+            if (end == std::string::npos)
+                break;
+            start = end + 1;
+        }
+    }
+}
+
+void Parser::ThrowError(const std::string& error, const std::string& cursorError, int cursorOffset, std::string sourceFile, int sourceFileLine) {
+    ParseError parseError{ error, cursorError, cursorOffset, m_PreviousOffset, m_LastBraceOffset, std::move(sourceFile), sourceFileLine };
+    if (m_Errors != nullptr) {
+        if (m_Errors->size() < m_MaxErrors)
+            m_Errors->push_back(std::move(parseError));
+        throw RecoveredError{};
+    }
+    throw std::runtime_error(FormatParseError(m_Reader, m_FilePath, parseError));
+}
+
+std::shared_ptr<Object> Parser::ParseFile(const std::string& filePath) {
+    // Initialize the reader with the file.
+    m_FilePath = filePath;
+    m_Reader.OpenFile(filePath);
+
+    // Initialize the line number on the first function call.
+    m_PreviousOffset = 0;
+    m_LastBraceOffset = 0;
+
+    // Parse the file from the root.
+    std::shared_ptr<Object> obj = this->ParseRoot();
+    return obj;
+}
+
+std::shared_ptr<Object> Parser::ParseBuffer(std::shared_ptr<Buffer> buffer, const std::string& filePath) {
+    // Initialize the reader with a source already in memory.
+    m_FilePath = filePath;
+    m_Reader.OpenBuffer(std::move(buffer));
+
+    m_PreviousOffset = 0;
+    m_LastBraceOffset = 0;
+    return this->ParseRoot();
+}
+
+std::shared_ptr<Object> Parser::ParseStream(std::istream& stream, size_t windowSize) {
+    // Initialize the reader with a refill window over the stream.
+    m_FilePath = "";
+    m_Reader.OpenStream(stream, windowSize);
+
+    // Initialize the line number on the first function call.
+    m_PreviousOffset = 0;
+    m_LastBraceOffset = 0;
+
+    // Parse the stream from the root.
+    std::shared_ptr<Object> obj = this->ParseRoot();
+    return obj;
+}
+
+std::shared_ptr<Object> Parser::ParseDescriptor(int fd, size_t windowSize) {
+    // Initialize the reader with a refill window over the file descriptor.
+    m_FilePath = "";
+    m_Reader.OpenDescriptor(fd, windowSize);
+
+    // Initialize the line number on the first function call.
+    m_PreviousOffset = 0;
+    m_LastBraceOffset = 0;
+
+    // Parse the stream from the root.
+    std::shared_ptr<Object> obj = this->ParseRoot();
+    return obj;
+}
+
+std::shared_ptr<Object> Parser::ParseString(const std::string& content) {
+    // Initialize the reader with the string.
+    m_FilePath = "";
+    m_Reader.OpenString(content);
+
+    // Initialize the line number on the first function call.
+    m_PreviousOffset = 0;
+    m_LastBraceOffset = 0;
+
+    // Parse the file from the root.
+    std::shared_ptr<Object> obj = this->ParseRoot();
+    return obj;
+}
+
+std::shared_ptr<Object> Parser::CreateObject(Type type) {
+    if (m_Arena != nullptr)
+        return m_Arena->Create(type);
+    std::shared_ptr<Object> object = std::make_shared<Object>(type);
+    if (type == Type::OBJECT)
+        object->m_Value.emplace<ObjectMap>(std::pmr::get_default_resource(), m_Symbols);
+    return object;
+}
+
+std::shared_ptr<Object> Parser::CreateScalar(std::string_view scalar) {
+    if (m_Arena != nullptr)
+        return m_Arena->CreateScalar(scalar);
+    return std::make_shared<Object>(scalar);
+}
+
+void Parser::PushScalar(const std::shared_ptr<Object>& array, std::string_view scalar, bool convertToArray) {
+    if (!array->PushPacked(scalar, convertToArray))
+        array->Push(this->CreateScalar(scalar), convertToArray);
+}
+
+void Parser::ResetSymbols() {
+    // Maps of an arena use its table.
+    m_Symbols = (m_Arena != nullptr) ? nullptr : std::make_shared<SymbolTable>();
+}
+
+std::shared_ptr<Object> Parser::ParseRoot() {
+    this->ResetSymbols();
+    // Streaming readers never hold the whole input, so they cannot be indexed.
+    if (m_Engine == Engine::STRUCTURAL_INDEX && !m_Reader.IsStreaming() && !m_Lazy && m_Projection.empty())
+        return this->ParseIndexed();
+    return this->Parse();
+}
+
+#define IS_OPERATOR(ch) (GetCharClass(ch) == CharClass::OPERATOR)
+
+// Key of the switch of the state machine over its state and the class of the character.
+static constexpr int DispatchKey(int state, CharClass charClass) {
+    return state * 8 + (int) charClass;
+}
+
+std::string_view Parser::ReadToken(char first) {
+    // Read a quoted string up to its closing quote, or a scalar up to the next delimiter.
+    if (first == '"')
+        return m_Reader.ReadUntilChar('"', true, true);
+    return m_Reader.ReadUntilDelimiter(true);
+}
+
+std::shared_ptr<Object> Parser::Parse() {
+    // Initialize the main object, key and operator of the block being parsed.
+    // Depending on what is read, the object can be an scalar, an object (map) or an array.
+    // Key and operator are not used if it isn't parsing a map object.
+    std::shared_ptr<Object> mainObject = this->CreateObject(Type::OBJECT);
+    std::string_view key = "";
+    std::string keyStorage;
+    Operator op = Operator::EQUAL;
+    Flags flags = Flags::NONE;
+    int depth = 0;
+
+    // Initialize the projection state of the block, and of the block opened by a key.
+    int projection = s_ProjectAll;
+    int keyProjection = s_ProjectAll;
+    m_ProjectionStates.clear();
+    if (!m_Projection.empty()) {
+        m_ProjectionPositions.clear();
+        for (size_t pattern = 0; pattern < m_Projection.size(); pattern++)
+            m_ProjectionPositions.emplace_back(pattern, 0);
+        projection = this->CreateProjectionState(m_ProjectionPositions);
+    }
+
+    // Initialize the current parsing state:
+    int state = 1;
+
+    // Blocks opened and closed by the states, which update the frame stack after them.
+    enum class Transition { NONE, OPEN, CLOSE };
+
+    // The blocks enclosing the current one are saved on the frame stack, which is
+    // kept between parses but must not hold on to their objects afterwards.
+    struct FramesGuard {
+        std::vector<Frame>& frames;
+        ~FramesGuard() { frames.clear(); }
+    } framesGuard{ m_Frames };
+    m_Frames.clear();
+
+    // Resume the enclosing block where it was opened, once the current block has been
+    // closed by one of the states #1a, #2c or #4a, with the object which was parsed.
+    const auto CloseBlock = [&]() {
+        std::shared_ptr<Object> object = std::move(mainObject);
+        // Blocks which did not match a whole pattern are removed if nothing in them did.
+        bool pruned = (projection != s_ProjectAll && ((object->Is(Type::OBJECT) && object->GetMapUnsafe().empty()) || (object->Is(Type::ARRAY) && object->GetArrayUnsafe().empty())));
+        Frame& frame = m_Frames.back();
+        mainObject = std::move(frame.object);
+        keyStorage = std::move(frame.keyStorage);
+        key = m_Reader.IsStreaming() ? std::string_view(keyStorage) : frame.key;
+        op = frame.op;
+        flags = frame.flags;
+        state = frame.state;
+        m_LastBraceOffset = frame.lastBrace;
+        projection = frame.projection;
+        m_Frames.pop_back();
+        depth--;
+
+        // State #1b: the object is an element of an array.
+        if (state == 1) {
+            if (!pruned)
+                mainObject->Push(object, true);
+            else
+                mainObject->ConvertToArray();
+            key = "";
+            state = 4;
+        }
+        // State #2b: the object follows a scalar in an array.
+        else if (state == 2) {
+            if (projection == s_ProjectAll)
+                this->PushScalar(mainObject, key, true);
+            else
+                mainObject->ConvertToArray();
+            if (!pruned)
+                mainObject->Push(object);
+            key = "";
+            state = 4;
+        }
+        // State #3a: the object is the value of the key.
+        else if (state == 3 && pruned) {
+            flags = Flags::NONE;
+            key = "";
+            state = 1;
+        }
+        else if (state == 3) {
+            // Empty object are by default all map objects, so if there is
+            // a list flags attached, the convert it to an array.
+            if (object->Is(Type::OBJECT) && ((bool) (flags & (Flags::LIST | Flags::RANGE))))
+                object->ConvertToArray();
+
+            // Convert range to an array.
+            if ((bool) (flags & Flags::RANGE)) {
+                if (!object->Is(Type::ARRAY))
+                    THROW_ERROR("expected 2-number-array in RANGE block", "expected array", 0);
+                ObjectArray& array = object->GetArray();
+                int a = 0, b = 0;
+                if (array.size() != 2 || array.at(0)->TryAs(a) != ConversionError::NONE || array.at(1)->TryAs(b) != ConversionError::NONE)
+                    THROW_ERROR("expected 2-number-array in RANGE block", "expected 2 numbers", 0);
+                array.clear();
+                if (a <= b) for (int i = a; i <= b; i++)
+                    array.push_back(this->CreateScalar(std::to_string(i)));
+                else for (int i = a; i >= b; i--)
+                    array.push_back(this->CreateScalar(std::to_string(i)));
+            }
+            mainObject->MergeUnsafe(key, object, op);
+            mainObject->Get(key)->SetFlag(flags, true);
+            flags = Flags::NONE;
+            key = "";
+            state = 1;
+        }
+        // State #4b: the object is an element of an array.
+        else {
+            if (!pruned)
+                mainObject->Push(object);
+            key = "";
+            state = 4;
+        }
+    };
+
+    // When recovering from errors, the entry where one was found is left out, and parsing
+    // resumes at the next line or brace. The blocks still open are closed at the end of the
+    // input, or once the maximum number of errors has been recorded.
+    char ch = 0;
+    Transition transition = Transition::NONE;
+    bool resync = false;
+    bool finish = false;
+    while (true) {
+        try {
+            if (finish) {
+                key = "";
+                while (depth > 0)
+                    CloseBlock();
+                if (!mainObject->Is(Type::OBJECT))
+                    return this->CreateObject(Type::OBJECT);
+                return mainObject;
+            }
+            if (resync) {
+                resync = false;
+                key = "";
+                keyStorage.clear();
+                flags = Flags::NONE;
+                state = (mainObject->Is(Type::ARRAY) ? 4 : 1);
+                // A block opened where it is not allowed is skipped, and a brace which was
+                // unexpected in a block still closes it.
+                if (ch == '{')
+                    this->SkipBlock(1);
+                else if (ch == '}' && transition != Transition::CLOSE && depth > 0)
+                    CloseBlock();
+                else {
+                    // Skip to the end of the line or to the next brace, outside of strings.
+                    m_Reader.SkipUntilAny("\n{}\"#");
+                    while (m_Reader.Match('"')) {
+                        m_Reader.SkipUntilChar('"');
+                        m_Reader.Match('"');
+                        m_Reader.SkipUntilAny("\n{}\"#");
+                    }
+                    if (m_Reader.Match('{'))
+                        this->SkipBlock(1);
+                }
+                m_PreviousOffset = m_Reader.GetSourceOffset();
+            }
+
+            // Loop over one character at a time, until the stream is empty.
+            while (!m_Reader.IsEmpty()) {
+                ch = m_Reader.Read();
+                CharClass charClass = GetCharClass(ch);
+
+                if (charClass == CharClass::BLANK)
+                    continue;
+                if (charClass == CharClass::COMMENT) {
+                    m_Reader.SkipUntilChar('\n');
+                    continue;
+                }
+
+                m_PreviousOffset = m_Reader.GetSourceOffset()-1;
+                transition = Transition::NONE;
+
+                // Dispatch on the state and the class of the character, which the compiler turns
+                // into a single indirect jump instead of a chain of comparisons.
+                switch (DispatchKey(state, charClass)) {
+                    // State #1a: stop reading and return the current main object.
+                    //  - from: initial, state #3
+                    //  - next: terminal
+                    //  - accepts: }
+                    case DispatchKey(1, CharClass::CLOSE_BRACE):
+                        if (depth == 0)
+                            THROW_ERROR("unexpected closing brace '}'", "unmatched closing brace", 0);
+                        transition = Transition::CLOSE;
+                        break;
+                    // State #1b: parsing object in array.
+                    //  - from: initial, state #3
+                    //  - next: state #4
+                    //  - accepts: {
+                    case DispatchKey(1, CharClass::OPEN_BRACE):
+                        if (mainObject->Is(Type::OBJECT) && !mainObject->GetMapUnsafe().empty())
+                            THROW_ERROR("unexpected opening brace '{' inside key-value block", "stray opening brace", 0);
+                        transition = Transition::OPEN;
+                        break;
+                    // State #1c: parsing key.
+                    //  - from: initial, state #3
+                    //  - next: state #2
+                    //  - accepts: non-blank, non-operator
+                    case DispatchKey(1, CharClass::OPERATOR):
+                    case DispatchKey(1, CharClass::OTHER):
+                        if (charClass == CharClass::OPERATOR)
+                            THROW_ERROR(std::format("expected key before '{}'", OperatorsLabels.at(op)), "missing key", 0);
+                        key = this->ReadToken(ch);
+                        // Streaming readers may overwrite the key while reading the rest of the entry.
+                        if (m_Reader.IsStreaming())
+                            key = keyStorage.assign(key);
+                        state = 2;
+                        break;
+                    // State #2a: parsing operator after #1.
+                    //  - from: state #1c
+                    //  - next: state #3
+                    //  - accepts: =, <, >, !, ?
+                    case DispatchKey(2, CharClass::OPERATOR):
+                        if (ch == '!' && !m_Reader.Match('='))
+                            THROW_ERROR("unexpected token '!'", "unexpected exclamation mark; did you mean '!='?", 0);
+                        if (ch == '?' && !m_Reader.Match('='))
+                            THROW_ERROR("unexpected token '?'", "unexpected question mark; did you mean '?='?", 0);
+                        switch (ch) {
+                            case '=':
+                                op = Operator::EQUAL;
+                                break;
+                            case '<':
+                                op = (m_Reader.Match('=') ? Operator::LESS_EQUAL : Operator::LESS);
+                                break;
+                            case '>':
+                                op = (m_Reader.Match('=') ? Operator::GREATER_EQUAL : Operator::GREATER);
+                                break;
+                            case '!':
+                                op = Operator::NOT_EQUAL;
+                                break;
+                            case '?':
+                                op = Operator::NOT_NULL;
+                                break;
+                        }
+                        state = 3;
+                        break;
+                    // State #2b: parsing an object after a scalar and create an array.
+                    //  - from: state #1c
+                    //  - next: state #4
+                    //  - accepts: {
+                    case DispatchKey(2, CharClass::OPEN_BRACE):
+                        if (mainObject->Is(Type::OBJECT) && !mainObject->GetMapUnsafe().empty())
+                            THROW_ERROR("unexpected opening brace '{' inside key-value block; expected operator", "stray opening brace; did you mean '='?", 0);
+                        transition = Transition::OPEN;
+                        break;
+                    // State #2c: stop parsing a single value array.
+                    //  - from: state #1c
+                    //  - next: terminal
+                    //  - accepts: }
+                    case DispatchKey(2, CharClass::CLOSE_BRACE):
+                        if (mainObject->Is(Type::OBJECT) && !mainObject->GetMapUnsafe().empty())
+                            THROW_ERROR("unexpected closing brace '}'; expected '=' or another operator", "unexpected closing brace; did you mean '='?", 0);
+                        // Scalars of arrays are only built if the array matched a whole pattern.
+                        if (projection == s_ProjectAll)
+                            this->PushScalar(mainObject, key, true);
+                        else
+                            mainObject->ConvertToArray();
+                        if (depth == 0)
+                            return mainObject;
+                        transition = Transition::CLOSE;
+                        break;
+                    // State #2d: parsing an array.
+                    //  - from: state #1c
+                    //  - next: state #4
+                    //  - accepts: non-blank
+                    case DispatchKey(2, CharClass::OTHER): {
+                        if (mainObject->Is(Type::OBJECT) && !mainObject->GetMapUnsafe().empty())
+                            THROW_ERROR("unexpected value after key inside key-value block; expected operator", "unexpected value", 0);
+                        std::string_view buffer = this->ReadToken(ch);
+                        if (projection == s_ProjectAll) {
+                            this->PushScalar(mainObject, key, true);
+                            this->PushScalar(mainObject, buffer);
+                        }
+                        else
+                            mainObject->ConvertToArray();
+                        key = "";
+                        state = 4;
+                        break;
+                    }
+                    // State #3a: parsing object value.
+                    //  - from: state #2a, state #3b
+                    //  - next: state #1
+                    //  - accepts: {
+                    case DispatchKey(3, CharClass::OPEN_BRACE):
+                        // Blocks out of the projection are skipped, as are flagged blocks which did
+                        // not match a whole pattern since their scalars cannot.
+                        keyProjection = this->ProjectKey(projection, key);
+                        if (keyProjection == s_ProjectNone || (keyProjection != s_ProjectAll && flags != Flags::NONE)) {
+                            this->SkipBlock(1);
+                            flags = Flags::NONE;
+                            key = "";
+                            state = 1;
+                            break;
+                        }
+                        // In lazy mode, the block is skipped and only parsed once it is accessed.
+                        if (m_Lazy && m_Errors == nullptr && flags == Flags::NONE && keyProjection == s_ProjectAll) {
+                            std::shared_ptr<Object> block = this->CreateLazyBlock(key, depth);
+                            if (block != nullptr) {
+                                mainObject->MergeUnsafe(key, block, op);
+                                key = "";
+                                state = 1;
+                                break;
+                            }
+                        }
+                        transition = Transition::OPEN;
+                        break;
+                    // State #3b: parsing scalar value.
+                    //  - from: state #2a, state #3b
+                    //  - next: state #1, state #3
+                    //  - accepts: non-blank, non-operator
+                    case DispatchKey(3, CharClass::OPERATOR):
+                        THROW_ERROR(std::format("unexpected '{}' after operator inside key-value block", (char) ch), "unexpected operator", 0);
+                        break;
+                    case DispatchKey(3, CharClass::CLOSE_BRACE):
+                        THROW_ERROR("unexpected closing brace '}' after operator inside key-value block", "unexpected closing brace", 0);
+                        break;
+                    case DispatchKey(3, CharClass::OTHER): {
+                        std::string_view buffer = this->ReadToken(ch);
+
+                        // Ignore flags if the buffer is larger than 'RANGE' (i.e 5 characters).
+                        if (buffer.size() > 5) {
+                            if (this->ProjectKey(projection, key) == s_ProjectAll)
+                                mainObject->MergeUnsafe(key, this->CreateScalar(buffer), op);
+                            key = "";
+                            state = 1;
+                            continue;
+                        }
+
+                        // Check if the value correspond to an array flag.
+                        if (EqualsIgnoreCase(buffer, "rgb"))
+                            flags = Flags::RGB;
+                        else if (EqualsIgnoreCase(buffer, "hsv"))
+                            flags = Flags::HSV;
+                        else if (EqualsIgnoreCase(buffer, "list"))
+                            flags = Flags::LIST;
+                        else if (EqualsIgnoreCase(buffer, "range"))
+                            flags = Flags::RANGE;
+                        else {
+                            if (this->ProjectKey(projection, key) == s_ProjectAll)
+                                mainObject->MergeUnsafe(key, this->CreateScalar(buffer), op);
+                            key = "";
+                            state = 1;
+                            continue;
+                        }
+                        state = 3;
+                        break;
+                    }
+                    // State #4a: stop parsing an array.
+                    //  - from: state #2b, state #2d
+                    //  - next: terminal
+                    //  - accepts: }
+                    case DispatchKey(4, CharClass::CLOSE_BRACE):
+                        if (depth == 0)
+                            THROW_ERROR("unexpected closing brace '}'", "unmatched closing brace", 0);
+                        transition = Transition::CLOSE;
+                        break;
+                    // State #4b: start parsing an object inside an array.
+                    //  - from: state #2b, state #2d
+                    //  - next: state #4
+                    //  - accepts: {
+                    case DispatchKey(4, CharClass::OPEN_BRACE):
+                        transition = Transition::OPEN;
+                        break;
+                    // State #4c: continue parsing an array.
+                    //  - from: state #2b, state #2d
+                    //  - next: state #4
+                    //  - accepts: non-blank
+                    case DispatchKey(4, CharClass::OPERATOR):
+                        THROW_ERROR(std::format("unexpected '{}' inside array block", (char) ch), "unexpected operator", 0);
+                        break;
+                    case DispatchKey(4, CharClass::OTHER): {
+                        std::string_view buffer = this->ReadToken(ch);
+                        if (projection == s_ProjectAll)
+                            this->PushScalar(mainObject, buffer);
+                        state = 4;
+                        break;
+                    }
+                }
+
+                // Save the current block and start parsing the one opened by a brace. The state of
+                // the saved block tells what to do with the nested object once it is closed.
+                if (transition == Transition::OPEN) {
+                    if (depth >= m_MaxDepth)
+                        THROW_ERROR(std::format("blocks nested deeper than the maximum depth of {}", m_MaxDepth), "too deeply nested", 0);
+                    uint64_t lastBrace = m_Reader.GetSourceOffset();
+                    m_LastBraceOffset = lastBrace;
+                    m_Frames.push_back(Frame{ std::move(mainObject), key, std::move(keyStorage), op, flags, state, lastBrace, projection });
+                    // Elements of arrays have the path of their array.
+                    if (state == 3)
+                        projection = keyProjection;
+                    mainObject = this->CreateObject(Type::OBJECT);
+                    key = "";
+                    keyStorage.clear();
+                    op = Operator::EQUAL;
+                    flags = Flags::NONE;
+                    state = 1;
+                    depth++;
+                    continue;
+                }
+                if (transition == Transition::CLOSE)
+                    CloseBlock();
+
+                // Update the previous line and cursor number to take into account
+                // strings and operators that have been read in the states.
+                m_PreviousOffset = m_Reader.GetSourceOffset();
+            }
+
+            if (depth == 0 && mainObject->Is(Type::SCALAR))
+                THROW_ERROR("unexpected value at root level", "unexpected standalone value", -INT_MAX);
+            if (depth == 0 && mainObject->Is(Type::ARRAY))
+                THROW_ERROR("unexpected array at root level", "unexpected standalone value", -INT_MAX);
+
+            if (!key.empty() && state == 3)
+                THROW_ERROR(std::format("expected a value after '{}'", OperatorsLabels.at(op)), "missing value", 0);
+            if (!key.empty() && state == 2)
+                THROW_ERROR(std::format("expected an operator after '{}'", key), "missing operator", 0);
+            if (state == 4)
+                THROW_ERROR("expected closing brace '}'", "unmatched closing brace", 1);
+            if (depth > 0 && mainObject->Is(Type::OBJECT))
+                THROW_ERROR("expected closing brace '}'", "unmatched closing brace", 2);
+
+            return mainObject;
+        }
+        catch (const RecoveredError&) {
+            if (m_Reader.IsEmpty() || m_Errors->size() >= m_MaxErrors)
+                finish = true;
+            else
+                resync = true;
+        }
+    }
+}
+
+void Parser::ParseEvents(EventHandler& handler) {
+    // Blocks are objects or arrays once their first entries have been read, and only
+    // then announced to the handler. Their contents are counted to check RANGE blocks.
+    enum class Kind { PENDING, OBJECT, ARRAY };
+    struct EventFrame {
+        Kind kind;
+        std::string_view key;
+        std::string keyStorage;
+        Operator op;
+        Flags flags;
+        int state;
+        uint64_t lastBrace;
+        size_t scalars;
+        size_t blocks;
+    };
+    std::vector<EventFrame> frames;
+
+    Kind kind = Kind::PENDING;
+    std::string_view key = "";
+    std::string keyStorage;
+    Operator op = Operator::EQUAL;
+    Flags flags = Flags::NONE;
+    size_t scalars = 0;
+    size_t blocks = 0;
+    bool skipValue = false;
+    int depth = 0;
+    int state = 1;
+
+    // Blocks opened and closed by the states, and blocks skipped by the handler, which
+    // are closed without reporting their end.
+    enum class Transition { NONE, OPEN, CLOSE, SKIP };
+
+    // Sets the type of the current block, and tells whether the handler wants it.
+    const auto Begin = [&](Kind blockKind) {
+        kind = blockKind;
+        if (depth == 0)
+            return true;
+        EventAction action = (blockKind == Kind::OBJECT) ? handler.OnObjectBegin() : handler.OnArrayBegin();
+        return action == EventAction::CONTINUE;
+    };
+
+    while (!m_Reader.IsEmpty()) {
+        char ch = m_Reader.Read();
+        CharClass charClass = GetCharClass(ch);
+
+        if (charClass == CharClass::BLANK)
+            continue;
+        if (charClass == CharClass::COMMENT) {
+            m_Reader.SkipUntilChar('\n');
+            continue;
+        }
+
+        m_PreviousOffset = m_Reader.GetSourceOffset()-1;
+        Transition transition = Transition::NONE;
+
+        // The states are those of Parser::Parse, with the same errors.
+        switch (DispatchKey(state, charClass)) {
+            // State #1a: end of the block, empty if its type is not known yet.
+            case DispatchKey(1, CharClass::CLOSE_BRACE):
+                if (depth == 0)
+                    THROW_ERROR("unexpected closing brace '}'", "unmatched closing brace", 0);
+                if (kind == Kind::PENDING) {
+                    Kind emptyKind = (bool) (frames.back().flags & (Flags::LIST | Flags::RANGE)) ? Kind::ARRAY : Kind::OBJECT;
+                    if (!Begin(emptyKind)) {
+                        transition = Transition::SKIP;
+                        break;
+                    }
+                }
+                transition = Transition::CLOSE;
+                break;
+            // State #1b: block in an array.
+            case DispatchKey(1, CharClass::OPEN_BRACE):
+                if (kind == Kind::OBJECT)
+                    THROW_ERROR("unexpected opening brace '{' inside key-value block", "stray opening brace", 0);
+                if (kind == Kind::PENDING && !Begin(Kind::ARRAY)) {
+                    this->SkipBlock(2);
+                    transition = Transition::SKIP;
+                    break;
+                }
+                transition = Transition::OPEN;
+                break;
+            // State #1c: key, or first value of an array.
+            case DispatchKey(1, CharClass::OPERATOR):
+            case DispatchKey(1, CharClass::OTHER):
+                if (charClass == CharClass::OPERATOR)
+                    THROW_ERROR(std::format("expected key before '{}'", OperatorsLabels.at(op)), "missing key", 0);
+                key = this->ReadToken(ch);
+                if (m_Reader.IsStreaming())
+                    key = keyStorage.assign(key);
+                state = 2;
+                break;
+            // State #2a: operator after a key.
+            case DispatchKey(2, CharClass::OPERATOR):
+                if (ch == '!' && !m_Reader.Match('='))
+                    THROW_ERROR("unexpected token '!'", "unexpected exclamation mark; did you mean '!='?", 0);
+                if (ch == '?' && !m_Reader.Match('='))
+                    THROW_ERROR("unexpected token '?'", "unexpected question mark; did you mean '?='?", 0);
+                switch (ch) {
+                    case '=':
+                        op = Operator::EQUAL;
+                        break;
+                    case '<':
+                        op = (m_Reader.Match('=') ? Operator::LESS_EQUAL : Operator::LESS);
+                        break;
+                    case '>':
+                        op = (m_Reader.Match('=') ? Operator::GREATER_EQUAL : Operator::GREATER);
+                        break;
+                    case '!':
+                        op = Operator::NOT_EQUAL;
+                        break;
+                    case '?':
+                        op = Operator::NOT_NULL;
+                        break;
+                }
+                if (kind == Kind::PENDING && !Begin(Kind::OBJECT)) {
+                    this->SkipBlock(1);
+                    transition = Transition::SKIP;
+                    break;
+                }
+                skipValue = (handler.OnKey(key, op) == EventAction::SKIP);
+                state = 3;
+                break;
+            // State #2b: block after the first value of an array.
+            case DispatchKey(2, CharClass::OPEN_BRACE):
+                if (kind == Kind::OBJECT)
+                    THROW_ERROR("unexpected opening brace '{' inside key-value block; expected operator", "stray opening brace; did you mean '='?", 0);
+                if (kind == Kind::PENDING && !Begin(Kind::ARRAY)) {
+                    this->SkipBlock(2);
+                    transition = Transition::SKIP;
+                    break;
+                }
+                handler.OnScalar(key);
+                scalars++;
+                transition = Transition::OPEN;
+                break;
+            // State #2c: end of an array of a single value.
+            case DispatchKey(2, CharClass::CLOSE_BRACE):
+                if (kind == Kind::OBJECT)
+                    THROW_ERROR("unexpected closing brace '}'; expected '=' or another operator", "unexpected closing brace; did you mean '='?", 0);
+                if (kind == Kind::PENDING && !Begin(Kind::ARRAY)) {
+                    transition = Transition::SKIP;
+                    break;
+                }
+                handler.OnScalar(key);
+                scalars++;
+                if (depth == 0)
+                    return;
+                transition = Transition::CLOSE;
+                break;
+            // State #2d: second value of an array.
+            case DispatchKey(2, CharClass::OTHER): {
+                if (kind == Kind::OBJECT)
+                    THROW_ERROR("unexpected value after key inside key-value block; expected operator", "unexpected value", 0);
+                std::string_view buffer = this->ReadToken(ch);
+                if (kind == Kind::PENDING && !Begin(Kind::ARRAY)) {
+                    this->SkipBlock(1);
+                    transition = Transition::SKIP;
+                    break;
+                }
+                handler.OnScalar(key);
+                handler.OnScalar(buffer);
+                scalars += 2;
+                key = "";
+                state = 4;
+                break;
+            }
+            // State #3a: block value of a key.
+            case DispatchKey(3, CharClass::OPEN_BRACE):
+                if (skipValue) {
+                    this->SkipBlock(1);
+                    skipValue = false;
+                    flags = Flags::NONE;
+                    key = "";
+                    state = 1;
+                    break;
+                }
+                transition = Transition::OPEN;
+                break;
+            // State #3b: scalar value or flag of a key.
+            case DispatchKey(3, CharClass::OPERATOR):
+                THROW_ERROR(std::format("unexpected '{}' after operator inside key-value block", (char) ch), "unexpected operator", 0);
+                break;
+            case DispatchKey(3, CharClass::CLOSE_BRACE):
+                THROW_ERROR("unexpected closing brace '}' after operator inside key-value block", "unexpected closing brace", 0);
+                break;
+            case DispatchKey(3, CharClass::OTHER): {
+                std::string_view buffer = this->ReadToken(ch);
+                Flags flag = GetFlag(buffer);
+                if (flag != Flags::NONE) {
+                    flags = flag;
+                    if (!skipValue)
+                        handler.OnFlag(flag);
+                    break;
+                }
+                if (!skipValue)
+                    handler.OnScalar(buffer);
+                skipValue = false;
+                key = "";
+                state = 1;
+                break;
+            }
+            // State #4a: end of an array.
+            case DispatchKey(4, CharClass::CLOSE_BRACE):
+                if (depth == 0)
+                    THROW_ERROR("unexpected closing brace '}'", "unmatched closing brace", 0);
+                transition = Transition::CLOSE;
+                break;
+            // State #4b: block in an array.
+            case DispatchKey(4, CharClass::OPEN_BRACE):
+                transition = Transition::OPEN;
+                break;
+            // State #4c: value of an array.
+            case DispatchKey(4, CharClass::OPERATOR):
+                THROW_ERROR(std::format("unexpected '{}' inside array block", (char) ch), "unexpected operator", 0);
+                break;
+            case DispatchKey(4, CharClass::OTHER):
+                handler.OnScalar(this->ReadToken(ch));
+                scalars++;
+                break;
+        }
+
+        if (transition == Transition::OPEN) {
+            if (depth >= m_MaxDepth)
+                THROW_ERROR(std::format("blocks nested deeper than the maximum depth of {}", m_MaxDepth), "too deeply nested", 0);
+            uint64_t lastBrace = m_Reader.GetSourceOffset();
+            m_LastBraceOffset = lastBrace;
+            frames.push_back(EventFrame{ kind, key, std::move(keyStorage), op, flags, state, lastBrace, scalars, blocks });
+            kind = Kind::PENDING;
+            key = "";
+            keyStorage.clear();
+            op = Operator::EQUAL;
+            flags = Flags::NONE;
+            scalars = 0;
+            blocks = 0;
+            state = 1;
+            depth++;
+            continue;
+        }
+        // Resume the enclosing block, like Parser::Parse does once the block is merged, after
+        // checking that the block is valid for the flags of its key.
+        if (transition == Transition::CLOSE || transition == Transition::SKIP) {
+            EventFrame& frame = frames.back();
+            if (transition == Transition::CLOSE) {
+                if (frame.state == 3 && (bool) (frame.flags & Flags::RANGE) && !(kind == Kind::ARRAY && scalars == 2 && blocks == 0))
+                    THROW_ERROR("expected 2-number-array in RANGE block", "expected 2 numbers", 0);
+                if (kind == Kind::ARRAY)
+                    handler.OnArrayEnd();
+                else
+                    handler.OnObjectEnd();
+            }
+            kind = frame.kind;
+            keyStorage = std::move(frame.keyStorage);
+            key = m_Reader.IsStreaming() ? std::string_view(keyStorage) : frame.key;
+            op = frame.op;
+            flags = frame.flags;
+            state = frame.state;
+            scalars = frame.scalars;
+            blocks = frame.blocks + 1;
+            m_LastBraceOffset = frame.lastBrace;
+            frames.pop_back();
+            depth--;
+
+            if (state == 3) {
+                flags = Flags::NONE;
+                state = 1;
+            }
+            else
+                state = 4;
+            key = "";
+        }
+
+        m_PreviousOffset = m_Reader.GetSourceOffset();
+    }
+
+    if (depth == 0 && kind == Kind::ARRAY)
+        THROW_ERROR("unexpected array at root level", "unexpected standalone value", -INT_MAX);
+
+    if (!key.empty() && state == 3)
+        THROW_ERROR(std::format("expected a value after '{}'", OperatorsLabels.at(op)), "missing value", 0);
+    if (!key.empty() && state == 2)
+        THROW_ERROR(std::format("expected an operator after '{}'", key), "missing operator", 0);
+    if (state == 4)
+        THROW_ERROR("expected closing brace '}'", "unmatched closing brace", 1);
+    if (depth > 0)
+        THROW_ERROR("expected closing brace '}'", "unmatched closing brace", 2);
+}
+
+void Parser::SkipBlock(int depth) {
+    // Fast-forward to the brace closing the block, ignoring those in quoted strings and comments.
+    // Inputs in memory are scanned at once, and streams one character class at a time.
+    if (!m_Reader.IsStreaming()) {
+        size_t close = FindClosingBrace(m_Reader.GetView(), m_Reader.GetOffset(), depth);
+        if (close != std::string_view::npos) {
+            m_Reader.SkipTo(close + 1);
+            return;
+        }
+    }
+    while (depth > 0 && !m_Reader.IsEmpty()) {
+        m_Reader.SkipUntilAny("{}\"#\n");
+        if (m_Reader.IsEmpty())
+            break;
+        char ch = m_Reader.Read();
+        if (ch == '{')
+            depth++;
+        else if (ch == '}')
+            depth--;
+        else if (ch == '"') {
+            m_Reader.SkipUntilChar('"');
+            if (!m_Reader.IsEmpty())
+                m_Reader.Read();
+        }
+        else if (ch == '#')
+            m_Reader.SkipUntilChar('\n');
+    }
+    if (depth > 0) {
+        m_PreviousOffset = m_Reader.GetSourceOffset();
+        THROW_ERROR("expected closing brace '}'", "unmatched closing brace", 0);
+    }
+}
+
+namespace {
+    // Next token of the lexer which is not a comment.
+    Token NextToken(Lexer& lexer) {
+        Token token = lexer.Next();
+        while (token.type == TokenType::COMMENT)
+            token = lexer.Next();
+        return token;
+    }
+}
+
+std::shared_ptr<Object> Parser::CreateLazyBlock(std::string_view key, int depth) {
+    // Blocks can only be parsed again from a source which stays in memory.
+    if (m_Reader.IsStreaming() || m_Arena != nullptr || depth < m_LazyDepth || depth >= m_MaxDepth)
+        return nullptr;
+
+    // Guess the type of the block from its first tokens, as the state machine would
+    // decide it. Empty and invalid blocks are left to the state machine.
+    std::string_view view = m_Reader.GetView();
+    size_t open = m_Reader.GetOffset();
+    Lexer lexer(view.substr(open));
+    Token first = NextToken(lexer);
+    Type type;
+    if (first.type == TokenType::OPEN_BRACE)
+        type = Type::ARRAY;
+    else if (first.type == TokenType::SCALAR || first.type == TokenType::STRING) {
+        Token second = NextToken(lexer);
+        if (second.type == TokenType::INVALID || second.type == TokenType::END)
+            return nullptr;
+        type = (second.type == TokenType::OPERATOR ? Type::OBJECT : Type::ARRAY);
+    }
+    else
+        return nullptr;
+
+    size_t close = FindClosingBrace(view, open);
+    if (close == std::string_view::npos)
+        return nullptr;
+
+    if (m_LazySource == nullptr || m_LazySource->buffer != m_Reader.GetBuffer() || m_LazySource->symbols != m_Symbols)
+        m_LazySource = std::make_shared<LazySource>(LazySource{ m_Reader.GetBuffer(), m_FilePath, m_Symbols });
+    size_t start = key.data() - view.data();
+    LazyBlock block{ m_LazySource, view.substr(start, close + 1 - start), m_MaxDepth - depth, type };
+    m_Reader.SkipTo(close + 1);
+    return std::make_shared<Object>(block);
+}
+
+std::shared_ptr<Object> Parser::ParseLazyBlock(const LazyBlock& block) {
+    m_FilePath = block.source->filePath;
+    // Positions are still counted from the start of the source.
+    m_Reader.OpenBuffer(block.source->buffer, block.view);
+    m_PreviousOffset = m_Reader.GetSourceOffset();
+    m_LastBraceOffset = m_PreviousOffset;
+    m_MaxDepth = block.maxDepth;
+    m_Lazy = true;
+    m_LazyDepth = 1;
+    m_LazySource = block.source;
+    m_Symbols = block.source->symbols;
+    // The block itself is parsed, and the blocks it contains are deferred again.
+    return this->Parse()->GetMapUnsafe().begin()->second.second;
+}
+
+int Parser::CreateProjectionState(std::vector<std::pair<size_t, size_t>>& positions) {
+    // A '**' segment may match no key, so the positions after it are reached as well.
+    for (size_t i = 0; i < positions.size(); i++) {
+        auto [pattern, segment] = positions[i];
+        if (segment == m_Projection[pattern].size())
+            return s_ProjectAll;
+        std::pair<size_t, size_t> next(pattern, segment + 1);
+        if (m_Projection[pattern][segment] == "**" && std::find(positions.begin(), positions.end(), next) == positions.end())
+            positions.push_back(next);
+    }
+    if (positions.empty())
+        return s_ProjectNone;
+    m_ProjectionStates.push_back(positions);
+    return m_ProjectionStates.size() - 1;
+}
+
+int Parser::ProjectKey(int projection, std::string_view key) {
+    if (projection == s_ProjectAll)
+        return s_ProjectAll;
+    // Move the positions of the block past the key, except those on a '**' segment,
+    // which also stay to match the keys of the next blocks.
+    m_ProjectionPositions.clear();
+    for (auto [pattern, segment] : m_ProjectionStates[projection]) {
+        const std::string& expected = m_Projection[pattern][segment];
+        std::pair<size_t, size_t> next(pattern, segment + 1);
+        if (expected == "**")
+            next.second = segment;
+        else if (!MatchPattern(expected, key))
+            continue;
+        if (std::find(m_ProjectionPositions.begin(), m_ProjectionPositions.end(), next) == m_ProjectionPositions.end())
+            m_ProjectionPositions.push_back(next);
+    }
+    return this->CreateProjectionState(m_ProjectionPositions);
+}
+
+namespace {
+    // Raised by the indexed engine on invalid inputs, which are then parsed
+    // again by the state machine to report the error with its location.
+    struct IndexedParseError {};
+}
+
+std::shared_ptr<Object> Parser::ParseIndexed() {
+    StructuralIndex index;
+    if (index.Build(m_Reader.GetView())) {
+        try {
+            size_t token = 0;
+            return this->ParseIndexedBlock(index, token, 0);
+        }
+        catch (const IndexedParseError&) {}
+    }
+    return this->Parse();
+}
+
+std::shared_ptr<Object> Parser::ParseIndexedBlock(const StructuralIndex& index, size_t& token, int depth) {
+    // Same states as Parser::Parse, driven by the indexed tokens instead of characters.
+    // Blocks are parsed recursively, so inputs nested too deeply are left to the
+    // state machine to report.
+    if (depth > m_MaxDepth)
+        throw IndexedParseError();
+    const std::vector<uint32_t>& positions = index.GetPositions();
+    std::string_view view = index.GetView();
+
+    std::shared_ptr<Object> mainObject = this->CreateObject(Type::OBJECT);
+    std::string_view key = "";
+    Operator op = Operator::EQUAL;
+    Flags flags = Flags::NONE;
+    int state = 1;
+
+    auto IsKeyValueBlock = [&mainObject]() {
+        return mainObject->Is(Type::OBJECT) && !mainObject->GetMapUnsafe().empty();
+    };
+
+    while (token < positions.size()) {
+        uint32_t position = positions[token++];
+        char ch = view[position];
+
+        if (ch == '}') {
+            if (state == 3 || (state != 2 && depth == 0) || (state == 2 && IsKeyValueBlock()))
+                throw IndexedParseError();
+            if (state == 2)
+                this->PushScalar(mainObject, key, true);
+            return mainObject;
+        }
+
+        if (ch == '{') {
+            if (state != 3 && state != 4 && IsKeyValueBlock())
+                throw IndexedParseError();
+            std::shared_ptr<Object> object = this->ParseIndexedBlock(index, token, depth+1);
+
+            if (state == 1) {
+                mainObject->Push(object, true);
+                state = 4;
+            }
+            else if (state == 2) {
+                this->PushScalar(mainObject, key, true);
+                mainObject->Push(object);
+                state = 4;
+            }
+            else if (state == 3) {
+                if (object->Is(Type::OBJECT) && ((bool) (flags & (Flags::LIST | Flags::RANGE))))
+                    object->ConvertToArray();
+                if ((bool) (flags & Flags::RANGE)) {
+                    if (!object->Is(Type::ARRAY))
+                        throw IndexedParseError();
+                    ObjectArray& array = object->GetArray();
+                    int a = 0, b = 0;
+                    if (array.size() != 2 || array.at(0)->TryAs(a) != ConversionError::NONE || array.at(1)->TryAs(b) != ConversionError::NONE)
+                        throw IndexedParseError();
+                    array.clear();
+                    if (a <= b) for (int i = a; i <= b; i++)
+                        array.push_back(this->CreateScalar(std::to_string(i)));
+                    else for (int i = a; i >= b; i--)
+                        array.push_back(this->CreateScalar(std::to_string(i)));
+                }
+                mainObject->MergeUnsafe(key, object, op);
+                mainObject->Get(key)->SetFlag(flags, true);
+                flags = Flags::NONE;
+                state = 1;
+            }
+            else {
+                mainObject->Push(object);
+            }
+            key = "";
+            continue;
+        }
+
+        if (IS_OPERATOR(ch)) {
+            if (state != 2)
+                throw IndexedParseError();
+            // Two-character operators are indexed as two adjacent tokens.
+            bool equal = token < positions.size() && positions[token] == position+1 && view[position+1] == '=';
+            switch (ch) {
+                case '=': op = Operator::EQUAL; break;
+                case '<': op = (equal ? Operator::LESS_EQUAL : Operator::LESS); break;
+                case '>': op = (equal ? Operator::GREATER_EQUAL : Operator::GREATER); break;
+                case '!': op = Operator::NOT_EQUAL; break;
+                case '?': op = Operator::NOT_NULL; break;
+            }
+            if ((ch == '!' || ch == '?') && !equal)
+                throw IndexedParseError();
+            if (ch != '=' && equal)
+                token++;
+            state = 3;
+            continue;
+        }
+
+        std::string_view buffer = index.GetToken(position);
+        if (state == 1) {
+            key = buffer;
+            state = 2;
+        }
+        else if (state == 2) {
+            if (IsKeyValueBlock())
+                throw IndexedParseError();
+            this->PushScalar(mainObject, key, true);
+            this->PushScalar(mainObject, buffer);
+            key = "";
+            state = 4;
+        }
+        else if (state == 3) {
+            // Flags are at most 5 characters long and only apply to the next object.
+            if (buffer.size() <= 5) {
+                Flags flag = Flags::NONE;
+                if (EqualsIgnoreCase(buffer, "rgb"))
+                    flag = Flags::RGB;
+                else if (EqualsIgnoreCase(buffer, "hsv"))
+                    flag = Flags::HSV;
+                else if (EqualsIgnoreCase(buffer, "list"))
+                    flag = Flags::LIST;
+                else if (EqualsIgnoreCase(buffer, "range"))
+                    flag = Flags::RANGE;
+                if (flag != Flags::NONE) {
+                    flags = flag;
+                    continue;
+                }
+            }
+            mainObject->MergeUnsafe(key, this->CreateScalar(buffer), op);
+            key = "";
+            state = 1;
+        }
+        else {
+            this->PushScalar(mainObject, buffer);
+        }
+    }
+
+    if (depth == 0 && (mainObject->Is(Type::SCALAR) || mainObject->Is(Type::ARRAY)))
+        throw IndexedParseError();
+    if ((!key.empty() && (state == 2 || state == 3)) || state == 4)
+        throw IndexedParseError();
+    if (depth > 0 && mainObject->Is(Type::OBJECT))
+        throw IndexedParseError();
+    return mainObject;
+}
+
+std::shared_ptr<Object> Parser::ParseView(std::shared_ptr<Buffer> buffer, std::string_view view, uint32_t line, uint32_t cursor) {
+    m_FilePath = "";
+    m_Reader.OpenBuffer(std::move(buffer), view, line, cursor);
+    m_PreviousOffset = m_Reader.GetSourceOffset();
+    m_LastBraceOffset = m_PreviousOffset;
+    return this->ParseRoot();
+}
+
+namespace {
+    // Finds the offset of every top-level entry of the input. Returns false unless the
+    // top level is a plain sequence of 'key op value' entries whose values are scalars
+    // or blocks, in which case the entries can be parsed separately without changing
+    // the result.
+    bool FindTopLevelEntries(std::string_view view, std::vector<size_t>& entries) {
+        enum class Expected { KEY, OPERATOR, VALUE };
+        Lexer lexer(view);
+        Expected expected = Expected::KEY;
+        bool flagged = false;
+        int depth = 0;
+
+        for (Token token = lexer.Next(); token.type != TokenType::END; token = lexer.Next()) {
+            if (token.type == TokenType::COMMENT)
+                continue;
+            if (token.type == TokenType::INVALID)
+                return false;
+
+            // Blocks are skipped, only their braces matter.
+            if (depth > 0) {
+                if (token.type == TokenType::OPEN_BRACE)
+                    depth++;
+                else if (token.type == TokenType::CLOSE_BRACE && --depth == 0) {
+                    expected = Expected::KEY;
+                    flagged = false;
+                }
+                continue;
+            }
+
+            if (expected == Expected::KEY) {
+                if (token.type != TokenType::SCALAR && token.type != TokenType::STRING)
+                    return false;
+                entries.push_back(token.offset);
+                expected = Expected::OPERATOR;
+            }
+            else if (expected == Expected::OPERATOR) {
+                if (token.type != TokenType::OPERATOR)
+                    return false;
+                expected = Expected::VALUE;
+            }
+            else if (token.type == TokenType::OPEN_BRACE) {
+                depth = 1;
+            }
+            // Flags only apply to the block following them.
+            else if (token.type == TokenType::FLAG) {
+                flagged = true;
+            }
+            else if ((token.type == TokenType::SCALAR || token.type == TokenType::STRING) && !flagged) {
+                expected = Expected::KEY;
+            }
+            else {
+                return false;
+            }
+        }
+        return depth == 0 && expected == Expected::KEY;
+    }
+}
+
+std::shared_ptr<Object> Parser::ParseFileParallel(const std::string& filePath, unsigned int threads) {
+    if (threads == 0)
+        threads = std::max(1u, std::thread::hardware_concurrency());
+
+    // Find the top-level entries, and fall back to a sequential parse when the file
+    // cannot be split or is too small to be worth it.
+    Reader reader;
+    reader.OpenFile(filePath);
+    std::shared_ptr<Buffer> buffer = reader.GetBuffer();
+    std::string_view view = reader.GetView();
+    std::vector<size_t> entries;
+    if (threads == 1 || !FindTopLevelEntries(view, entries) || entries.size() < 2)
+        return this->ParseFile(filePath);
+
+    // Group the entries into chunks of similar sizes, a few per thread so that
+    // threads finishing early can take over the remaining ones.
+    struct Chunk {
+        size_t firstEntry;
+        size_t lastEntry;
+        std::vector<std::shared_ptr<Object>> roots;
+    };
+    std::vector<Chunk> chunks;
+    size_t chunkCount = std::min<size_t>(entries.size(), threads * 4);
+    for (size_t entry = 0; entry < entries.size();) {
+        size_t limit = view.size() * (chunks.size() + 1) / chunkCount;
+        size_t last = entry + 1;
+        while (last < entries.size() && entries[last] < limit)
+            last++;
+        chunks.push_back(Chunk{ entry, last, {} });
+        entry = last;
+    }
+    const auto GetEntriesView = [&](size_t first, size_t last) {
+        size_t end = (last < entries.size()) ? entries[last] : view.size();
+        return view.substr(entries[first], end - entries[first]);
+    };
+
+    // Parse the chunks on the threads. A chunk repeating one of its keys has merged the
+    // values of that key, so its entries are parsed again one by one to be merged below
+    // in the same order as a sequential parse.
+    std::atomic<size_t> nextChunk = 0;
+    std::atomic<bool> failed = false;
+    const auto ParseChunks = [&]() {
+        Parser parser;
+        parser.SetEngine(m_Engine);
+        parser.SetMaxDepth(m_MaxDepth);
+        try {
+            for (size_t i = nextChunk++; i < chunks.size() && !failed; i = nextChunk++) {
+                Chunk& chunk = chunks[i];
+                std::shared_ptr<Object> root = parser.ParseView(buffer, GetEntriesView(chunk.firstEntry, chunk.lastEntry));
+                if (root->GetMapUnsafe().size() == chunk.lastEntry - chunk.firstEntry) {
+                    chunk.roots.push_back(root);
+                    continue;
+                }
+                for (size_t entry = chunk.firstEntry; entry < chunk.lastEntry; entry++)
+                    chunk.roots.push_back(parser.ParseView(buffer, GetEntriesView(entry, entry + 1)));
+            }
+        }
+        catch (const std::exception&) {
+            failed = true;
+        }
+    };
+    std::vector<std::thread> workers;
+    for (unsigned int i = 1; i < threads; i++)
+        workers.emplace_back(ParseChunks);
+    ParseChunks();
+    for (std::thread& worker : workers)
+        worker.join();
+
+    // Parse invalid inputs again sequentially to report the error with its location.
+    if (failed)
+        return this->ParseFile(filePath);
+
+    // Merge the entries in source order. New keys are inserted as they are, and repeated
+    // ones are merged with the flags of their blocks applied afterwards, like the state
+    // machine does. The keys of the root are interned again in a table of its own.
+    this->ResetSymbols();
+    std::shared_ptr<Object> root = this->CreateObject(Type::OBJECT);
+    ObjectMap& map = root->GetMapUnsafe();
+    map.reserve(entries.size());
+    for (Chunk& chunk : chunks) {
+        for (const std::shared_ptr<Object>& chunkRoot : chunk.roots) {
+            for (auto& [key, pair] : chunkRoot->GetMapUnsafe()) {
+                if (!map.contains(key)) {
+                    map.insert_missing(key, pair);
+                    continue;
+                }
+                auto& [op, value] = pair;
+                Flags flags = value->GetFlags();
+                value->SetFlag(flags, false);
+                root->MergeUnsafe(key.GetName(), value, op);
+                root->Get(key)->SetFlag(flags, true);
+            }
+        }
+    }
+    return root;
+}
+
+namespace {
+    struct File {
+        std::string path;
+        uintmax_t size;
+    };
+
+    void SortBySize(std::vector<File>& files) {
+        std::sort(files.begin(), files.end(), [](const File& a, const File& b) {
+            return a.size > b.size;
+        });
+    }
+
+    // Lists the regular files of the directory tree matching the pattern, largest first.
+    std::vector<File> ListDirectory(const std::string& directoryPath, const std::string& pattern) {
+        if (!std::filesystem::is_directory(directoryPath))
+            throw std::runtime_error("Cannot list the files of " + directoryPath + ": not a directory.");
+
+        std::vector<File> files;
+        bool matchPath = (pattern.find('/') != std::string::npos);
+        for (const auto& entry : std::filesystem::recursive_directory_iterator(directoryPath)) {
+            if (!entry.is_regular_file())
+                continue;
+            std::string name = matchPath
+                ? entry.path().lexically_relative(directoryPath).generic_string()
+                : entry.path().filename().string();
+            if (MatchPattern(pattern, name))
+                files.push_back(File{ entry.path().string(), entry.file_size() });
+        }
+        SortBySize(files);
+        return files;
+    }
+}
+
+DirectoryResult Parser::ParseDirectory(const std::string& directoryPath, const std::string& pattern, unsigned int threads) {
+    if (threads == 0)
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<File> files = ListDirectory(directoryPath, pattern);
+
+    // Deal the files to the threads from the largest to the smallest. Each thread parses
+    // its own files from the largest, then steals the smallest files left to the others.
+    struct Queue {
+        std::mutex mutex;
+        std::deque<size_t> files;
+    };
+    threads = std::max(1u, std::min<unsigned int>(threads, files.size()));
+    std::vector<Queue> queues(threads);
+    for (size_t i = 0; i < files.size(); i++)
+        queues[i % threads].files.push_back(i);
+
+    std::vector<std::shared_ptr<Object>> objects(files.size());
+    std::vector<std::optional<std::string>> errors(files.size());
+    const auto ParseFiles = [&](unsigned int thread) {
+        Parser parser;
+        parser.SetEngine(m_Engine);
+        parser.SetMaxDepth(m_MaxDepth);
+        while (true) {
+            std::optional<size_t> file;
+            for (unsigned int i = 0; i < threads && !file; i++) {
+                Queue& queue = queues[(thread + i) % threads];
+                std::lock_guard<std::mutex> lock(queue.mutex);
+                if (queue.files.empty())
+                    continue;
+                if (i == 0) {
+                    file = queue.files.front();
+                    queue.files.pop_front();
+                }
+                else {
+                    file = queue.files.back();
+                    queue.files.pop_back();
+                }
+            }
+            if (!file)
+                return;
+            // Read the file first, so that the files which cannot be read
+            // are reported like Loader does, instead of parsed as empty.
+            std::shared_ptr<Buffer> buffer = std::make_shared<Buffer>();
+            if (!buffer->MapFile(files[*file].path) && !buffer->ReadFile(files[*file].path)) {
+                errors[*file] = "Failed to read file " + files[*file].path + ".";
+                continue;
+            }
+            try {
+                objects[*file] = parser.ParseBuffer(std::move(buffer), files[*file].path);
+            }
+            catch (const std::exception& e) {
+                errors[*file] = e.what();
+            }
+        }
+    };
+    std::vector<std::thread> workers;
+    for (unsigned int i = 1; i < threads; i++)
+        workers.emplace_back(ParseFiles, i);
+    ParseFiles(0);
+    for (std::thread& worker : workers)
+        worker.join();
+
+    DirectoryResult result;
+    for (size_t i = 0; i < files.size(); i++) {
+        if (errors[i])
+            result.errors.emplace(std::move(files[i].path), std::move(*errors[i]));
+        else
+            result.objects.emplace(std::move(files[i].path), std::move(objects[i]));
+    }
+    return result;
+}
+
+std::shared_ptr<Object> ParseFile(const std::string& filePath) {
+    Parser parser;
+    return parser.ParseFile(filePath);
+}
+
+std::shared_ptr<Object> ParseFileParallel(const std::string& filePath, unsigned int threads) {
+    Parser parser;
+    return parser.ParseFileParallel(filePath, threads);
+}
+
+std::shared_ptr<Object> ParseLazyFile(const std::string& filePath) {
+    Parser parser;
+    parser.SetLazy(true);
+    return parser.ParseFile(filePath);
+}
+
+std::shared_ptr<Object> ParseProjectedFile(const std::string& filePath, const std::vector<std::string>& patterns) {
+    Parser parser;
+    parser.SetProjection(patterns);
+    return parser.ParseFile(filePath);
+}
+
+DirectoryResult ParseDirectory(const std::string& directoryPath, const std::string& pattern, unsigned int threads) {
+    Parser parser;
+    return parser.ParseDirectory(directoryPath, pattern, threads);
+}
+
+std::shared_ptr<Object> ParseString(const std::string& content) {
+    Parser parser;
+    return parser.ParseString(content);
+}
+
+std::shared_ptr<Object> ParseStream(std::istream& stream) {
+    Parser parser;
+    return parser.ParseStream(stream);
+}
+
+std::shared_ptr<Document> ParseDocumentFile(const std::string& filePath) {
+    Parser parser;
+    return parser.ParseDocumentFile(filePath);
+}
+
+std::shared_ptr<Document> ParseDocumentString(const std::string& content) {
+    Parser parser;
+    return parser.ParseDocumentString(content);
+}
+
+ParseResult ParseResultFile(const std::string& filePath) {
+    Parser parser;
+    return parser.ParseResultFile(filePath);
+}
+
+ParseResult ParseResultString(const std::string& content) {
+    Parser parser;
+    return parser.ParseResultString(content);
+}
+
+std::shared_ptr<TapeDocument> ParseTapeFile(const std::string& filePath) {
+    Parser parser;
+    return parser.ParseTapeFile(filePath);
+}
+
+std::shared_ptr<TapeDocument> ParseTapeString(const std::string& content) {
+    Parser parser;
+    return parser.ParseTapeString(content);
+}
+
+void ParseEventsFile(const std::string& filePath, EventHandler& handler) {
+    Parser parser;
+    parser.ParseEventsFile(filePath, handler);
+}
+
+void ParseEventsString(const std::string& content, EventHandler& handler) {
+    Parser parser;
+    parser.ParseEventsString(content, handler);
+}
+
+//////////////////////////////////////////////////////////
+//                      Loader                          //
+//////////////////////////////////////////////////////////
+
+const size_t Loader::s_DefaultBufferBudget = 64 * 1024 * 1024;
+
+Loader::Loader(unsigned int readThreads, unsigned int parseThreads, size_t bufferBudget)
+: m_ReadThreads(std::max(1u, readThreads)), m_ParseThreads(parseThreads), m_BufferBudget(bufferBudget), m_Stats{}
+{
+    if (m_ParseThreads == 0)
+        m_ParseThreads = std::max(1u, std::thread::hardware_concurrency());
+}
+
+namespace {
+    DirectoryResult LoadFiles(std::vector<File> files, unsigned int readThreads, unsigned int parseThreads, size_t bufferBudget, LoaderStats& stats) {
+        using Clock = std::chrono::steady_clock;
+        stats = LoaderStats{};
+        stats.files = files.size();
+
+        std::mutex mutex;
+        std::condition_variable budgetReleased;
+        std::condition_variable bufferQueued;
+        std::deque<std::pair<size_t, std::shared_ptr<Buffer>>> queue;
+        size_t nextFile = 0;
+        size_t bytesInFlight = 0;
+        size_t queueDepthSum = 0;
+        size_t dequeued = 0;
+        unsigned int readersLeft = readThreads;
+        std::vector<std::shared_ptr<Object>> objects(files.size());
+        std::vector<std::optional<std::string>> errors(files.size());
+
+        // Reader threads reserve the size of the next file in the budget before reading it,
+        // waiting for parser threads to release some when it is exhausted. A file larger than
+        // the whole budget is read once nothing else is in flight.
+        const auto ReadFiles = [&]() {
+            std::unique_lock<std::mutex> lock(mutex);
+            while (nextFile < files.size()) {
+                size_t file = nextFile++;
+                size_t size = files[file].size;
+                if (bytesInFlight > 0 && bytesInFlight + size > bufferBudget) {
+                    Clock::time_point start = Clock::now();
+                    budgetReleased.wait(lock, [&]() {
+                        return bytesInFlight == 0 || bytesInFlight + size <= bufferBudget;
+                    });
+                    stats.readStall += Clock::now() - start;
+                }
+                bytesInFlight += size;
+                stats.maxBytesInFlight = std::max(stats.maxBytesInFlight, bytesInFlight);
+                lock.unlock();
+
+                std::shared_ptr<Buffer> buffer = std::make_shared<Buffer>();
+                bool read = buffer->ReadFile(files[file].path);
+
+                lock.lock();
+                if (!read) {
+                    errors[file] = "Failed to read file " + files[file].path + ".";
+                    bytesInFlight -= size;
+                    budgetReleased.notify_all();
+                    continue;
+                }
+                stats.bytesRead += buffer->GetView().size();
+                queue.emplace_back(file, std::move(buffer));
+                stats.maxQueueDepth = std::max(stats.maxQueueDepth, queue.size());
+                bufferQueued.notify_one();
+            }
+            readersLeft--;
+            bufferQueued.notify_all();
+        };
+
+        // Parser threads take the buffers in the order they were read, and release
+        // their size in the budget once they are parsed.
+        const auto ParseFiles = [&]() {
+            Parser parser;
+            std::unique_lock<std::mutex> lock(mutex);
+            while (true) {
+                if (queue.empty() && readersLeft > 0) {
+                    Clock::time_point start = Clock::now();
+                    bufferQueued.wait(lock, [&]() {
+                        return !queue.empty() || readersLeft == 0;
+                    });
+                    stats.parseStall += Clock::now() - start;
+                }
+                if (queue.empty())
+                    return;
+                queueDepthSum += queue.size();
+                dequeued++;
+                auto [file, buffer] = std::move(queue.front());
+                queue.pop_front();
+                lock.unlock();
+
+                try {
+                    objects[file] = parser.ParseBuffer(std::move(buffer), files[file].path);
+                }
+                catch (const std::exception& e) {
+                    errors[file] = e.what();
+                }
+
+                lock.lock();
+                bytesInFlight -= files[file].size;
+                budgetReleased.notify_all();
+            }
+        };
+
+        std::vector<std::thread> workers;
+        for (unsigned int i = 0; i < readThreads; i++)
+            workers.emplace_back(ReadFiles);
+        for (unsigned int i = 1; i < parseThreads; i++)
+            workers.emplace_back(ParseFiles);
+        ParseFiles();
+        for (std::thread& worker : workers)
+            worker.join();
+        stats.averageQueueDepth = (dequeued > 0) ? (double) queueDepthSum / dequeued : 0.0;
+
+        DirectoryResult result;
+        for (size_t i = 0; i < files.size(); i++) {
+            if (errors[i])
+                result.errors.emplace(std::move(files[i].path), std::move(*errors[i]));
+            else
+                result.objects.emplace(std::move(files[i].path), std::move(objects[i]));
+        }
+        return result;
+    }
+}
+
+DirectoryResult Loader::Load(const std::vector<std::string>& filePaths) {
+    std::vector<File> files;
+    for (const std::string& filePath : filePaths) {
+        std::error_code error;
+        uintmax_t size = std::filesystem::file_size(filePath, error);
+        files.push_back(File{ filePath, error ? 0 : size });
+    }
+    SortBySize(files);
+    return LoadFiles(std::move(files), m_ReadThreads, m_ParseThreads, m_BufferBudget, m_Stats);
+}
+
+DirectoryResult Loader::LoadDirectory(const std::string& directoryPath, const std::string& pattern) {
+    return LoadFiles(ListDirectory(directoryPath, pattern), m_ReadThreads, m_ParseThreads, m_BufferBudget, m_Stats);
+}
+
+const LoaderStats& Loader::GetStats() const {
+    return m_Stats;
+}
+
+
+//////////////////////////////////////////////////////////
+//                   Tape Document                      //
+//////////////////////////////////////////////////////////
+
+namespace {
+    const uint32_t s_NoNode = UINT32_MAX;
+
+    TapeDocument::Node MakeTapeNode(Type type) {
+        return TapeDocument::Node{ "", "", 0, 0, s_NoNode, type, Operator::EQUAL, Flags::NONE };
+    }
+}
+
+const uint32_t TapeDocument::s_LinearLookupLimit = 16;
+
+TapeDocument::TapeDocument(std::shared_ptr<Buffer> buffer)
+: m_Buffer(buffer), m_Root(0)
+{}
+
+TapeCursor TapeDocument::GetRoot() const {
+    return TapeCursor(this, m_Root);
+}
+
+const std::vector<TapeDocument::Node>& TapeDocument::GetNodes() const {
+    return m_Nodes;
+}
+
+// Builds the nodes of a tape document from a structural index, following the
+// same states as Parser::Parse. The entries of the blocks being parsed are kept
+// on a shared stack, and a block is written to the tape once it is closed so that
+// its children are contiguous. Invalid inputs, including blocks nested deeper
+// than the maximum depth of the parser, are rejected and left to the parser to
+// report.
+class TapeBuilder {
+    public:
+        using Node = TapeDocument::Node;
+
+        TapeBuilder(TapeDocument& document, const StructuralIndex& index, int maxDepth);
+
+        bool Build();
+
+    private:
+        bool ParseBlock(int depth, Node& block);
+        bool ConvertFlagged(Node& value, Flags flags);
+        bool CloseObject(size_t mark, Node& block);
+        bool MergeDuplicates(Node* entries, size_t begin, size_t end);
+        uint32_t Emit(const Node* nodes, size_t count);
+
+        TapeDocument& m_Document;
+        const StructuralIndex& m_Index;
+        int m_MaxDepth;
+        size_t m_Token;
+        std::vector<Node> m_Pending;
+        std::vector<Node> m_Elements;
+        std::vector<uint32_t> m_Order;
+        std::vector<uint32_t> m_Positions;
+};
+
+TapeBuilder::TapeBuilder(TapeDocument& document, const StructuralIndex& index, int maxDepth)
+: m_Document(document), m_Index(index), m_MaxDepth(maxDepth), m_Token(0)
+{}
+
+bool TapeBuilder::Build() {
+    m_Document.m_Nodes.reserve(m_Index.GetPositions().size() / 2 + 1);
+    Node root = MakeTapeNode(Type::OBJECT);
+    if (!this->ParseBlock(0, root))
+        return false;
+    m_Document.m_Root = this->Emit(&root, 1);
+    return true;
+}
+
+uint32_t TapeBuilder::Emit(const Node* nodes, size_t count) {
+    uint32_t first = m_Document.m_Nodes.size();
+    m_Document.m_Nodes.insert(m_Document.m_Nodes.end(), nodes, nodes + count);
+    return first;
+}
+
+bool TapeBuilder::ParseBlock(int depth, Node& block) {
+    if (depth > m_MaxDepth)
+        return false;
+    const std::vector<uint32_t>& positions = m_Index.GetPositions();
+    std::string_view view = m_Index.GetView();
+
+    size_t mark = m_Pending.size();
+    bool isArray = false;
+    bool isClosed = false;
+    std::string_view key = "";
+    Operator op = Operator::EQUAL;
+    Flags flags = Flags::NONE;
+    int state = 1;
+
+    const auto PushScalar = [this](std::string_view scalar) {
+        Node value = MakeTapeNode(Type::SCALAR);
+        value.scalar = scalar;
+        m_Pending.push_back(value);
+    };
+
+    while (m_Token < positions.size()) {
+        uint32_t position = positions[m_Token++];
+        char ch = view[position];
+        bool isKeyValueBlock = !isArray && m_Pending.size() > mark;
+
+        if (ch == '}') {
+            if (state == 3 || (state != 2 && depth == 0) || (state == 2 && isKeyValueBlock))
+                return false;
+            if (state == 2) {
+                PushScalar(key);
+                isArray = true;
+            }
+            isClosed = true;
+            break;
+        }
+
+        if (ch == '{') {
+            if (state != 3 && state != 4 && isKeyValueBlock)
+                return false;
+            Node value = MakeTapeNode(Type::OBJECT);
+            if (!this->ParseBlock(depth+1, value))
+                return false;
+
+            if (state == 2)
+                PushScalar(key);
+            if (state == 3) {
+                if (!this->ConvertFlagged(value, flags))
+                    return false;
+                // The flags are applied to the entry once merged.
+                value.key = key;
+                value.op = op;
+                value.flags = flags;
+                flags = Flags::NONE;
+                state = 1;
+            }
+            else {
+                isArray = true;
+                state = 4;
+            }
+            m_Pending.push_back(value);
+            key = "";
+            continue;
+        }
+
+        if (IS_OPERATOR(ch)) {
+            if (state != 2)
+                return false;
+            bool equal = m_Token < positions.size() && positions[m_Token] == position+1 && view[position+1] == '=';
+            switch (ch) {
+                case '=': op = Operator::EQUAL; break;
+                case '<': op = (equal ? Operator::LESS_EQUAL : Operator::LESS); break;
+                case '>': op = (equal ? Operator::GREATER_EQUAL : Operator::GREATER); break;
+                case '!': op = Operator::NOT_EQUAL; break;
+                case '?': op = Operator::NOT_NULL; break;
+            }
+            if ((ch == '!' || ch == '?') && !equal)
+                return false;
+            if (ch != '=' && equal)
+                m_Token++;
+            state = 3;
+            continue;
+        }
+
+        std::string_view buffer = m_Index.GetToken(position);
+        if (state == 1) {
+            key = buffer;
+            state = 2;
+        }
+        else if (state == 2) {
+            if (isKeyValueBlock)
+                return false;
+            PushScalar(key);
+            PushScalar(buffer);
+            isArray = true;
+            key = "";
+            state = 4;
+        }
+        else if (state == 3) {
+            if (buffer.size() <= 5) {
+                Flags flag = Flags::NONE;
+                if (EqualsIgnoreCase(buffer, "rgb"))
+                    flag = Flags::RGB;
+                else if (EqualsIgnoreCase(buffer, "hsv"))
+                    flag = Flags::HSV;
+                else if (EqualsIgnoreCase(buffer, "list"))
+                    flag = Flags::LIST;
+                else if (EqualsIgnoreCase(buffer, "range"))
+                    flag = Flags::RANGE;
+                if (flag != Flags::NONE) {
+                    flags = flag;
+                    continue;
+                }
+            }
+            PushScalar(buffer);
+            m_Pending.back().key = key;
+            m_Pending.back().op = op;
+            key = "";
+            state = 1;
+        }
+        else {
+            PushScalar(buffer);
+        }
+    }
+
+    // Blocks left open are only valid at the root, after a complete entry.
+    if (!isClosed && (depth > 0 || isArray || state != 1))
+        return false;
+
+    if (isArray) {
+        block.type = Type::ARRAY;
+        block.count = m_Pending.size() - mark;
+        block.first = this->Emit(m_Pending.data() + mark, block.count);
+    }
+    else if (!this->CloseObject(mark, block)) {
+        return false;
+    }
+    m_Pending.resize(mark);
+    return true;
+}
+
+bool TapeBuilder::ConvertFlagged(Node& value, Flags flags) {
+    // Empty objects are converted to arrays, other objects become the only value of an array.
+    if (value.type == Type::OBJECT && ((bool) (flags & (Flags::LIST | Flags::RANGE)))) {
+        if (value.count > 0) {
+            Node object = value;
+            value = MakeTapeNode(Type::ARRAY);
+            value.first = this->Emit(&object, 1);
+            value.count = 1;
+        }
+        else {
+            value = MakeTapeNode(Type::ARRAY);
+        }
+    }
+    if (!((bool) (flags & Flags::RANGE)))
+        return true;
+
+    // Expand the range, with the generated numbers owned by the document.
+    const std::vector<Node>& nodes = m_Document.m_Nodes;
+    if (value.type != Type::ARRAY || value.count != 2)
+        return false;
+    if (nodes[value.first].type != Type::SCALAR || nodes[value.first+1].type != Type::SCALAR)
+        return false;
+    int a, b;
+    try {
+        a = std::stoi(std::string(nodes[value.first].scalar));
+        b = std::stoi(std::string(nodes[value.first+1].scalar));
+    }
+    catch (std::exception& e) {
+        return false;
+    }
+    m_Elements.clear();
+    for (int i = a; (a <= b) ? i <= b : i >= b; i += (a <= b) ? 1 : -1) {
+        m_Elements.push_back(MakeTapeNode(Type::SCALAR));
+        m_Elements.back().scalar = m_Document.m_Strings.emplace_back(std::to_string(i));
+    }
+    value.first = this->Emit(m_Elements.data(), m_Elements.size());
+    value.count = m_Elements.size();
+    return true;
+}
+
+bool TapeBuilder::CloseObject(size_t mark, Node& block) {
+    Node* entries = m_Pending.data() + mark;
+    size_t count = m_Pending.size() - mark;
+    block.type = Type::OBJECT;
+    if (count == 0)
+        return true;
+
+    // Sort the entries by key, then by position, to find duplicates and build the lookup index.
+    m_Order.resize(count);
+    for (size_t i = 0; i < count; i++)
+        m_Order[i] = i;
+    std::sort(m_Order.begin(), m_Order.end(), [entries](uint32_t a, uint32_t b) {
+        int comparison = entries[a].key.compare(entries[b].key);
+        return comparison < 0 || (comparison == 0 && a < b);
+    });
+
+    for (size_t i = 0; i < count;) {
+        size_t j = i + 1;
+        while (j < count && entries[m_Order[j]].key == entries[m_Order[i]].key)
+            j++;
+        if (j - i > 1 && !this->MergeDuplicates(entries, i, j))
+            return false;
+        i = j;
+    }
+
+    // Write the remaining entries in their insertion order.
+    m_Positions.resize(count);
+    uint32_t first = m_Document.m_Nodes.size();
+    uint32_t written = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (entries[i].type == Type::NONE)
+            continue;
+        m_Positions[i] = written++;
+        m_Document.m_Nodes.push_back(entries[i]);
+    }
+    block.first = first;
+    block.count = written;
+
+    if (written > TapeDocument::s_LinearLookupLimit) {
+        block.sorted = m_Document.m_Sorted.size();
+        for (uint32_t i : m_Order) {
+            if (entries[i].type != Type::NONE)
+                m_Document.m_Sorted.push_back(first + m_Positions[i]);
+        }
+    }
+    return true;
+}
+
+bool TapeBuilder::MergeDuplicates(Node* entries, size_t begin, size_t end) {
+    // Replays Object::MergeUnsafe on the values of a duplicated key, in order,
+    // merging them into the first one and removing the others.
+    const std::vector<Node>& nodes = m_Document.m_Nodes;
+    Node& merged = entries[m_Order[begin]];
+    bool isExpanded = false;
+    m_Elements.clear();
+
+    const auto Expand = [&]() {
+        if (!isExpanded)
+            m_Elements.insert(m_Elements.end(), nodes.begin() + merged.first, nodes.begin() + merged.first + merged.count);
+        isExpanded = true;
+    };
+
+    for (size_t i = begin + 1; i < end; i++) {
+        Node& value = entries[m_Order[i]];
+        Flags entryFlags = value.flags;
+
+        if (merged.type == Type::ARRAY && ((bool) (merged.flags & (Flags::LIST | Flags::RANGE))) && value.type == Type::ARRAY) {
+            Expand();
+            m_Elements.insert(m_Elements.end(), nodes.begin() + value.first, nodes.begin() + value.first + value.count);
+        }
+        else if ((bool) (merged.flags & (Flags::LIST | Flags::RANGE)) && value.type == Type::ARRAY) {
+            return false;
+        }
+        else {
+            merged.flags |= Flags::MULTILINE;
+            if (merged.type != Type::ARRAY) {
+                Node former = merged;
+                former.key = "";
+                former.op = Operator::EQUAL;
+                former.flags = Flags::NONE;
+                if (merged.type == Type::SCALAR || merged.count > 0)
+                    m_Elements.push_back(former);
+                merged.type = Type::ARRAY;
+                merged.scalar = "";
+                merged.sorted = s_NoNode;
+                isExpanded = true;
+            }
+            Expand();
+            Node element = value;
+            element.key = "";
+            element.op = Operator::EQUAL;
+            element.flags = Flags::NONE;
+            m_Elements.push_back(element);
+        }
+
+        merged.flags |= entryFlags;
+        value.type = Type::NONE;
+    }
+
+    if (isExpanded) {
+        merged.first = this->Emit(m_Elements.data(), m_Elements.size());
+        merged.count = m_Elements.size();
+    }
+    return true;
+}
+
+std::shared_ptr<TapeDocument> Parser::ParseTapeFile(const std::string& filePath) {
+    // Initialize the reader with the file.
+    m_FilePath = filePath;
+    m_Reader.OpenFile(filePath);
+
+    m_PreviousOffset = 0;
+    m_LastBraceOffset = 0;
+    return this->ParseTapeRoot();
+}
+
+std::shared_ptr<TapeDocument> Parser::ParseTapeString(const std::string& content) {
+    // Initialize the reader with the string.
+    m_FilePath = "";
+    m_Reader.OpenString(content);
+
+    m_PreviousOffset = 0;
+    m_LastBraceOffset = 0;
+    return this->ParseTapeRoot();
+}
+
+std::shared_ptr<TapeDocument> Parser::ParseTapeRoot() {
+    std::shared_ptr<TapeDocument> document = std::make_shared<TapeDocument>(m_Reader.GetBuffer());
+    StructuralIndex index;
+    if (index.Build(m_Reader.GetView())) {
+        TapeBuilder builder(*document, index, m_MaxDepth);
+        if (builder.Build())
+            return document;
+    }
+
+    // Parse invalid inputs again with the state machine to report the error.
+    this->Parse();
+    throw std::runtime_error("Cannot build a tape document from this input.");
+}
+
+//////////////////////////////////////////////////////////
+//                    Tape Cursor                       //
+//////////////////////////////////////////////////////////
+
+TapeCursor::Iterator::Iterator(const TapeDocument* document, uint32_t node)
+: m_Document(document), m_Node(node)
+{}
+
+TapeCursor TapeCursor::Iterator::operator*() const {
+    return TapeCursor(m_Document, m_Node);
+}
+
+TapeCursor::Iterator& TapeCursor::Iterator::operator++() {
+    m_Node++;
+    return *this;
+}
+
+bool TapeCursor::Iterator::operator==(const Iterator& other) const {
+    return m_Node == other.m_Node && m_Document == other.m_Document;
+}
+
+bool TapeCursor::Iterator::operator!=(const Iterator& other) const {
+    return !(*this == other);
+}
+
+TapeCursor::TapeCursor()
+: m_Document(nullptr), m_Node(s_NoNode)
+{}
+
+TapeCursor::TapeCursor(const TapeDocument* document, uint32_t node)
+: m_Document(document), m_Node(node)
+{}
+
+Type TapeCursor::GetType() const {
+    if (m_Document == nullptr)
+        return Type::NONE;
+    return m_Document->m_Nodes[m_Node].type;
+}
+
+bool TapeCursor::Is(Type type) const {
+    return this->GetType() == type;
+}
+
+Flags TapeCursor::GetFlags() const {
+    if (m_Document == nullptr)
+        return Flags::NONE;
+    return m_Document->m_Nodes[m_Node].flags;
+}
+
+bool TapeCursor::HasFlag(Flags flag) const {
+    return (bool) (this->GetFlags() & flag);
+}
+
+std::string_view TapeCursor::GetKey() const {
+    if (m_Document == nullptr)
+        return "";
+    return m_Document->m_Nodes[m_Node].key;
+}
+
+Operator TapeCursor::GetOperator() const {
+    if (m_Document == nullptr)
+        return Operator::EQUAL;
+    return m_Document->m_Nodes[m_Node].op;
+}
+
+std::string_view TapeCursor::GetScalar() const {
+    if (m_Document == nullptr)
+        return "";
+    return m_Document->m_Nodes[m_Node].scalar;
+}
+
+size_t TapeCursor::GetSize() const {
+    if (this->GetType() == Type::NONE || this->GetType() == Type::SCALAR)
+        return 0;
+    return m_Document->m_Nodes[m_Node].count;
+}
+
+template <> std::string TapeCursor::As() const {
+    if (this->GetType() != Type::SCALAR)
+        throw std::runtime_error("Invalid conversion of object to std::string.");
+    return std::string(this->GetScalar());
+}
+
+template <> int TapeCursor::As() const {
+    if (this->GetType() != Type::SCALAR)
+        throw std::runtime_error("Invalid conversion of object to int.");
+    try {
+        return std::stoi(std::string(this->GetScalar()));
+    }
+    catch (std::exception& e) {
+        throw std::runtime_error(std::string(e.what()) + " Invalid conversion of object to int.");
+    }
+}
+
+template <> double TapeCursor::As() const {
+    if (this->GetType() != Type::SCALAR)
+        throw std::runtime_error("Invalid conversion of object to double.");
+    try {
+        return std::stod(std::string(this->GetScalar()));
+    }
+    catch (std::exception& e) {
+        throw std::runtime_error(std::string(e.what()) + " Invalid conversion of object to double.");
+    }
+}
+
+template <> bool TapeCursor::As() const {
+    if (this->GetType() != Type::SCALAR)
+        throw std::runtime_error("Invalid conversion of object to boolean.");
+    if (this->GetScalar() == "yes")
+        return true;
+    else if (this->GetScalar() == "no")
+        return false;
+    throw std::runtime_error("Invalid conversion of object to boolean.");
+}
+
+template <> Date TapeCursor::As() const {
+    if (this->GetType() != Type::SCALAR)
+        throw std::runtime_error("Invalid conversion of object to date.");
+    try {
+        return Date(std::string(this->GetScalar()));
+    }
+    catch (std::exception& e) {
+        throw std::runtime_error(std::string(e.what()) + " Invalid conversion of object to date.");
+    }
+}
+
+template <> sf::Color TapeCursor::As() const {
+    if (this->GetType() != Type::ARRAY || this->GetSize() < 3)
+        throw std::runtime_error("Invalid conversion of object to sf::Color.");
+    try {
+        TapeCursor first = this->At(0);
+        if (!first.Is(Type::SCALAR))
+            throw std::runtime_error("Cannot use GetString on object or array.");
+        if (this->HasFlag(Flags::HSV) || first.GetScalar().find('.') != std::string_view::npos) {
+            #define CLAMP(v) std::min(1.0, std::max(0.0, v))
+            double h = CLAMP(this->At(0).As<double>());
+            double s = CLAMP(this->At(1).As<double>());
+            double v = CLAMP(this->At(2).As<double>());
+            double a = (this->GetSize() > 3) ? CLAMP(this->At(3).As<double>()) : 1.0;
+            #undef CLAMP
+            return ColorFromHsv(h, s, v, a);
+        }
+        else {
+            int r = this->At(0).As<int>();
+            int g = this->At(1).As<int>();
+            int b = this->At(2).As<int>();
+            int a = (this->GetSize() > 3) ? this->At(3).As<int>() : 255;
+            return sf::Color(r, g, b, a);
+        }
+    }
+    catch (std::exception& e) {
+        throw std::runtime_error(std::string(e.what()) + " Invalid conversion of object to sf::Color.");
+    }
+}
+
+template <typename T> std::optional<T> TapeCursor::AsOpt() const {
+    try {
+        return std::optional<T>{this->As<T>()};
+    }
+    catch (std::exception& e) {}
+    return std::nullopt;
+}
+template std::optional<std::string> TapeCursor::AsOpt() const;
+template std::optional<int> TapeCursor::AsOpt() const;
+template std::optional<double> TapeCursor::AsOpt() const;
+template std::optional<bool> TapeCursor::AsOpt() const;
+template std::optional<Date> TapeCursor::AsOpt() const;
+template std::optional<sf::Color> TapeCursor::AsOpt() const;
+
+template <typename T> T TapeCursor::As(const T& defaultValue) const {
+    try {
+        return this->As<T>();
+    }
+    catch (std::exception& e) {}
+    return defaultValue;
+}
+template std::string TapeCursor::As(const std::string& defaultValue) const;
+template int TapeCursor::As(const int& defaultValue) const;
+template double TapeCursor::As(const double& defaultValue) const;
+template bool TapeCursor::As(const bool& defaultValue) const;
+template Date TapeCursor::As(const Date& defaultValue) const;
+template sf::Color TapeCursor::As(const sf::Color& defaultValue) const;
+
+template <typename T> std::vector<T> TapeCursor::AsArray() const {
+    if (this->GetType() != Type::ARRAY)
+        throw std::runtime_error("Invalid conversion of object to array of " + std::string(typeid(T).name()));
+    std::vector<T> array;
+    array.reserve(this->GetSize());
+    try {
+        for (TapeCursor value : *this)
+            array.push_back(value.As<T>());
+    }
+    catch (std::exception& e) {
+        throw std::runtime_error(std::string(e.what()) + " Invalid conversion of object to array of " + std::string(typeid(T).name()));
+    }
+    return array;
+}
+template std::vector<std::string> TapeCursor::AsArray() const;
+template std::vector<int> TapeCursor::AsArray() const;
+template std::vector<double> TapeCursor::AsArray() const;
+template std::vector<bool> TapeCursor::AsArray() const;
+template std::vector<Date> TapeCursor::AsArray() const;
+
+uint32_t TapeCursor::Find(std::string_view key) const {
+    const std::vector<TapeDocument::Node>& nodes = m_Document->m_Nodes;
+    const TapeDocument::Node& node = nodes[m_Node];
+
+    // Large objects are binary searched, small ones are scanned.
+    if (node.sorted != s_NoNode) {
+        auto begin = m_Document->m_Sorted.begin() + node.sorted;
+        auto end = begin + node.count;
+        auto it = std::lower_bound(begin, end, key, [&nodes](uint32_t index, std::string_view key) {
+            return nodes[index].key < key;
+        });
+        if (it != end && nodes[*it].key == key)
+            return *it;
+        return s_NoNode;
+    }
+    for (uint32_t i = node.first; i < node.first + node.count; i++) {
+        if (nodes[i].key == key)
+            return i;
+    }
+    return s_NoNode;
+}
+
+bool TapeCursor::Contains(std::string_view key) const {
+    if (this->GetType() == Type::SCALAR)
+        throw std::runtime_error("Cannot use Contains on scalar.");
+    if (this->GetType() == Type::ARRAY)
+        throw std::runtime_error("Cannot use Contains on array.");
+    if (this->GetType() == Type::NONE)
+        return false;
+    return this->Find(key) != s_NoNode;
+}
+
+TapeCursor TapeCursor::Get(std::string_view key) const {
+    if (this->GetType() == Type::SCALAR)
+        throw std::runtime_error("Cannot use Get on scalar.");
+    if (this->GetType() == Type::ARRAY)
+        throw std::runtime_error("Cannot use Get on array.");
+    if (this->GetType() == Type::NONE)
+        return TapeCursor();
+    uint32_t node = this->Find(key);
+    if (node == s_NoNode)
+        return TapeCursor();
+    return TapeCursor(m_Document, node);
+}
+
+TapeCursor TapeCursor::GetFirst(std::string_view key) const {
+    TapeCursor value = this->Get(key);
+    if (value.Is(Type::ARRAY))
+        return (value.GetSize() > 0) ? value.At(0) : TapeCursor();
+    return value;
+}
+
+Operator TapeCursor::GetOperator(std::string_view key) const {
+    if (this->GetType() == Type::SCALAR)
+        throw std::runtime_error("Cannot use GetOperator on scalar.");
+    if (this->GetType() == Type::ARRAY)
+        throw std::runtime_error("Cannot use GetOperator on array.");
+    return this->Get(key).GetOperator();
+}
+
+TapeCursor TapeCursor::At(size_t index) const {
+    if (index >= this->GetSize())
+        throw std::out_of_range("TapeCursor::At: index out of range.");
+    return TapeCursor(m_Document, m_Document->m_Nodes[m_Node].first + index);
+}
+
+TapeCursor::Iterator TapeCursor::begin() const {
+    if (this->GetSize() == 0)
+        return Iterator(m_Document, 0);
+    return Iterator(m_Document, m_Document->m_Nodes[m_Node].first);
+}
+
+TapeCursor::Iterator TapeCursor::end() const {
+    if (this->GetSize() == 0)
+        return Iterator(m_Document, 0);
+    return Iterator(m_Document, m_Document->m_Nodes[m_Node].first + m_Document->m_Nodes[m_Node].count);
+}
+
+std::shared_ptr<Object> TapeCursor::ToObject() const {
+    return this->ToObject(std::make_shared<SymbolTable>());
+}
+
+std::shared_ptr<Object> TapeCursor::ToObject(const std::shared_ptr<SymbolTable>& symbols) const {
+    std::shared_ptr<Object> object;
+    switch (this->GetType()) {
+        case Type::SCALAR:
+            object = std::make_shared<Object>(this->GetScalar());
+            break;
+        case Type::OBJECT:
+            object = std::make_shared<Object>(ObjectMap(std::pmr::get_default_resource(), symbols));
+            for (TapeCursor entry : *this)
+                object->GetMapUnsafe().insert(entry.GetKey(), ObjectMap::Value(entry.GetOperator(), entry.ToObject(symbols)));
+            break;
+        case Type::ARRAY:
+            object = std::make_shared<Object>(ObjectArray{});
+            for (TapeCursor value : *this)
+                object->GetArrayUnsafe().push_back(value.ToObject(symbols));
+            break;
+        default:
+            return std::make_shared<Object>(Type::NONE);
+    }
+    object->SetFlags(this->GetFlags());
+    return object;
+}
+
+//////////////////////////////////////////////////////////
+//                      Document                        //
+//////////////////////////////////////////////////////////
+
+Arena::Arena(size_t initialSize, std::shared_ptr<SymbolTable> symbols)
+: std::pmr::monotonic_buffer_resource(initialSize), m_Symbols(symbols ? std::move(symbols) : std::make_shared<SymbolTable>()), m_AllocatedSize(0)
+{}
+
+std::shared_ptr<Object> Arena::Create(Type type) {
+    // The pointer does not own the object, which is never destroyed.
+    Object* object = new (this->allocate(sizeof(Object), alignof(Object))) Object(type, this);
+    return std::shared_ptr<Object>(std::shared_ptr<Object>(), object);
+}
+
+std::shared_ptr<Object> Arena::CreateScalar(std::string_view scalar) {
+    std::shared_ptr<Object> object = this->Create(Type::SCALAR);
+    if (this->IsInSource(scalar))
+        object->m_Value.emplace<ScalarView>(scalar, this);
+    else
+        std::get<std::pmr::string>(object->m_Value).assign(scalar);
+    object->ClassifyScalar();
+    return object;
+}
+
+std::shared_ptr<Object> Arena::Adopt(const Object& object) {
+    object.Materialize(false);
+    std::shared_ptr<Object> copy = this->Create(object.m_Type);
+    copy->m_Flags = object.m_Flags;
+    if (object.m_Type == Type::SCALAR) {
+        std::get<std::pmr::string>(copy->m_Value).assign(object.GetScalar());
+        copy->m_ScalarType = object.m_ScalarType;
+        copy->m_Scale = object.m_Scale;
+        copy->m_Number = object.m_Number;
+    }
+    else if (object.m_Type == Type::OBJECT) {
+        ObjectMap& map = std::get<ObjectMap>(copy->m_Value);
+        for (const auto& [key, pair] : std::get<ObjectMap>(object.m_Value))
+            map.insert_missing(key, ObjectMap::Value(pair.first, this->Adopt(*pair.second)));
+    }
+    else if (std::holds_alternative<PackedArray>(object.m_Value))
+        copy->m_Value = CopyPackedArray(std::get<PackedArray>(object.m_Value), this);
+    else if (object.m_Type == Type::ARRAY) {
+        ObjectArray& array = std::get<ObjectArray>(copy->m_Value);
+        const ObjectArray& values = std::get<ObjectArray>(object.m_Value);
+        array.reserve(values.size());
+        for (const std::shared_ptr<Object>& value : values)
+            array.push_back(this->Adopt(*value));
+    }
+    return copy;
+}
+
+std::shared_ptr<Object> Arena::Retain(const std::shared_ptr<Object>& object) {
+    m_Retained.push_back(object);
+    return std::shared_ptr<Object>(std::shared_ptr<Object>(), object.get());
+}
+
+void Arena::SetSource(std::string_view source) {
+    m_Source = source;
+}
+
+bool Arena::IsInSource(std::string_view view) const {
+    // Compare addresses as integers since the view may belong to another buffer.
+    uintptr_t begin = reinterpret_cast<uintptr_t>(m_Source.data());
+    uintptr_t data = reinterpret_cast<uintptr_t>(view.data());
+    return !m_Source.empty() && data >= begin && data + view.size() <= begin + m_Source.size();
+}
+
+size_t Arena::GetAllocatedSize() const {
+    return m_AllocatedSize;
+}
+
+const std::shared_ptr<SymbolTable>& Arena::GetSymbols() const {
+    return m_Symbols;
+}
+
+void* Arena::do_allocate(size_t bytes, size_t alignment) {
+    m_AllocatedSize += bytes;
+    return std::pmr::monotonic_buffer_resource::do_allocate(bytes, alignment);
+}
+
+Document::Document(size_t initialSize)
+: m_Arena(std::make_unique<Arena>(initialSize)), m_Root(std::make_shared<Object>(Type::OBJECT, m_Arena.get())), m_Edited(false)
+{}
+
+std::shared_ptr<Object> Document::GetRoot() {
+    // Share the ownership of the document with the root.
+    return std::shared_ptr<Object>(this->shared_from_this(), m_Root.get());
+}
+
+Arena& Document::GetArena() {
+    return *m_Arena;
+}
+
+std::string_view Document::GetSource() const {
+    if (m_Edited)
+        return m_Text;
+    return (m_Buffer != nullptr) ? m_Buffer->GetView() : std::string_view();
+}
+
+size_t Document::GetAllocatedSize() const {
+    size_t size = m_Arena->GetAllocatedSize();
+    for (const BlockSpan& span : m_Spans) {
+        if (span.arena != nullptr)
+            size += span.arena->GetAllocatedSize();
+    }
+    return size;
+}
+
+std::shared_ptr<Object> Document::ApplyEdit(size_t offset, size_t removedLength, std::string_view text) {
+    std::string_view source = this->GetSource();
+    if (offset > source.size() || removedLength > source.size() - offset)
+        throw std::runtime_error("Edit out of the source, at offset " + std::to_string(offset) + ".");
+    if (!m_Edited) {
+        m_Spans.clear();
+        FindBlockSpans(source, 0, m_Spans);
+    }
+    size_t editEnd = offset + removedLength;
+
+    // Find the blocks containing the edit between their braces, from the outermost one,
+    // as long as the tree still reaches them by their keys. Duplicated keys are merged
+    // in arrays, so their blocks can't be replaced on their own.
+    struct Enclosing {
+        size_t span;
+        Object* parent;
+        std::string_view key;
+    };
+    std::vector<Enclosing> enclosing;
+    Object* parent = m_Root.get();
+    for (size_t i = 0; i < m_Spans.size() && m_Spans[i].open < offset; i++) {
+        if (editEnd > m_Spans[i].close)
+            continue;
+        std::string_view key = Lexer(source.substr(m_Spans[i].key)).Next().text;
+        if (!parent->Is(Type::OBJECT) || !parent->GetMapUnsafe().contains(key))
+            break;
+        std::shared_ptr<Object> value = parent->GetMapUnsafe().at(key).second;
+        if (value->Is(Type::SCALAR) || value->HasFlag(Flags::MULTILINE | Flags::LIST | Flags::RANGE))
+            break;
+        enclosing.push_back(Enclosing{ i, parent, key });
+        parent = value.get();
+    }
+
+    // Parse the innermost block again with its key, unless the edit changed where it
+    // closes, in which case its parent is tried instead.
+    for (size_t depth = enclosing.size(); depth-- > 0;) {
+        auto [i, parent, key] = enclosing[depth];
+        BlockSpan span = m_Spans[i];
+        std::string block;
+        block.reserve(span.close + 1 - span.key + text.size() - removedLength);
+        block.append(source.substr(span.key, offset - span.key));
+        block.append(text);
+        block.append(source.substr(editEnd, span.close + 1 - editEnd));
+        if (FindClosingBrace(block, span.open - span.key + 1) != block.size() - 1)
+            continue;
+
+        // The block is parsed in its own arena, so that the objects it replaces are released
+        // with theirs instead of piling up in the arena of the document.
+        std::shared_ptr<Arena> arena = std::make_shared<Arena>(std::max<size_t>(256, block.size() * 4), m_Arena->GetSymbols());
+        std::shared_ptr<Buffer> buffer = std::make_shared<Buffer>(std::move(block));
+        std::shared_ptr<Object> root = this->ParseEdited(buffer, span.key, *arena);
+        if (!root->Is(Type::OBJECT) || root->GetMapUnsafe().size() != 1)
+            continue;
+        // The key and operator are out of the edit, so only the value of the entry changes.
+        ObjectMap::Value& entry = parent->GetMapUnsafe().at(key);
+        entry = root->GetMapUnsafe().begin()->second;
+
+        // Replace the spans of the block and shift those after it. The arenas of the
+        // replaced spans are released with them.
+        std::vector<BlockSpan> spans;
+        FindBlockSpans(buffer->GetView(), span.key, spans);
+        spans.front().arena = std::move(arena);
+        size_t end = i + 1;
+        while (end < m_Spans.size() && m_Spans[end].open < span.close)
+            end++;
+        for (size_t j = end; j < m_Spans.size(); j++) {
+            m_Spans[j].key = m_Spans[j].key + text.size() - removedLength;
+            m_Spans[j].open = m_Spans[j].open + text.size() - removedLength;
+            m_Spans[j].close = m_Spans[j].close + text.size() - removedLength;
+        }
+        for (size_t j = 0; j < depth; j++)
+            m_Spans[enclosing[j].span].close = m_Spans[enclosing[j].span].close + text.size() - removedLength;
+        m_Spans.erase(m_Spans.begin() + i, m_Spans.begin() + end);
+        m_Spans.insert(m_Spans.begin() + i, std::make_move_iterator(spans.begin()), std::make_move_iterator(spans.end()));
+
+        if (!m_Edited)
+            m_Text.assign(source);
+        m_Text.replace(offset, removedLength, text);
+        m_Edited = true;
+        return std::shared_ptr<Object>(this->shared_from_this(), entry.second.get());
+    }
+
+    // Otherwise the whole source is parsed again.
+    std::string edited;
+    edited.reserve(source.size() + text.size() - removedLength);
+    edited.append(source.substr(0, offset));
+    edited.append(text);
+    edited.append(source.substr(editEnd));
+    // It is parsed in a new arena, which replaces the arena of the document and
+    // those of the edited blocks.
+    std::shared_ptr<Buffer> buffer = std::make_shared<Buffer>(edited);
+    std::unique_ptr<Arena> arena = std::make_unique<Arena>(std::max<size_t>(4096, edited.size() * 4));
+    std::shared_ptr<Object> root = this->ParseEdited(buffer, 0, *arena);
+    this->SetRoot(*root);
+    m_Arena = std::move(arena);
+    m_Text = std::move(edited);
+    m_Edited = true;
+    m_Spans.clear();
+    FindBlockSpans(m_Text, 0, m_Spans);
+    return this->GetRoot();
+}
+
+void Document::FindBlockSpans(std::string_view source, size_t offset, std::vector<BlockSpan>& spans) {
+    // Blocks opened, with their span or -1 if it isn't recorded, under the root.
+    std::vector<int64_t> blocks;
+    Lexer lexer(source);
+    Token previous = Token{ TokenType::END, "", 0, Operator::EQUAL, Flags::NONE };
+    size_t key = 0;
+    for (Token token = lexer.Next(); token.type != TokenType::END; token = lexer.Next()) {
+        if (token.type == TokenType::COMMENT)
+            continue;
+        if (token.type == TokenType::OPERATOR)
+            key = previous.offset;
+        else if (token.type == TokenType::OPEN_BRACE) {
+            // Only the blocks which are values of keys are recorded, in a recorded block.
+            bool keyed = (previous.type == TokenType::OPERATOR || previous.type == TokenType::FLAG);
+            if (keyed && (blocks.empty() || blocks.back() >= 0)) {
+                blocks.push_back(spans.size());
+                spans.push_back(BlockSpan{ offset + key, offset + token.offset, 0 });
+            }
+            else
+                blocks.push_back(-1);
+        }
+        else if (token.type == TokenType::CLOSE_BRACE && !blocks.empty()) {
+            if (blocks.back() >= 0)
+                spans[blocks.back()].close = offset + token.offset;
+            blocks.pop_back();
+        }
+        previous = token;
+    }
+}
+
+std::shared_ptr<Object> Document::ParseEdited(std::shared_ptr<Buffer> buffer, size_t offset, Arena& arena) {
+    // Scalars are copied in the arena, since the buffer is only kept during the parsing.
+    Parser parser;
+    parser.m_Arena = &arena;
+    // Ignore first three UTF8 BOM bytes of the whole source, like the reader.
+    std::string_view view = buffer->GetView();
+    if (offset == 0 && view.starts_with("\xEF\xBB\xBF"))
+        view.remove_prefix(3);
+    try {
+        return parser.ParseView(buffer, view);
+    }
+    catch (std::exception& e) {
+        // Parse it again from its position in the source, for the error to point to it.
+        std::string_view before = this->GetSource().substr(0, offset);
+        size_t lineStart = before.rfind('\n');
+        uint32_t line = std::count(before.begin(), before.end(), '\n');
+        uint32_t cursor = (lineStart == std::string_view::npos) ? offset : offset - lineStart - 1;
+        parser.ParseView(buffer, view, line, cursor);
+        throw;
+    }
+}
+
+void Document::SetRoot(Object& root) {
+    // Containers are moved with their memory resource, so the root then allocates
+    // in the arena of the object.
+    std::visit([this](auto& value) {
+        m_Root->m_Value.template emplace<std::decay_t<decltype(value)>>(std::move(value));
+    }, root.m_Value);
+    m_Root->m_Type = root.m_Type;
+    m_Root->m_Flags = root.m_Flags;
+    m_Root->m_ScalarType = root.m_ScalarType;
+    m_Root->m_Scale = root.m_Scale;
+    m_Root->m_Number = root.m_Number;
+}
+
+std::shared_ptr<Document> Parser::ParseDocumentFile(const std::string& filePath) {
+    // Initialize the reader with the file.
+    m_FilePath = filePath;
+    m_Reader.OpenFile(filePath);
+
+    m_PreviousOffset = 0;
+    m_LastBraceOffset = 0;
+    return this->ParseDocumentRoot();
+}
+
+std::shared_ptr<Document> Parser::ParseDocumentString(const std::string& content) {
+    // Initialize the reader with the string.
+    m_FilePath = "";
+    m_Reader.OpenString(content);
+
+    m_PreviousOffset = 0;
+    m_LastBraceOffset = 0;
+    return this->ParseDocumentRoot();
+}
+
+ParseResult Parser::ParseResultFile(const std::string& filePath) {
+    m_FilePath = filePath;
+    m_Reader.OpenFile(filePath);
+
+    m_PreviousOffset = 0;
+    m_LastBraceOffset = 0;
+    return this->ParseResultRoot();
+}
+
+ParseResult Parser::ParseResultString(const std::string& content) {
+    m_FilePath = "";
+    m_Reader.OpenString(content);
+
+    m_PreviousOffset = 0;
+    m_LastBraceOffset = 0;
+    return this->ParseResultRoot();
+}
+
+ParseResult Parser::ParseResultRoot() {
+    // The source is kept by the result to format the errors when they are asked for.
+    ParseResult result;
+    result.m_FilePath = m_FilePath;
+    result.m_Buffer = m_Reader.GetBuffer();
+
+    struct ErrorsGuard {
+        std::vector<ParseError>*& errors;
+        ~ErrorsGuard() { errors = nullptr; }
+    } errorsGuard{ m_Errors };
+    m_Errors = &result.m_Errors;
+    this->ResetSymbols();
+    result.m_Object = this->Parse();
+    result.m_Truncated = (result.m_Errors.size() >= m_MaxErrors && !m_Reader.IsEmpty());
+    return result;
+}
+
+void Parser::ParseEventsFile(const std::string& filePath, EventHandler& handler) {
+    m_FilePath = filePath;
+    m_Reader.OpenFile(filePath);
+
+    m_PreviousOffset = 0;
+    m_LastBraceOffset = 0;
+    this->ParseEvents(handler);
+}
+
+void Parser::ParseEventsString(const std::string& content, EventHandler& handler) {
+    m_FilePath = "";
+    m_Reader.OpenString(content);
+
+    m_PreviousOffset = 0;
+    m_LastBraceOffset = 0;
+    this->ParseEvents(handler);
+}
+
+void Parser::ParseEventsStream(std::istream& stream, EventHandler& handler, size_t windowSize) {
+    m_FilePath = "";
+    m_Reader.OpenStream(stream, windowSize);
+
+    m_PreviousOffset = 0;
+    m_LastBraceOffset = 0;
+    this->ParseEvents(handler);
+}
+
+std::shared_ptr<Document> Parser::ParseDocumentRoot() {
+    // Objects take a few times the size of their source, so start the arena with
+    // a block large enough to avoid most of the intermediate ones.
+    std::shared_ptr<Document> document = std::make_shared<Document>(std::max<size_t>(4096, m_Reader.GetView().size() * 4));
+    // Scalars are views of the source, which the document keeps alive.
+    document->m_Buffer = m_Reader.GetBuffer();
+    document->m_Arena->SetSource(document->GetSource());
+    m_Arena = document->m_Arena.get();
+    try {
+        document->SetRoot(*this->ParseRoot());
+    }
+    catch (std::exception& e) {
+        m_Arena = nullptr;
+        throw;
+    }
+    m_Arena = nullptr;
+    return document;
+}
+
+}
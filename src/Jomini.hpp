@@ -2,6 +2,7 @@
 
 #include <iostream>
 #include <vector>
+#include <array>
 #include <sstream>
 #include <memory>
 #include <map>
@@ -17,6 +18,16 @@
 #include <ranges>
 #include <cmath>
 #include <algorithm>
+#include <cstring>
+#include <atomic>
+#include <deque>
+#include <memory_resource>
+#include <mutex>
+#include <shared_mutex>
+#include <limits>
+#include <chrono>
+#include <charconv>
+#include <span>
 
 namespace Jomini {
 
@@ -31,12 +42,15 @@ namespace Jomini {
 
     class Object;
     class Parser;
+    class TapeDocument;
+    class Arena;
+    class Document;
 
     //////////////////////////////////////////////////////////
     //                  Jomini Object Types                 //
     //////////////////////////////////////////////////////////
     
-    enum class Type {
+    enum class Type : uint8_t {
         SCALAR,
         OBJECT,
         ARRAY,
@@ -62,7 +76,7 @@ namespace Jomini {
         { Operator::NOT_NULL, "?=" },
     };
 
-    enum class Flags {
+    enum class Flags : uint8_t {
         NONE  = 0,
         RGB   = 1 << 0,
         HSV   = 1 << 1,
@@ -71,6 +85,34 @@ namespace Jomini {
         MULTILINE = 1 << 4,
     };
     
+    // Kind of value of a scalar, found when the scalar is created. Integers and
+    // decimals have at most 9 digits, and the years of dates fit in 16 bits;
+    // longer scalars are strings, and are converted from their text.
+    enum class ScalarType : uint8_t {
+        STRING,
+        INT,
+        FLOAT,
+        DATE,
+        BOOL
+    };
+
+    // Reason a conversion failed, returned by the Try methods of objects instead of
+    // throwing an exception.
+    enum class ConversionError : uint8_t {
+        NONE,
+        MISSING,
+        INVALID_TYPE,
+        INVALID_FORMAT,
+        OUT_OF_RANGE,
+    };
+    const std::map<ConversionError, std::string> ConversionErrorsLabels = {
+        { ConversionError::NONE, "" },
+        { ConversionError::MISSING, "Missing object." },
+        { ConversionError::INVALID_TYPE, "Invalid object type." },
+        { ConversionError::INVALID_FORMAT, "Invalid format." },
+        { ConversionError::OUT_OF_RANGE, "Out of range." },
+    };
+
     Flags operator|(Flags a, Flags b);
     Flags operator&(Flags a, Flags b);
     Flags operator~(Flags a);
@@ -105,6 +147,7 @@ namespace Jomini {
 namespace sf {
     struct Color {
         uint8_t r, g, b, a;
+        Color() : r(0), g(0), b(0), a(255) {}
         Color(uint8_t r, uint8_t g, uint8_t b, uint8_t a = 255) : r(r), g(g), b(b), a(a) {}
         bool operator==(const sf::Color& o) const { return r == o.r && g == o.g && b == o.b && a == o.a; };
         operator std::string() const { return std::format("({}, {}, {}, {})", r, g, b, a); };
@@ -119,49 +162,165 @@ namespace Jomini {
     sf::Color ColorFromHsv(double h, double s, double v, double a = 1.0);
 
     //////////////////////////////////////////////////////////
-    //                 Ordered Object Map                   //
+    //                   Symbol Table                       //
     //////////////////////////////////////////////////////////
 
     struct StringHash {
-        using is_transparent = void; 
+        using is_transparent = void;
         size_t operator()(const std::string& s) const { return std::hash<std::string>{}(s); }
         size_t operator()(const char* c) const { return std::hash<std::string_view>{}(c); }
         size_t operator()(std::string_view sv) const { return std::hash<std::string_view>{}(sv); }
     };
 
+    // Key interned in a symbol table, which stores its name once and gives it a 32-bit
+    // id. Symbols keep the hash of their name, so maps look them up without hashing it,
+    // and compare the names only when the hashes match, by their address first. A symbol
+    // is only valid while its table is alive.
+    class Symbol {
+        public:
+            // Interns the name in a table shared by the whole program, which is never
+            // released. Use it for the keys known in advance, not for parsed ones.
+            explicit Symbol(std::string_view name);
+
+            uint32_t GetId() const;
+            uint32_t GetHash() const;
+            std::string_view GetName() const;
+
+            operator std::string_view() const;
+            bool operator==(const Symbol& other) const;
+            bool operator==(std::string_view other) const;
+            friend std::ostream& operator<<(std::ostream& os, const Symbol& symbol);
+
+        private:
+            friend class SymbolTable;
+            friend class ObjectMap;
+
+            Symbol(uint32_t id, uint32_t hash, std::string_view name);
+
+            uint32_t m_Id;
+            uint32_t m_Hash;
+            std::string_view m_Name;
+    };
+
+    // Interns the keys of the maps of one tree or document, which share the table and
+    // release it with their last map. Each parse creates its own table, so the names of
+    // a tree are released with it. Interning is not synchronized: the maps of a tree must
+    // not be modified by several threads at once, while lookups never use the table.
+    class SymbolTable {
+        public:
+            SymbolTable();
+            SymbolTable(const SymbolTable& other) = delete;
+            SymbolTable& operator=(const SymbolTable& other) = delete;
+
+            Symbol Intern(std::string_view name);
+            std::optional<Symbol> Find(std::string_view name) const;
+
+            // Returns true if the symbol was interned by this table.
+            bool Contains(Symbol symbol) const;
+
+            size_t GetSize() const;
+            size_t GetNamesSize() const;
+
+        private:
+            friend class ObjectMap;
+
+            Symbol Intern(std::string_view name, uint32_t hash);
+            // Returns the slot of a name, or the first empty slot after it if it is missing.
+            size_t FindSlot(std::string_view name, uint32_t hash) const;
+
+            // Index of the ids by the hash of their name, empty slots holding s_EmptySlot.
+            static constexpr uint32_t s_EmptySlot = std::numeric_limits<uint32_t>::max();
+            std::vector<uint32_t> m_Slots;
+            std::vector<Symbol> m_Symbols;
+            // Names are copied once in blocks which never move.
+            std::pmr::monotonic_buffer_resource m_Names;
+            size_t m_NamesSize;
+    };
+
+    //////////////////////////////////////////////////////////
+    //                 Ordered Object Map                   //
+    //////////////////////////////////////////////////////////
+
+    // The items and index of a map are allocated from its memory resource,
+    // which is the default one unless the map belongs to a Document. Keys are
+    // symbols of the table of the map. Items are stored in insertion order in
+    // a flat vector, indexed by an open-addressing table of the hashes of their
+    // names and their positions, so looking up a name never goes through the
+    // symbol table. Maps of up to s_SmallMapSize items have no index and are
+    // searched linearly, which is faster for the small objects most files are
+    // made of. Erased items of an
+    // indexed map are left as tombstones until they make up half of the
+    // vector, when it is compacted. Inserting may move the items, so
+    // references and iterators are only valid until the map is modified.
     class ObjectMap {
         public:
             using Value = std::pair<Operator, std::shared_ptr<Object>>;
-            using Item = std::pair<std::string, Value>;
-            using List = std::list<Item>;
-            using Iterator = typename List::iterator;
-            using ConstIterator = typename List::const_iterator;
-            using IndexMap = std::unordered_map<std::string, Iterator, StringHash, std::equal_to<>>;
+            using Item = std::pair<Symbol, Value>;
+
+            // Iterates the items in insertion order, skipping the erased ones.
+            template <typename T> class BasicIterator {
+                public:
+                    using iterator_category = std::forward_iterator_tag;
+                    using value_type = Item;
+                    using difference_type = std::ptrdiff_t;
+                    using pointer = T*;
+                    using reference = T&;
+
+                    BasicIterator();
+                    BasicIterator(T* item, T* end);
+                    operator BasicIterator<const Item>() const;
+
+                    reference operator*() const;
+                    pointer operator->() const;
+                    BasicIterator& operator++();
+                    BasicIterator operator++(int);
+                    bool operator==(const BasicIterator& other) const;
+                    bool operator!=(const BasicIterator& other) const;
+
+                private:
+                    T* m_Item;
+                    T* m_End;
+            };
+            using Iterator = BasicIterator<Item>;
+            using ConstIterator = BasicIterator<const Item>;
 
             // Initialized in the source file with (EQUAL, nullptr).
             static const Value s_DefaultValue;
 
             // Constructors
             ObjectMap();
+            explicit ObjectMap(std::pmr::memory_resource* resource, std::shared_ptr<SymbolTable> symbols = nullptr);
             ObjectMap(const std::unordered_map<std::string, Value>& entries);
             ObjectMap(const ObjectMap& other);
-            ObjectMap& operator=(ObjectMap other);
+            ObjectMap(ObjectMap&& other);
+            ObjectMap& operator=(const ObjectMap& other);
+            ObjectMap& operator=(ObjectMap&& other);
 
             // Modifiers
             void insert(const std::string& key, const Value& value);
             void insert(std::string_view key, const Value& value);
+            void insert(Symbol key, const Value& value);
             void insert_missing(std::string_view key, const Value& value);
-            template <typename K> void erase(const K& key);
+            void insert_missing(Symbol key, const Value& value);
+            void erase(std::string_view key);
+            void erase(Symbol key);
             void clear();
 
             // Lookups
-            template <typename K> Value& at(const K& key);
-            template <typename K> const Value& at(const K& key) const;
+            Value& at(std::string_view key);
+            Value& at(Symbol key);
+            const Value& at(std::string_view key) const;
+            const Value& at(Symbol key) const;
             Value& operator[](std::string_view key);
-            template <typename K> const Value& operator[](const K& key) const;
-            template <typename K> Iterator find(const K& key);
-            template <typename K> ConstIterator find(const K& key) const;
-            template <typename K> bool contains(const K& key) const;
+            Value& operator[](Symbol key);
+            const Value& operator[](std::string_view key) const;
+            const Value& operator[](Symbol key) const;
+            Iterator find(std::string_view key);
+            Iterator find(Symbol key);
+            ConstIterator find(std::string_view key) const;
+            ConstIterator find(Symbol key) const;
+            bool contains(std::string_view key) const;
+            bool contains(Symbol key) const;
 
             // Iterators
             Iterator begin();
@@ -177,16 +336,77 @@ namespace Jomini {
             bool empty() const;
             void reserve(size_t size);
 
+            std::pmr::memory_resource* resource() const;
+
+            // Table interning the keys of the map. Maps created by a parse share its table,
+            // copies share the table of the original, and maps of a document use the table
+            // of its arena. Other maps create their own when their first key is inserted.
+            SymbolTable& symbols();
+
         private:
-            List m_Items;
-            IndexMap m_Index;
+            // Slot of the index, whose position is one of the markers below when it is not used.
+            struct Slot {
+                uint32_t hash;
+                uint32_t position;
+            };
+            static constexpr uint32_t s_EmptySlot = std::numeric_limits<uint32_t>::max();
+            static constexpr uint32_t s_ErasedSlot = s_EmptySlot - 1;
+            static constexpr size_t s_MinIndexSize = 8;
+            static constexpr size_t s_SmallMapSize = 8;
+
+            // Symbol id of erased items, which the symbol table never gives out.
+            static constexpr uint32_t s_ErasedId = std::numeric_limits<uint32_t>::max();
+
+            // Return the position of a key, or the number of items if it is missing.
+            size_t find_position(std::string_view key) const;
+            size_t find_position(std::string_view key, uint32_t hash) const;
+            // Returns the slot of a key, or the size of the index if it is missing.
+            size_t find_slot(std::string_view key, uint32_t hash) const;
+            void insert_slot(uint32_t hash, uint32_t position);
+            void rebuild_index(size_t size);
+            void compact();
+
+            std::pmr::vector<Item> m_Items;
+            std::pmr::vector<Slot> m_Index;
+            std::shared_ptr<SymbolTable> m_Symbols;
+            uint32_t m_Erased;
+            uint32_t m_ErasedSlots;
     };
 
     //////////////////////////////////////////////////////////
     //                  Jomini Objects                      //
     //////////////////////////////////////////////////////////
 
-    using ObjectArray = std::vector<std::shared_ptr<Object>>;
+    using ObjectArray = std::pmr::vector<std::shared_ptr<Object>>;
+
+    // Scalar of a document which references its source instead of owning a copy.
+    // It is turned into a string of the same resource when it is modified.
+    struct ScalarView {
+        std::string_view view;
+        std::pmr::memory_resource* resource;
+    };
+
+    // Source of the blocks deferred by a lazy parse, shared by all of them.
+    struct LazySource;
+
+    // Block of a lazy parse which is only parsed when its content is first accessed.
+    // The view spans the key, operator and braces of the block, which are parsed again
+    // as a single entry; the type is guessed from its first tokens when it is recorded.
+    struct LazyBlock {
+        std::shared_ptr<LazySource> source;
+        std::string_view view;
+        int maxDepth;
+        Type type;
+    };
+
+    // Array of integers, decimals or dates stored inline, instead of as one object per
+    // element. Arrays are packed while parsing if all their elements are numbers of the
+    // same kind written without redundant zeros or sign, so that their text can be written
+    // back from the values. Integers and decimals are packed together as decimals.
+    struct PackedArray {
+        std::variant<std::pmr::vector<int>, std::pmr::vector<double>, std::pmr::vector<Date>> values;
+        std::pmr::vector<uint8_t> scales; // Number of decimals of each decimal, with the sign in the highest bit.
+    };
 
     class Object {
         public:
@@ -201,17 +421,23 @@ namespace Jomini {
             Object(const Date& scalar);
             Object(const sf::Color& scalar);
             template <typename T> Object(const std::vector<T>& array);
+            Object(const std::vector<std::shared_ptr<Object>>& array);
             Object(const ObjectMap& objects);
             Object(const ObjectArray& array);
-            Object(const std::variant<std::string, ObjectMap, ObjectArray>& value);
+            Object(const std::variant<std::pmr::string, ObjectMap, ObjectArray, ScalarView, LazyBlock, PackedArray>& value);
+            Object(Type type, std::pmr::memory_resource* resource);
             Object(const Object& object);
             Object(const std::shared_ptr<Object>& object);
             ~Object();
 
             Type GetType() const;
             bool Is(Type type) const;
+            ScalarType GetScalarType() const;
             std::shared_ptr<Object> Copy() const;
 
+            // Memory resource of the object's scalar, map or array.
+            std::pmr::memory_resource* GetResource() const;
+
             Flags GetFlags() const;
             bool HasFlag(Flags flag) const;
             void SetFlags(Flags flags);
@@ -228,10 +454,30 @@ namespace Jomini {
             template <typename T> std::optional<std::vector<T>> AsArrayOpt() const;
             template <typename T> std::vector<T> AsArray(const std::vector<T>& defaultValue) const;
 
+            // Conversions which never throw. The value is only assigned if the conversion
+            // succeeds, in which case ConversionError::NONE is returned.
+            template <typename T> ConversionError TryAs(T& value) const;
+            template <typename T> ConversionError TryAsArray(std::vector<T>& values) const;
+
+            // Elements of a packed array of integers, decimals or dates, read without boxing
+            // them into objects. Returns an empty optional if the array is not packed as T.
+            bool IsPacked() const;
+            template <typename T> std::optional<std::span<const T>> GetPacked() const;
+
             bool Contains(std::string_view key) const;
             std::shared_ptr<Object> Get(std::string_view key);
 			std::shared_ptr<Object> GetFirst(std::string_view key); // Returns the first object if it is an array, otherwise returns the object itself.
             Operator GetOperator(std::string_view key);
+
+            // Lookups with a key resolved once as a Symbol, which skip hashing the name.
+            bool Contains(Symbol key) const;
+            std::shared_ptr<Object> Get(Symbol key);
+            std::shared_ptr<Object> GetFirst(Symbol key);
+            Operator GetOperator(Symbol key);
+
+            // Returns nullptr if the key is missing or if the object is not a map, instead of throwing.
+            std::shared_ptr<Object> TryGet(std::string_view key);
+            std::shared_ptr<Object> TryGet(Symbol key);
             
             template <typename T> void Set(T value);
 
@@ -275,7 +521,8 @@ namespace Jomini {
              */
             std::shared_ptr<Object> Flatten(bool ignoreDuplicate) const;
 
-            std::string& GetString();
+            std::string_view GetScalar() const;
+            std::pmr::string& GetString();
             ObjectMap& GetMap();
             ObjectArray& GetArray();
             
@@ -286,15 +533,361 @@ namespace Jomini {
             std::string SerializeScalar(uint32_t depth) const;
             std::string SerializeObject(uint32_t depth, bool isRoot, bool isInline) const;
             std::string SerializeArray(uint32_t depth) const;
-            std::string SerializeArrayRange(const std::string& key, Operator op, uint32_t depth = 0) const;
-            std::string SerializeArrayMultiline(const std::string& key, Operator op, uint32_t depth = 0) const;
+            std::string SerializeArrayRange(std::string_view key, Operator op, uint32_t depth = 0) const;
+            std::string SerializeArrayMultiline(std::string_view key, Operator op, uint32_t depth = 0) const;
 
         private:
-            std::variant<std::string, ObjectMap, ObjectArray> m_Value;
+            friend class Arena;
+            friend class Document;
+            friend class Parser;
+
+            template <typename T> std::shared_ptr<Object> CreateChild(T value) const;
+            std::shared_ptr<Object> AdoptChild(const std::shared_ptr<Object>& value) const;
+
+            // Copies the tree with the keys of its maps interned in one table, which
+            // is created by the first map copied.
+            std::shared_ptr<Object> Copy(std::shared_ptr<SymbolTable>& symbols) const;
+
+            // Parses the object if it is a lazy block, before its map or array is read, and boxes
+            // the elements of a packed array unless unpack is false. Lazy and packed objects are
+            // therefore modified by const methods, and must not be shared between threads until
+            // they have been accessed.
+            void Materialize(bool unpack = true) const;
+
+            // Appends a scalar to a packed array, which is created if the object is an empty
+            // array, or an empty map converted to an array. Returns false if the scalar cannot
+            // be packed with the other elements, in which case the object is left unchanged.
+            bool PushPacked(std::string_view scalar, bool convertToArray);
+
+            // Decodes the scalar into m_Number, which is read by the conversions instead of the text.
+            void ClassifyScalar();
+
+            std::variant<std::pmr::string, ObjectMap, ObjectArray, ScalarView, LazyBlock, PackedArray> m_Value;
             Type m_Type;
             Flags m_Flags;
+            ScalarType m_ScalarType;
+            uint8_t m_Scale; // Number of decimals of a float, with the sign in the highest bit.
+            int32_t m_Number;
     };
     
+    //////////////////////////////////////////////////////////
+    //                      Buffer                          //
+    //////////////////////////////////////////////////////////
+
+    // Owns the raw bytes of a parsed source, either as a heap string or as a
+    // read-only memory mapping of the file. It is shared between the reader and
+    // anything that keeps views into the source, so that the mapping stays alive
+    // for as long as one of them does.
+    class Buffer {
+        public:
+            Buffer();
+            Buffer(std::string content);
+            Buffer(const Buffer& other) = delete;
+            Buffer& operator=(const Buffer& other) = delete;
+            ~Buffer();
+
+            bool MapFile(const std::string& filePath);
+            bool ReadFile(const std::string& filePath);
+
+            bool IsMapped() const;
+            std::string_view GetView() const;
+
+        private:
+            void Unmap();
+
+            std::string m_Storage;
+            char* m_Mapping;
+            size_t m_MappingSize;
+    };
+
+    //////////////////////////////////////////////////////////
+    //                      Scanner                         //
+    //////////////////////////////////////////////////////////
+
+    // Returns the first blank, operator, brace or comment character in [begin, end),
+    // or end if there is none. The implementation (AVX2, SSE2 or scalar) is
+    // chosen once at runtime depending on the CPU.
+    const char* ScanDelimiter(const char* begin, const char* end);
+
+    // Returns the first occurrence of c in [begin, end), or end if there is none.
+    const char* ScanChar(const char* begin, const char* end, char c);
+
+    // Returns the name of the implementation used by ScanDelimiter.
+    std::string_view GetScannerName();
+
+    //////////////////////////////////////////////////////////
+    //                       Lexer                          //
+    //////////////////////////////////////////////////////////
+
+    enum class TokenType {
+        END,
+        SCALAR,
+        STRING,
+        OPERATOR,
+        OPEN_BRACE,
+        CLOSE_BRACE,
+        FLAG,
+        COMMENT,
+        INVALID,
+    };
+
+    // Token of the input, viewing its text. The operator and the flag are only set
+    // for OPERATOR and FLAG tokens.
+    struct Token {
+        TokenType type;
+        std::string_view text;
+        size_t offset;
+        Operator op;
+        Flags flag;
+    };
+
+    // Splits an input into the tokens read by the parser, one at a time and without
+    // allocating. Quoted strings run to the next quote and comments to the end of the
+    // line. Flag keywords are only FLAG tokens after an operator or another flag, where
+    // the parser reads them as flags. A '!' or '?' without '=' and an unterminated
+    // quoted string are INVALID tokens. The input must outlive the lexer.
+    class Lexer {
+        public:
+            Lexer(std::string_view input);
+
+            // Returns the next token, or an END token once the input is read.
+            Token Next();
+
+            std::string_view GetInput() const;
+            size_t GetOffset() const;
+
+        private:
+            std::string_view m_Input;
+            size_t m_Offset;
+            bool m_AfterOperator;
+    };
+
+    //////////////////////////////////////////////////////////
+    //                  Structural Index                    //
+    //////////////////////////////////////////////////////////
+
+    // Positions of every structural character (operators and braces) and of the
+    // first character of every scalar or quoted string, in order, ignoring
+    // comments and the contents of quoted strings. It is built 64 bytes at a time
+    // from bitmasks, and lets a parser walk the tokens without reading characters.
+    class StructuralIndex {
+        public:
+            StructuralIndex();
+
+            bool Build(std::string_view view);
+
+            std::string_view GetView() const;
+            const std::vector<uint32_t>& GetPositions() const;
+
+            // Returns the token starting at the given position.
+            std::string_view GetToken(uint32_t position) const;
+
+        private:
+            std::string_view m_View;
+            std::vector<uint32_t> m_Positions;
+    };
+
+    //////////////////////////////////////////////////////////
+    //                   Tape Document                      //
+    //////////////////////////////////////////////////////////
+
+    // Read-only handle on a node of a TapeDocument, mirroring the lookups of Object.
+    // Cursors are plain values and are only valid while their document is alive.
+    class TapeCursor {
+        public:
+            class Iterator {
+                public:
+                    Iterator(const TapeDocument* document, uint32_t node);
+
+                    TapeCursor operator*() const;
+                    Iterator& operator++();
+                    bool operator==(const Iterator& other) const;
+                    bool operator!=(const Iterator& other) const;
+
+                private:
+                    const TapeDocument* m_Document;
+                    uint32_t m_Node;
+            };
+
+            TapeCursor();
+            TapeCursor(const TapeDocument* document, uint32_t node);
+
+            Type GetType() const;
+            bool Is(Type type) const;
+            Flags GetFlags() const;
+            bool HasFlag(Flags flag) const;
+
+            // Key and operator of the entry when the cursor was obtained by iterating over an object.
+            std::string_view GetKey() const;
+            Operator GetOperator() const;
+            std::string_view GetScalar() const;
+            size_t GetSize() const;
+
+            template <typename T> T As() const;
+            template <typename T> std::optional<T> AsOpt() const;
+            template <typename T> T As(const T& defaultValue) const;
+            template <typename T> std::vector<T> AsArray() const;
+
+            bool Contains(std::string_view key) const;
+            TapeCursor Get(std::string_view key) const;
+            TapeCursor GetFirst(std::string_view key) const; // Returns the first object if it is an array, otherwise returns the object itself.
+            Operator GetOperator(std::string_view key) const;
+            TapeCursor At(size_t index) const;
+
+            // Iterates over the entries of an object or the values of an array.
+            Iterator begin() const;
+            Iterator end() const;
+
+            // Deep-copies the node into a regular object tree.
+            std::shared_ptr<Object> ToObject() const;
+
+        private:
+            uint32_t Find(std::string_view key) const;
+            std::shared_ptr<Object> ToObject(const std::shared_ptr<SymbolTable>& symbols) const;
+
+            const TapeDocument* m_Document;
+            uint32_t m_Node;
+    };
+
+    // Immutable parsed document stored as one contiguous array of fixed-size nodes.
+    // The children of an object or an array are stored next to each other, scalars
+    // and keys are views into the source buffer, and duplicate keys are merged like
+    // in an Object tree. It is built by Parser::ParseTapeFile and ParseTapeString.
+    class TapeDocument {
+        public:
+            struct Node {
+                std::string_view key;
+                std::string_view scalar;
+                uint32_t first;
+                uint32_t count;
+                uint32_t sorted;
+                Type type;
+                Operator op;
+                Flags flags;
+            };
+
+            // Objects with more entries than this are looked up through a sorted index.
+            static const uint32_t s_LinearLookupLimit;
+
+            TapeDocument(std::shared_ptr<Buffer> buffer);
+
+            TapeCursor GetRoot() const;
+            const std::vector<Node>& GetNodes() const;
+
+        private:
+            friend class TapeCursor;
+            friend class TapeBuilder;
+
+            std::shared_ptr<Buffer> m_Buffer;
+            std::vector<Node> m_Nodes;
+            std::vector<uint32_t> m_Sorted;
+            std::deque<std::string> m_Strings;
+            uint32_t m_Root;
+    };
+
+    //////////////////////////////////////////////////////////
+    //                      Document                        //
+    //////////////////////////////////////////////////////////
+
+    // Monotonic memory resource holding the objects of a Document. Objects are
+    // created in place and referenced by non-owning shared pointers, so passing
+    // them around never touches a reference count, and they are never destroyed
+    // one by one: their memory is released all at once with the arena.
+    class Arena final : public std::pmr::monotonic_buffer_resource {
+        public:
+            // The maps of the arena intern their keys in the symbol table, which is
+            // shared with the other arenas of a document, or created otherwise.
+            Arena(size_t initialSize = 4096, std::shared_ptr<SymbolTable> symbols = nullptr);
+            Arena(const Arena& other) = delete;
+            Arena& operator=(const Arena& other) = delete;
+
+            std::shared_ptr<Object> Create(Type type);
+            std::shared_ptr<Object> CreateScalar(std::string_view scalar);
+
+            // Deep-copies an object into the arena.
+            std::shared_ptr<Object> Adopt(const Object& object);
+
+            // Scalars viewing the source are referenced instead of copied.
+            void SetSource(std::string_view source);
+            bool IsInSource(std::string_view view) const;
+
+            // Keeps an object created outside of the arena alive for as long as
+            // the arena, and returns a non-owning pointer to it.
+            std::shared_ptr<Object> Retain(const std::shared_ptr<Object>& object);
+
+            size_t GetAllocatedSize() const;
+            const std::shared_ptr<SymbolTable>& GetSymbols() const;
+
+        protected:
+            void* do_allocate(size_t bytes, size_t alignment) override;
+
+        private:
+            std::shared_ptr<SymbolTable> m_Symbols;
+            std::vector<std::shared_ptr<Object>> m_Retained;
+            std::string_view m_Source;
+            size_t m_AllocatedSize;
+    };
+
+    // Parsed tree whose objects, map entries and arrays all live in one arena.
+    // Parsing does not allocate objects one by one and destroying the document
+    // does not visit them. Objects taken from the document are only valid while
+    // it is alive, except for the root which keeps it alive; use Object::Copy to
+    // detach a subtree. Objects added to it are copied or retained by the arena.
+    // Scalars reference the source of the document, which it keeps mapped,
+    // and are only copied when they are modified.
+    class Document : public std::enable_shared_from_this<Document> {
+        public:
+            Document(size_t initialSize = 4096);
+            Document(const Document& other) = delete;
+            Document& operator=(const Document& other) = delete;
+
+            std::shared_ptr<Object> GetRoot();
+            Arena& GetArena();
+            std::string_view GetSource() const;
+
+            // Bytes allocated by the arena of the document and by those of its edited blocks.
+            size_t GetAllocatedSize() const;
+
+            // Replaces removedLength bytes of the source at the offset with the text, and parses
+            // again only the innermost block containing the edit which is reached from the root
+            // by a path of unique keys. Its entry keeps its place in the map of its parent. Returns
+            // the new value of the block, or the root when the whole source is parsed again. If the
+            // edited source is invalid, the error is thrown and the document is left unchanged.
+            // Each edited block is parsed in an arena of its own, which is released with the objects
+            // of the block when it is replaced again, and the whole source is parsed in a new arena
+            // replacing the previous one: objects taken from the replaced tree are invalidated,
+            // except for the root which is updated in place.
+            std::shared_ptr<Object> ApplyEdit(size_t offset, size_t removedLength, std::string_view text);
+
+        private:
+            friend class Parser;
+
+            // Offsets of the key and braces of a block which is the value of a key, in the
+            // root or in another such block, and the arena of its objects once it is edited.
+            struct BlockSpan {
+                size_t key;
+                size_t open;
+                size_t close;
+                std::shared_ptr<Arena> arena;
+            };
+
+            static void FindBlockSpans(std::string_view source, size_t offset, std::vector<BlockSpan>& spans);
+            std::shared_ptr<Object> ParseEdited(std::shared_ptr<Buffer> buffer, size_t offset, Arena& arena);
+
+            // Moves the value of the object into the root, which is not allocated in the arena
+            // so that the pointers to it stay valid when the arena is replaced.
+            void SetRoot(Object& root);
+
+            std::shared_ptr<Buffer> m_Buffer;
+            std::unique_ptr<Arena> m_Arena;
+            std::shared_ptr<Object> m_Root;
+            // Source once edited, and the spans of its blocks ordered by offset, which are
+            // found by the first edit.
+            std::string m_Text;
+            bool m_Edited;
+            std::vector<BlockSpan> m_Spans;
+    };
+
     //////////////////////////////////////////////////////////
     //                      Reader                          //
     //////////////////////////////////////////////////////////
@@ -305,10 +898,24 @@ namespace Jomini {
             Reader(std::string filePath);
             ~Reader();
 
+            // Default size of the refill window used by streaming readers.
+            static const size_t s_DefaultWindowSize;
+
             void OpenFile(std::string filePath);
             void OpenString(std::string content);
+            void OpenBuffer(std::shared_ptr<Buffer> buffer);
+            // Reads only a part of the buffer, which must be a view of its content. Positions
+            // are those in the whole buffer, which starts at the given line and column.
+            void OpenBuffer(std::shared_ptr<Buffer> buffer, std::string_view view, uint32_t line = 0, uint32_t cursor = 0);
             void Open(std::istream& stream);
 
+            // Streaming readers only keep a fixed-size window of the input in memory
+            // and refill it on demand, so they work on pipes and inputs of any size.
+            // Views returned by ReadUntil are only valid until the next read.
+            void OpenStream(std::istream& stream, size_t windowSize = s_DefaultWindowSize);
+            void OpenDescriptor(int fd, size_t windowSize = s_DefaultWindowSize);
+            bool IsStreaming() const;
+
             bool IsEmpty();
             char Read();
             char Peek();
@@ -317,21 +924,64 @@ namespace Jomini {
             std::string_view ReadUntil(const std::function<bool(char)>& predicate, bool includePrevious = false, bool includeLast = false);
             void SkipUntil(const std::function<bool(char)>& predicate);
 
+            // Vectorized versions of ReadUntil and SkipUntil, stopping at the next
+            // delimiter (blank, operator, brace or comment) or the next given character.
+            std::string_view ReadUntilDelimiter(bool includePrevious = false);
+            std::string_view ReadUntilChar(char c, bool includePrevious = false, bool includeLast = false);
+            void SkipUntilChar(char c);
+            // Skips to the next occurrence of any of the characters.
+            void SkipUntilAny(std::string_view characters);
+            // Moves to an offset of the view further in the input, counting the lines skipped.
+            // Only for readers which are not streaming.
+            void SkipTo(size_t offset);
+
+            // Line and column of an offset of the source, both counted from 0.
+            struct Position {
+                uint32_t line;
+                uint32_t cursor;
+            };
+
+            std::shared_ptr<Buffer> GetBuffer() const;
             std::string_view GetView() const;
             std::string_view GetLine(uint32_t line) const;
 
+            // Only the offset is kept while reading. Lines and columns are found from an
+            // index of the line starts, built on the first query, so they are only paid
+            // for by diagnostics. When streaming, positions dropped from the window are
+            // only known on the line it starts with.
             uint32_t GetCurrentLine() const;
             uint32_t GetCurrentCursor() const;
+            Position GetPosition(uint64_t sourceOffset) const;
+            // Offset in the view, and in the whole source.
+            size_t GetOffset() const;
+            uint64_t GetSourceOffset() const;
 
         private:
-            void IncrementLine();
+            template <typename Finder> std::string_view ReadUntilImpl(const Finder& find, bool includePrevious, bool includeLast);
+            template <typename Finder> void SkipUntilImpl(const Finder& find);
 
-            std::string m_Buffer;
+            void OpenWindow(std::function<size_t(char*, size_t)> source, size_t windowSize);
+            bool Refill(size_t keepFrom);
+            void IndexLines(size_t offset) const;
+
+            std::shared_ptr<Buffer> m_Buffer;
             std::string_view m_View;
 
-            uint32_t m_CurrentLine;
-            uint32_t m_CurrentCursor;
-            uint32_t m_CurrentGlobalCursor;
+            std::function<size_t(char*, size_t)> m_Source;
+            std::string m_Window;
+            bool m_EndOfStream;
+
+            // Text whose lines are indexed, that is the buffer or the window, with its offset
+            // in the source and the position of its first character.
+            std::string_view m_Origin;
+            uint64_t m_OriginOffset;
+            uint32_t m_OriginLine;
+            uint32_t m_OriginCursor;
+            // Offsets in the origin of the lines after the first, up to the indexed size.
+            mutable std::vector<size_t> m_LineStarts;
+            mutable size_t m_IndexedSize;
+
+            size_t m_CurrentGlobalCursor;
 
     };
 
@@ -342,25 +992,297 @@ namespace Jomini {
 
     #define THROW_ERROR(error, cursorError, cursorOffset) this->ThrowError(error, cursorError, cursorOffset, __FILE__, __LINE__);
 
+    // Parsing engines producing the same objects from the same grammar.
+    //  - STATE_MACHINE reads the input one character at a time.
+    //  - STRUCTURAL_INDEX first indexes every token with bitmasks, then walks the index.
+    enum class Engine {
+        STATE_MACHINE,
+        STRUCTURAL_INDEX,
+    };
+
+    void SetDefaultEngine(Engine engine);
+    Engine GetDefaultEngine();
+
+    // Returned by the callbacks of an EventHandler to go on or to skip what they announce.
+    enum class EventAction {
+        CONTINUE,
+        SKIP,
+    };
+
+    // Receives the content of an input from Parser::ParseEvents* in source order, without
+    // any object being built. Keys and scalars are views only valid during the call. Unlike
+    // objects, duplicate keys are not merged and blocks are reported as written: flags come
+    // before the block they apply to and RANGE blocks are not expanded, but empty blocks
+    // after LIST or RANGE are reported as arrays. The root object has no begin and end.
+    class EventHandler {
+        public:
+            virtual ~EventHandler() = default;
+
+            // Skipping a key skips its value, and any block it opens.
+            virtual EventAction OnKey(std::string_view key, Operator op);
+            virtual void OnScalar(std::string_view scalar);
+            virtual void OnFlag(Flags flag);
+
+            // Blocks are announced once their type is known, that is after the first key
+            // or the first two values. Skipping a block fast-forwards to its closing brace,
+            // and its end is not reported.
+            virtual EventAction OnObjectBegin();
+            virtual void OnObjectEnd();
+            virtual EventAction OnArrayBegin();
+            virtual void OnArrayEnd();
+    };
+
+    // Files parsed by Parser::ParseDirectory, and the errors of those which could not be, by path.
+    struct DirectoryResult {
+        std::map<std::string, std::shared_ptr<Object>> objects;
+        std::map<std::string, std::string> errors;
+    };
+
+    // Syntax error recorded by a parser which recovers from errors. Only its offsets in the
+    // source are kept, and its message is formatted by ParseResult::FormatError.
+    struct ParseError {
+        std::string error;
+        std::string cursorError;
+        int cursorOffset;
+        uint64_t offset;
+        uint64_t lastBraceOffset;
+        std::string sourceFile;
+        int sourceFileLine;
+    };
+
+    // Object built by Parser::ParseResultFile or ParseResultString, and the errors found in
+    // its source. Entries with an error are left out of the object.
+    class ParseResult {
+        public:
+            ParseResult();
+
+            std::shared_ptr<Object> GetObject() const;
+            const std::vector<ParseError>& GetErrors() const;
+            bool HasErrors() const;
+            // True if parsing stopped at the maximum number of errors.
+            bool IsTruncated() const;
+
+            // Line and column of an error, and its message with the lines around it, the same
+            // as if the parser had raised it. The lines of the source are only indexed by the
+            // first call.
+            Reader::Position GetPosition(size_t index) const;
+            std::string FormatError(size_t index) const;
+
+        private:
+            friend class Parser;
+
+            const Reader& GetReader() const;
+
+            std::shared_ptr<Object> m_Object;
+            std::vector<ParseError> m_Errors;
+            bool m_Truncated;
+            std::string m_FilePath;
+            std::shared_ptr<Buffer> m_Buffer;
+            mutable std::shared_ptr<Reader> m_Reader;
+    };
+
+    // Blocks are parsed with an explicit stack of frames instead of recursion,
+    // so the nesting of the input is bounded by the maximum depth and not by
+    // the size of the call stack. Objects are still copied, serialized and
+    // destroyed recursively, which the maximum depth keeps within the stack.
     class Parser {
         public:
+            static const int s_DefaultMaxDepth;
+
             Parser();
 
+            void SetEngine(Engine engine);
+            Engine GetEngine() const;
+            void SetMaxDepth(int maxDepth);
+            int GetMaxDepth() const;
+
+            // In lazy mode, the blocks which are the value of a key are only brace-matched,
+            // and parsed when their content is first accessed, as long as the source stays
+            // mapped by them. Their type is known at once, but errors inside them are raised
+            // on that first access. Streams, documents and blocks after a flag are parsed
+            // as usual, and lazy parses always use the state machine.
+            void SetLazy(bool lazy);
+            bool IsLazy() const;
+
+            // Builds only the entries whose path of keys matches one of the patterns, and the
+            // blocks leading to them, skipping the others at brace-matching speed. Segments are
+            // separated by '/' and may use '*' and '?' wildcards, and a '**' segment matches any
+            // number of keys, e.g. "c_*/*/holder" or "k_disputed_lands/**". Elements of arrays
+            // have the path of their array, and blocks left empty by the projection are removed.
+            // Skipped entries are not checked for errors beyond their braces. Projected parses
+            // use the state machine, and an empty list of patterns builds everything.
+            void SetProjection(const std::vector<std::string>& patterns);
+
+            // Maximum number of errors recorded by ParseResultFile and ParseResultString,
+            // after which they stop parsing.
+            static const size_t s_DefaultMaxErrors;
+            void SetMaxErrors(size_t maxErrors);
+            size_t GetMaxErrors() const;
+
             void ThrowError(const std::string& error, const std::string& cursorError, int cursorOffset, std::string sourceFile, int sourceFileLine);
 
             std::shared_ptr<Object> ParseFile(const std::string& filePath);
             std::shared_ptr<Object> ParseString(const std::string& content);
+            std::shared_ptr<Object> ParseStream(std::istream& stream, size_t windowSize = Reader::s_DefaultWindowSize);
+            std::shared_ptr<Object> ParseDescriptor(int fd, size_t windowSize = Reader::s_DefaultWindowSize);
+            // Parses a source already in memory, reporting errors with the given path.
+            std::shared_ptr<Object> ParseBuffer(std::shared_ptr<Buffer> buffer, const std::string& filePath = "");
+
+            // Splits the file at its top-level entries and parses groups of them on
+            // several threads (the number of cores by default), then merges them into
+            // the root in source order, exactly as ParseFile would. Inputs which cannot
+            // be split, including invalid ones, are parsed by ParseFile instead.
+            std::shared_ptr<Object> ParseFileParallel(const std::string& filePath, unsigned int threads = 0);
+
+            // Parses every file of the directory tree whose name matches the pattern ('*'
+            // and '?' wildcards, or a path relative to the directory if it contains '/',
+            // where '**' also matches separators) on several threads, largest files first.
+            // Errors are collected by file instead of interrupting the others.
+            DirectoryResult ParseDirectory(const std::string& directoryPath, const std::string& pattern = "*.txt", unsigned int threads = 0);
+
+            std::shared_ptr<TapeDocument> ParseTapeFile(const std::string& filePath);
+            std::shared_ptr<TapeDocument> ParseTapeString(const std::string& content);
+
+            std::shared_ptr<Document> ParseDocumentFile(const std::string& filePath);
+            std::shared_ptr<Document> ParseDocumentString(const std::string& content);
+
+            // Parse with the state machine without raising syntax errors. Each error is recorded,
+            // the entry where it was found is left out, and parsing resumes at the next line or
+            // brace. Blocks are never lazy, and those left open at the end are closed.
+            ParseResult ParseResultFile(const std::string& filePath);
+            ParseResult ParseResultString(const std::string& content);
+
+            // Reads the input with the state machine and reports it to the handler instead of
+            // building objects. Errors are the same as when parsing, raised once they are read.
+            void ParseEventsFile(const std::string& filePath, EventHandler& handler);
+            void ParseEventsString(const std::string& content, EventHandler& handler);
+            void ParseEventsStream(std::istream& stream, EventHandler& handler, size_t windowSize = Reader::s_DefaultWindowSize);
 
         private:
-            std::shared_ptr<Object> Parse(int depth);
+            friend class Object;
+            friend class Document;
+
+            std::shared_ptr<Document> ParseDocumentRoot();
+            ParseResult ParseResultRoot();
+            std::shared_ptr<Object> CreateObject(Type type);
+            std::shared_ptr<Object> CreateScalar(std::string_view scalar);
+            // Pushes a scalar to an array, packed with the other elements when possible.
+            void PushScalar(const std::shared_ptr<Object>& array, std::string_view scalar, bool convertToArray = false);
 
+            // Each tree gets a symbol table of its own, released with its maps.
+            void ResetSymbols();
+            std::shared_ptr<Object> ParseRoot();
+            std::shared_ptr<Object> ParseView(std::shared_ptr<Buffer> buffer, std::string_view view, uint32_t line = 0, uint32_t cursor = 0);
+            std::shared_ptr<TapeDocument> ParseTapeRoot();
+            std::shared_ptr<Object> Parse();
+            std::string_view ReadToken(char first);
+            void ParseEvents(EventHandler& handler);
+            void SkipBlock(int depth);
+            std::shared_ptr<Object> CreateLazyBlock(std::string_view key, int depth);
+            std::shared_ptr<Object> ParseLazyBlock(const LazyBlock& block);
+            int CreateProjectionState(std::vector<std::pair<size_t, size_t>>& positions);
+            int ProjectKey(int projection, std::string_view key);
+
+            std::shared_ptr<Object> ParseIndexed();
+            std::shared_ptr<Object> ParseIndexedBlock(const StructuralIndex& index, size_t& token, int depth);
+
+            // State of a block whose parsing resumes once the block it opened is closed.
+            struct Frame {
+                std::shared_ptr<Object> object;
+                std::string_view key;
+                std::string keyStorage;
+                Operator op;
+                Flags flags;
+                int state;
+                uint64_t lastBrace;
+                int projection;
+            };
+
+            // Raised by ThrowError once the error is recorded, when recovering from errors.
+            struct RecoveredError {};
+
+            Engine m_Engine;
+            int m_MaxDepth;
+            size_t m_MaxErrors;
+            // Errors of the parse which recovers from them, or nullptr.
+            std::vector<ParseError>* m_Errors;
+            bool m_Lazy;
+            int m_LazyDepth;
+            std::shared_ptr<LazySource> m_LazySource;
+            // Segments of the projection patterns, and the positions reached in them by the
+            // blocks being built whose path matched part of a pattern.
+            std::vector<std::vector<std::string>> m_Projection;
+            std::vector<std::vector<std::pair<size_t, size_t>>> m_ProjectionStates;
+            std::vector<std::pair<size_t, size_t>> m_ProjectionPositions;
+            std::vector<Frame> m_Frames;
+            Arena* m_Arena;
+            // Table of the maps of the tree being parsed, unless it belongs to an arena.
+            std::shared_ptr<SymbolTable> m_Symbols;
             std::string m_FilePath;
             Reader m_Reader;
-            int m_PreviousLine;
-            int m_PreviousCursor;
-            int m_LastBraceLine;
+            // Source offsets of the last token read, and of the last opening brace.
+            uint64_t m_PreviousOffset;
+            uint64_t m_LastBraceOffset;
     };
 
     std::shared_ptr<Object> ParseFile(const std::string& filePath);
     std::shared_ptr<Object> ParseString(const std::string& content);
+    std::shared_ptr<Object> ParseStream(std::istream& stream);
+    std::shared_ptr<Object> ParseFileParallel(const std::string& filePath, unsigned int threads = 0);
+    std::shared_ptr<Object> ParseLazyFile(const std::string& filePath);
+    std::shared_ptr<Object> ParseProjectedFile(const std::string& filePath, const std::vector<std::string>& patterns);
+    DirectoryResult ParseDirectory(const std::string& directoryPath, const std::string& pattern = "*.txt", unsigned int threads = 0);
+
+    std::shared_ptr<TapeDocument> ParseTapeFile(const std::string& filePath);
+    std::shared_ptr<TapeDocument> ParseTapeString(const std::string& content);
+
+    std::shared_ptr<Document> ParseDocumentFile(const std::string& filePath);
+    std::shared_ptr<Document> ParseDocumentString(const std::string& content);
+
+    ParseResult ParseResultFile(const std::string& filePath);
+    ParseResult ParseResultString(const std::string& content);
+
+    void ParseEventsFile(const std::string& filePath, EventHandler& handler);
+    void ParseEventsString(const std::string& content, EventHandler& handler);
+
+    //////////////////////////////////////////////////////////
+    //                      Loader                          //
+    //////////////////////////////////////////////////////////
+
+    // Statistics of the last load, to tune the number of threads and the buffer budget.
+    struct LoaderStats {
+        size_t files;
+        size_t bytesRead;
+        // Buffers read and waiting for a parser thread, at most and on average when one is taken.
+        size_t maxQueueDepth;
+        double averageQueueDepth;
+        // Bytes reserved by reader threads and not yet parsed.
+        size_t maxBytesInFlight;
+        // Time spent by reader threads waiting for the budget, and by parser threads waiting for buffers.
+        std::chrono::duration<double, std::milli> readStall;
+        std::chrono::duration<double, std::milli> parseStall;
+    };
+
+    // Loads many files with their reads and parsing overlapped: reader threads read
+    // the files into buffers, largest first, and queue them for the parser threads.
+    // Reading pauses while the bytes read and not yet parsed would exceed the buffer
+    // budget, so memory stays bounded whatever the number of files; a file larger than
+    // the budget is read once nothing else is in flight. Errors are collected by file.
+    class Loader {
+        public:
+            static const size_t s_DefaultBufferBudget;
+
+            Loader(unsigned int readThreads = 2, unsigned int parseThreads = 0, size_t bufferBudget = s_DefaultBufferBudget);
+
+            DirectoryResult Load(const std::vector<std::string>& filePaths);
+            DirectoryResult LoadDirectory(const std::string& directoryPath, const std::string& pattern = "*.txt");
+
+            const LoaderStats& GetStats() const;
+
+        private:
+            unsigned int m_ReadThreads;
+            unsigned int m_ParseThreads;
+            size_t m_BufferBudget;
+            LoaderStats m_Stats;
+    };
 }
\ No newline at end of file
@@ -2,10 +2,18 @@
 #include <chrono>
 #include <iomanip>
 #include <regex>
+#include <filesystem>
+#include <thread>
 
 #include "Jomini.hpp"
 using namespace Jomini;
 
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#endif
+
 // Dependencies for testing, debugging and benchmarking.
 #include "backward/signal_handler.hpp"
 SignalHandler signalHandler;
@@ -19,12 +27,70 @@ void ManualTests();
 // Function to measure reading and parsing speed.
 void Benchmark();
 
+// Function to measure the peak memory of streaming readers on growing inputs.
+void BenchmarkStreaming();
+
+// Function to measure lookups and parsing speed of objects of growing sizes.
+void BenchmarkMapSizes();
+
+// Function to measure parsing speed of flat and deeply nested inputs.
+void BenchmarkNesting();
+
+// Function to measure parsing speed of a large file on a growing number of threads.
+void BenchmarkParallel();
+
+// Function to measure loading a directory tree of many files serially, on several threads and pipelined.
+void BenchmarkDirectory();
+
+// Function to measure event parsing against building objects.
+void BenchmarkEvents();
+
+// Function to measure the latency from opening a file to its first query, with and without lazy parsing.
+void BenchmarkLazy();
+
+// Function to measure projected parsing of a small part of a large file against a full parse.
+void BenchmarkProjection();
+
+// Function to measure the latency of edits to a document against parsing it again.
+void BenchmarkEdits();
+
+// Function to measure conversions of the scalars of a file, from their decoded values and from their text.
+void BenchmarkConversions();
+
+// Function to measure conversions of missing and invalid values, with exceptions and with the non-throwing methods.
+void BenchmarkMisses();
+
+// Function to measure finding every error of an invalid file at once against raising the first one.
+void BenchmarkErrors();
+
+// Function to measure reading arrays of numbers packed inline against reading their boxed elements.
+void BenchmarkPackedArrays();
+
 int main(int argc, char** argv) {
+    // Run the tests and benchmarks with the structural index engine using '--engine=index'.
+    for (int i = 1; i < argc; i++) {
+        if (std::string_view(argv[i]) == "--engine=index")
+            SetDefaultEngine(Engine::STRUCTURAL_INDEX);
+    }
+
     doctest::Context context(argc, argv);
     context.run();
 
     // ManualTests();
     // Benchmark();
+    // BenchmarkStreaming();
+    // BenchmarkMapSizes();
+    // BenchmarkNesting();
+    // BenchmarkParallel();
+    // BenchmarkDirectory();
+    // BenchmarkEvents();
+    // BenchmarkLazy();
+    // BenchmarkProjection();
+    // BenchmarkEdits();
+    // BenchmarkConversions();
+    // BenchmarkMisses();
+    // BenchmarkErrors();
+    // BenchmarkPackedArrays();
 
     return 0;
 }
@@ -53,13 +119,15 @@ void Benchmark() {
         std::string filePath;
         std::chrono::duration<double, std::milli> duration;
         double entries;
+        double throughput;
     };
 
     const auto BenchmarkFile = [](const std::string& filePath, uint iterations) {
         BenchmarkResult result = {
             filePath,
             std::chrono::duration<double, std::milli>::zero(),
-            0 
+            0,
+            0
         };
 
         for (int i = 0; i < iterations; i++) {
@@ -73,6 +141,7 @@ void Benchmark() {
         result.filePath = filePath;
         result.duration /= iterations;
         result.entries /= iterations;
+        result.throughput = std::filesystem::file_size(filePath) / (result.duration.count() * 1000.0);
         return result;
     };
 
@@ -84,12 +153,711 @@ void Benchmark() {
     results.push_back(BenchmarkFile("tests/00_benchmark_1MB.txt", 5));
     results.push_back(BenchmarkFile("tests/00_tests.txt", 1));
 
-    std::cout << std::left << std::setw(30) << "file path" << std::right << std::setw(15) << "avg time" << std::setw(15) << "avg entries" << std::endl;
-    std::cout << "------------------------------------------------------------" << std::endl;
+    std::cout << "scanner: " << GetScannerName() << std::endl;
+    std::cout << "engine: " << (GetDefaultEngine() == Engine::STRUCTURAL_INDEX ? "structural index" : "state machine") << std::endl;
+    std::cout << std::left << std::setw(30) << "file path" << std::right << std::setw(15) << "avg time" << std::setw(15) << "avg entries" << std::setw(15) << "throughput" << std::endl;
+    std::cout << "---------------------------------------------------------------------------" << std::endl;
     
     for (auto result : results) {
-        std::cout << std::left << std::setw(30) << result.filePath << std::right << std::setw(15) << (std::to_string(result.duration.count()) + "ms") << std::setw(15) << result.entries << std::endl;
+        std::cout << std::left << std::setw(30) << result.filePath << std::right << std::setw(15) << (std::to_string(result.duration.count()) + "ms") << std::setw(15) << result.entries << std::setw(15) << (std::to_string((int) result.throughput) + "MB/s") << std::endl;
+    }
+}
+
+// Stream buffer over a string that cannot seek, like a pipe.
+class PipeStreamBuffer : public std::streambuf {
+    public:
+        PipeStreamBuffer(std::string content) : m_Content(std::move(content)) {
+            this->setg(m_Content.data(), m_Content.data(), m_Content.data() + m_Content.size());
+        }
+
+    private:
+        std::string m_Content;
+};
+
+// Stream buffer generating an input of any size by repeating a pattern,
+// without ever holding more than the pattern in memory.
+class RepeatStreamBuffer : public std::streambuf {
+    public:
+        RepeatStreamBuffer(std::string pattern, uint64_t size) : m_Pattern(std::move(pattern)), m_Remaining(size) {}
+
+    protected:
+        int_type underflow() override {
+            if (m_Remaining == 0)
+                return traits_type::eof();
+            size_t count = (size_t) std::min<uint64_t>(m_Pattern.size(), m_Remaining);
+            m_Remaining -= count;
+            this->setg(m_Pattern.data(), m_Pattern.data(), m_Pattern.data() + count);
+            return traits_type::to_int_type(*this->gptr());
+        }
+
+    private:
+        std::string m_Pattern;
+        uint64_t m_Remaining;
+};
+
+// Returns the message of the exception raised by a parse without its first line, which has
+// the line of the source that raised it. Only the location and message of the error are kept,
+// unless the context lines are requested too.
+std::string GetError(const std::function<void()>& parse, bool withContext = false) {
+    try {
+        parse();
+    }
+    catch (std::runtime_error& e) {
+        std::string message = e.what();
+        size_t start = message.find('\n') + 1;
+        if (withContext)
+            return message.substr(start - 1);
+        return message.substr(start, message.find('\n', start) - start);
+    }
+    return std::string();
+}
+
+void BenchmarkStreaming() {
+    // Count the tokens of the input with the reader only, so that the
+    // measured memory is the one of the reader and not of a parsed tree.
+    const auto CountTokens = [](Reader& reader) {
+        const auto isBlank = [](char c) { return c == ' ' || c == '\t' || c == '\r' || c == '\n'; };
+        const auto isDelimiter = [&](char c) { return isBlank(c) || c == '=' || c == '{' || c == '}' || c == '#' || c == '<' || c == '>'; };
+        uint64_t tokens = 0;
+        while (!reader.IsEmpty()) {
+            char ch = reader.Read();
+            if (isBlank(ch) || ch == '=' || ch == '{' || ch == '}' || ch == '<' || ch == '>')
+                continue;
+            if (ch == '#') {
+                reader.SkipUntil([](char c) { return c == '\n'; });
+                continue;
+            }
+            reader.ReadUntil(isDelimiter, true, false);
+            tokens++;
+        }
+        return tokens;
+    };
+
+    const auto PeakMemory = []() {
+#if defined(__unix__) || defined(__APPLE__)
+        struct rusage usage;
+        getrusage(RUSAGE_SELF, &usage);
+        return (double) usage.ru_maxrss / 1024.0;
+#else
+        return 0.0;
+#endif
+    };
+
+    std::ifstream file("tests/00_benchmark_10KB.txt", std::ios::binary);
+    std::string pattern((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    pattern += "\n";
+
+    std::cout << "Starting streaming benchmarks..." << std::endl;
+    std::cout << std::left << std::setw(12) << "mode" << std::right << std::setw(12) << "input" << std::setw(15) << "time" << std::setw(15) << "tokens" << std::setw(15) << "peak rss" << std::endl;
+    std::cout << "---------------------------------------------------------------------" << std::endl;
+
+    const auto Run = [&](const std::string& mode, uint64_t size) {
+        RepeatStreamBuffer buffer(pattern, size);
+        std::istream stream(&buffer);
+        Reader reader;
+        auto start = std::chrono::high_resolution_clock::now();
+        if (mode == "stream")
+            reader.OpenStream(stream);
+        else
+            reader.Open(stream);
+        uint64_t tokens = CountTokens(reader);
+        auto end = std::chrono::high_resolution_clock::now();
+        std::chrono::duration<double, std::milli> duration = end - start;
+        std::cout << std::left << std::setw(12) << mode << std::right << std::setw(12) << (std::to_string(size >> 20) + "MB") << std::setw(15) << (std::to_string((int) duration.count()) + "ms") << std::setw(15) << tokens << std::setw(15) << (std::to_string((int) PeakMemory()) + "MB") << std::endl;
+    };
+
+    // The peak memory is monotonic, so streaming runs come first: they should
+    // stay flat, while reading whole streams grows with the input size.
+    for (uint64_t size : { 1ull << 20, 16ull << 20, 256ull << 20, 1ull << 30, 4ull << 30 })
+        Run("stream", size);
+    for (uint64_t size : { 1ull << 20, 16ull << 20, 256ull << 20 })
+        Run("whole", size);
+}
+
+void BenchmarkMapSizes() {
+    using Clock = std::chrono::high_resolution_clock;
+    const auto Nanoseconds = [](Clock::duration duration, uint64_t count) {
+        return std::chrono::duration<double, std::nano>(duration).count() / count;
+    };
+
+    std::cout << "Starting map size benchmarks..." << std::endl;
+    std::cout << std::left << std::setw(10) << "keys" << std::right << std::setw(15) << "parse/key" << std::setw(15) << "Get(name)" << std::setw(15) << "Get(symbol)" << std::setw(15) << "Get(missing)" << std::endl;
+    std::cout << "------------------------------------------------------------------------" << std::endl;
+
+    for (int size : { 1, 2, 4, 8, 9, 16, 64, 256 }) {
+        // Parse about a megabyte of objects of the same size.
+        std::string content;
+        int objects = std::max(1, 1000000 / (size * 16));
+        for (int i = 0; i < objects; i++) {
+            content += std::to_string(i) + " = {";
+            for (int j = 0; j < size; j++)
+                content += " key_" + std::to_string(j) + " = " + std::to_string(j);
+            content += " }\n";
+        }
+        auto start = Clock::now();
+        std::shared_ptr<Object> root = ParseString(content);
+        double parse = Nanoseconds(Clock::now() - start, (uint64_t) objects * size);
+
+        std::vector<std::string> names;
+        std::vector<Symbol> symbols;
+        for (int j = 0; j < size; j++) {
+            names.push_back("key_" + std::to_string(j));
+            symbols.push_back(Symbol(names.back()));
+        }
+        std::shared_ptr<Object> object = root->Get("0");
+        uint64_t iterations = 4000000;
+        uint64_t sum = 0;
+
+        start = Clock::now();
+        for (uint64_t i = 0; i < iterations; i++)
+            sum += object->Get(names[i % size]).use_count();
+        double byName = Nanoseconds(Clock::now() - start, iterations);
+
+        start = Clock::now();
+        for (uint64_t i = 0; i < iterations; i++)
+            sum += object->Get(symbols[i % size]).use_count();
+        double bySymbol = Nanoseconds(Clock::now() - start, iterations);
+
+        start = Clock::now();
+        for (uint64_t i = 0; i < iterations; i++)
+            sum += object->Contains("missing_key");
+        double missing = Nanoseconds(Clock::now() - start, iterations);
+
+        std::cout << std::left << std::setw(10) << size << std::right << std::setw(15) << (std::format("{:.1f}ns", parse)) << std::setw(15) << (std::format("{:.1f}ns", byName)) << std::setw(15) << (std::format("{:.1f}ns", bySymbol)) << std::setw(15) << (std::format("{:.1f}ns", missing)) << std::endl;
+
+        // Keep the lookups from being optimized out.
+        volatile uint64_t sink = sum;
+        (void) sink;
+    }
+}
+
+void BenchmarkNesting() {
+    const auto BenchmarkContent = [](const std::string& name, const std::string& content, int iterations) {
+        Parser parser;
+        parser.SetMaxDepth(4096);
+        std::chrono::duration<double, std::milli> duration = std::chrono::duration<double, std::milli>::zero();
+        for (int i = 0; i < iterations; i++) {
+            auto start = std::chrono::high_resolution_clock::now();
+            std::shared_ptr<Object> object = parser.ParseString(content);
+            auto end = std::chrono::high_resolution_clock::now();
+            duration += end - start;
+        }
+        duration /= iterations;
+        double throughput = content.size() / (duration.count() * 1000.0);
+        std::cout << std::left << std::setw(30) << name << std::right << std::setw(15) << (std::to_string(duration.count()) + "ms") << std::setw(15) << (std::to_string((int) throughput) + "MB/s") << std::endl;
+    };
+
+    // A single block with many entries, and many blocks nested a few thousand levels deep.
+    std::string wide;
+    for (int i = 0; i < 100000; i++)
+        wide += "key_" + std::to_string(i) + " = { value = " + std::to_string(i) + " }\n";
+    std::string deep;
+    for (int i = 0; i < 50; i++) {
+        deep += "key_" + std::to_string(i) + " = ";
+        for (int j = 0; j < 4000; j++)
+            deep += "{ a = ";
+        deep += "b" + std::string(4000, '}') + "\n";
+    }
+
+    std::cout << "Starting nesting benchmarks..." << std::endl;
+    std::cout << std::left << std::setw(30) << "input" << std::right << std::setw(15) << "avg time" << std::setw(15) << "throughput" << std::endl;
+    std::cout << "------------------------------------------------------------" << std::endl;
+    BenchmarkContent("flat-wide", wide, 20);
+    BenchmarkContent("deeply nested", deep, 20);
+}
+
+std::string CopyBenchmark(int copies) {
+    // Copies of the 1MB benchmark with their top-level keys renamed, so that the entries stay unique.
+    std::ifstream input("tests/00_benchmark_1MB.txt");
+    std::string source((std::istreambuf_iterator<char>(input)), std::istreambuf_iterator<char>());
+    std::string content;
+    for (int i = 0; i < copies; i++) {
+        size_t lineStart = 0;
+        while (lineStart < source.size()) {
+            size_t lineEnd = source.find('\n', lineStart);
+            lineEnd = (lineEnd == std::string::npos ? source.size() : lineEnd + 1);
+            std::string_view line(source.data() + lineStart, lineEnd - lineStart);
+            size_t keyEnd = line.find(" =");
+            if (!line.empty() && !std::isspace((unsigned char) line[0]) && line[0] != '}' && line[0] != '#' && keyEnd != std::string_view::npos)
+                content += std::string(line.substr(0, keyEnd)) + "_" + std::to_string(i) + std::string(line.substr(keyEnd));
+            else
+                content += line;
+            lineStart = lineEnd;
+        }
+    }
+    return content;
+}
+
+void BenchmarkParallel() {
+    const std::string content = CopyBenchmark(20);
+    const std::string filePath = "tests/00_benchmark_parallel.tmp";
+    std::ofstream(filePath) << content;
+
+    std::cout << "Starting parallel benchmarks..." << std::endl;
+    std::cout << std::left << std::setw(30) << "threads" << std::right << std::setw(15) << "avg time" << std::setw(15) << "throughput" << std::endl;
+    std::cout << "------------------------------------------------------------" << std::endl;
+    for (unsigned int threads : { 1u, 2u, 4u, 8u, std::thread::hardware_concurrency() }) {
+        std::chrono::duration<double, std::milli> duration = std::chrono::duration<double, std::milli>::zero();
+        const int iterations = 5;
+        for (int i = 0; i < iterations; i++) {
+            auto start = std::chrono::high_resolution_clock::now();
+            std::shared_ptr<Object> object = ParseFileParallel(filePath, threads);
+            auto end = std::chrono::high_resolution_clock::now();
+            duration += end - start;
+        }
+        duration /= iterations;
+        double throughput = content.size() / (duration.count() * 1000.0);
+        std::cout << std::left << std::setw(30) << threads << std::right << std::setw(15) << (std::to_string(duration.count()) + "ms") << std::setw(15) << (std::to_string((int) throughput) + "MB/s") << std::endl;
+    }
+    std::filesystem::remove(filePath);
+}
+
+void BenchmarkDirectory() {
+    // A tree of 5000 files cut from the benchmark files, from a few lines to whole files,
+    // like the common, history and events directories of a game.
+    std::vector<std::string> sources;
+    for (const char* filePath : { "tests/00_benchmark_10KB.txt", "tests/00_benchmark_100KB.txt", "tests/00_benchmark_1MB.txt" }) {
+        std::ifstream input(filePath);
+        sources.emplace_back((std::istreambuf_iterator<char>(input)), std::istreambuf_iterator<char>());
+    }
+    const std::filesystem::path directory = std::filesystem::temp_directory_path() / "jomini_benchmark_directory";
+    std::filesystem::remove_all(directory);
+    size_t totalSize = 0;
+    for (int i = 0; i < 5000; i++) {
+        std::filesystem::path path = directory / ("dir_" + std::to_string(i % 50)) / ("sub_" + std::to_string(i % 7));
+        std::filesystem::create_directories(path);
+        const std::string& source = sources[(i % 100 == 0) ? 2 : (i % 10 == 0) ? 1 : 0];
+        std::ofstream(path / ("file_" + std::to_string(i) + ".txt")) << source;
+        totalSize += source.size();
+    }
+
+    std::cout << "Starting directory benchmarks (5000 files, " << totalSize / 1000000 << "MB)..." << std::endl;
+    std::cout << std::left << std::setw(30) << "threads" << std::right << std::setw(15) << "avg time" << std::setw(15) << "throughput" << std::endl;
+    std::cout << "------------------------------------------------------------" << std::endl;
+    const auto Report = [&](const std::string& name, std::chrono::duration<double, std::milli> duration) {
+        double throughput = totalSize / (duration.count() * 1000.0);
+        std::cout << std::left << std::setw(30) << name << std::right << std::setw(15) << (std::to_string(duration.count()) + "ms") << std::setw(15) << (std::to_string((int) throughput) + "MB/s") << std::endl;
+    };
+    const int iterations = 3;
+
+    std::chrono::duration<double, std::milli> duration = std::chrono::duration<double, std::milli>::zero();
+    for (int i = 0; i < iterations; i++) {
+        auto start = std::chrono::high_resolution_clock::now();
+        std::map<std::string, std::shared_ptr<Object>> objects;
+        for (const auto& entry : std::filesystem::recursive_directory_iterator(directory))
+            if (entry.is_regular_file())
+                objects[entry.path().string()] = ParseFile(entry.path().string());
+        auto end = std::chrono::high_resolution_clock::now();
+        duration += end - start;
+    }
+    Report("serial ParseFile loop", duration / iterations);
+
+    for (unsigned int threads : { 1u, 2u, 4u, 8u, std::thread::hardware_concurrency() }) {
+        duration = std::chrono::duration<double, std::milli>::zero();
+        for (int i = 0; i < iterations; i++) {
+            auto start = std::chrono::high_resolution_clock::now();
+            DirectoryResult result = ParseDirectory(directory.string(), "*.txt", threads);
+            auto end = std::chrono::high_resolution_clock::now();
+            duration += end - start;
+        }
+        Report(std::to_string(threads), duration / iterations);
+    }
+
+    // Pipelined loads, with the statistics of the last iteration to tune the budget.
+    for (size_t bufferBudget : { 1u << 20, 16u << 20, 256u << 20 }) {
+        Loader loader(2, std::thread::hardware_concurrency(), bufferBudget);
+        duration = std::chrono::duration<double, std::milli>::zero();
+        for (int i = 0; i < iterations; i++) {
+            auto start = std::chrono::high_resolution_clock::now();
+            DirectoryResult result = loader.LoadDirectory(directory.string());
+            auto end = std::chrono::high_resolution_clock::now();
+            duration += end - start;
+        }
+        Report("loader " + std::to_string(bufferBudget >> 20) + "MB budget", duration / iterations);
+        const LoaderStats& stats = loader.GetStats();
+        std::cout << "    queue depth " << stats.averageQueueDepth << " (max " << stats.maxQueueDepth << "), max in flight " << stats.maxBytesInFlight / 1000 << "KB, read stall " << stats.readStall.count() << "ms, parse stall " << stats.parseStall.count() << "ms" << std::endl;
+    }
+    std::filesystem::remove_all(directory);
+}
+
+void BenchmarkEvents() {
+    // Counts every event, or only reads the top-level keys and skips their values.
+    struct CountHandler : EventHandler {
+        size_t count = 0;
+        bool skip = false;
+        EventAction OnKey(std::string_view key, Operator op) override { count++; return skip ? EventAction::SKIP : EventAction::CONTINUE; }
+        void OnScalar(std::string_view scalar) override { count++; }
+        EventAction OnObjectBegin() override { count++; return EventAction::CONTINUE; }
+        EventAction OnArrayBegin() override { count++; return EventAction::CONTINUE; }
+    };
+    const auto BenchmarkParse = [](const std::string& name, const std::string& filePath, const std::function<void(Parser&)>& parse) {
+        std::ifstream file(filePath, std::ios::binary | std::ios::ate);
+        size_t size = file.tellg();
+        Parser parser;
+        std::chrono::duration<double, std::milli> duration = std::chrono::duration<double, std::milli>::zero();
+        const int iterations = 20;
+        for (int i = 0; i < iterations; i++) {
+            auto start = std::chrono::high_resolution_clock::now();
+            parse(parser);
+            auto end = std::chrono::high_resolution_clock::now();
+            duration += end - start;
+        }
+        duration /= iterations;
+        double throughput = size / (duration.count() * 1000.0);
+        std::cout << std::left << std::setw(30) << name << std::right << std::setw(15) << (std::to_string(duration.count()) + "ms") << std::setw(15) << (std::to_string((int) throughput) + "MB/s") << std::endl;
+    };
+
+    const std::string filePath = "tests/00_benchmark_1MB.txt";
+    std::cout << "Starting event benchmarks..." << std::endl;
+    std::cout << std::left << std::setw(30) << "parse" << std::right << std::setw(15) << "avg time" << std::setw(15) << "throughput" << std::endl;
+    std::cout << "------------------------------------------------------------" << std::endl;
+    BenchmarkParse("objects", filePath, [&](Parser& parser) {
+        parser.ParseFile(filePath);
+    });
+    BenchmarkParse("events", filePath, [&](Parser& parser) {
+        CountHandler handler;
+        parser.ParseEventsFile(filePath, handler);
+    });
+    BenchmarkParse("events, skipping values", filePath, [&](Parser& parser) {
+        CountHandler handler;
+        handler.skip = true;
+        parser.ParseEventsFile(filePath, handler);
+    });
+}
+
+void BenchmarkLazy() {
+    // Time from opening the file to reading the first entry of its first block, and to
+    // reading every block, which a lazy parse only pays for once they are accessed.
+    const auto BenchmarkOpen = [](const std::string& name, const std::string& filePath, bool lazy, bool all) {
+        std::chrono::duration<double, std::milli> duration = std::chrono::duration<double, std::milli>::zero();
+        const int iterations = 10;
+        size_t count = 0;
+        for (int i = 0; i < iterations; i++) {
+            auto start = std::chrono::high_resolution_clock::now();
+            std::shared_ptr<Object> root = lazy ? ParseLazyFile(filePath) : ParseFile(filePath);
+            for (auto& [key, pair] : root->GetMap()) {
+                if (pair.second->Is(Type::OBJECT))
+                    count += pair.second->GetMap().size();
+                if (!all)
+                    break;
+            }
+            auto end = std::chrono::high_resolution_clock::now();
+            duration += end - start;
+        }
+        duration /= iterations;
+        std::cout << std::left << std::setw(40) << name << std::right << std::setw(15) << (std::to_string(duration.count()) + "ms") << std::endl;
+    };
+
+    const std::string filePath = "tests/00_benchmark_lazy.tmp";
+    const std::string blockFilePath = "tests/00_benchmark_lazy_block.tmp";
+    const std::string content = CopyBenchmark(30);
+    std::ofstream(filePath) << content;
+    // The same content in a single block, like the sections of a save.
+    std::ofstream(blockFilePath) << "save = {\n" << content << "\n}\n";
+
+    std::cout << "Starting lazy benchmarks..." << std::endl;
+    std::cout << std::left << std::setw(40) << "file" << std::right << std::setw(15) << "avg time" << std::endl;
+    std::cout << "-------------------------------------------------------" << std::endl;
+    for (const std::string& path : { std::string("tests/00_benchmark_1MB.txt"), filePath, blockFilePath }) {
+        BenchmarkOpen(path + ", eager, first", path, false, false);
+        BenchmarkOpen(path + ", lazy, first", path, true, false);
+        BenchmarkOpen(path + ", eager, all", path, false, true);
+        BenchmarkOpen(path + ", lazy, all", path, true, true);
     }
+    std::filesystem::remove(filePath);
+    std::filesystem::remove(blockFilePath);
+}
+
+void BenchmarkProjection() {
+    const auto BenchmarkPatterns = [](const std::string& name, const std::string& filePath, size_t size, const std::vector<std::string>& patterns) {
+        Parser parser;
+        parser.SetProjection(patterns);
+        std::chrono::duration<double, std::milli> duration = std::chrono::duration<double, std::milli>::zero();
+        const int iterations = 5;
+        for (int i = 0; i < iterations; i++) {
+            auto start = std::chrono::high_resolution_clock::now();
+            std::shared_ptr<Object> object = parser.ParseFile(filePath);
+            auto end = std::chrono::high_resolution_clock::now();
+            duration += end - start;
+        }
+        duration /= iterations;
+        double throughput = size / (duration.count() * 1000.0);
+        std::cout << std::left << std::setw(30) << name << std::right << std::setw(15) << (std::to_string(duration.count()) + "ms") << std::setw(15) << (std::to_string((int) throughput) + "MB/s") << std::endl;
+    };
+
+    const std::string filePath = "tests/00_benchmark_projection.tmp";
+    const std::string content = CopyBenchmark(30);
+    std::ofstream(filePath) << content;
+
+    std::cout << "Starting projection benchmarks..." << std::endl;
+    std::cout << std::left << std::setw(30) << "patterns" << std::right << std::setw(15) << "avg time" << std::setw(15) << "throughput" << std::endl;
+    std::cout << "------------------------------------------------------------" << std::endl;
+    BenchmarkPatterns("(none)", filePath, content.size(), {});
+    BenchmarkPatterns("*_0/**", filePath, content.size(), { "*_0/**" });
+    BenchmarkPatterns("*/name", filePath, content.size(), { "*/name" });
+    BenchmarkPatterns("*/*/birth", filePath, content.size(), { "*/*/birth" });
+    BenchmarkPatterns("nothing", filePath, content.size(), { "nothing" });
+    std::filesystem::remove(filePath);
+}
+
+void BenchmarkEdits() {
+    // Time of parsing the document, of its first edit which also finds its blocks, and of
+    // the following edits to a scalar in the middle of the file.
+    const auto BenchmarkDocument = [](const std::string& filePath) {
+        auto start = std::chrono::high_resolution_clock::now();
+        std::shared_ptr<Document> document = ParseDocumentFile(filePath);
+        std::chrono::duration<double, std::milli> parse = std::chrono::high_resolution_clock::now() - start;
+
+        std::string_view source = document->GetSource();
+        size_t offset = source.find("learning = ", source.size() / 2) + 11;
+        start = std::chrono::high_resolution_clock::now();
+        document->ApplyEdit(offset, 1, "7");
+        std::chrono::duration<double, std::milli> first = std::chrono::high_resolution_clock::now() - start;
+
+        const int iterations = 100;
+        start = std::chrono::high_resolution_clock::now();
+        for (int i = 0; i < iterations; i++)
+            document->ApplyEdit(offset, 1, (i % 2 == 0) ? "8" : "7");
+        std::chrono::duration<double, std::milli> edit = (std::chrono::high_resolution_clock::now() - start) / iterations;
+
+        std::cout << std::left << std::setw(40) << filePath << std::right << std::setw(15) << (std::to_string(parse.count()) + "ms") << std::setw(15) << (std::to_string(first.count()) + "ms") << std::setw(15) << (std::to_string(edit.count()) + "ms") << std::endl;
+    };
+
+    const std::string filePath = "tests/00_benchmark_edits.tmp";
+    const std::string blockFilePath = "tests/00_benchmark_edits_block.tmp";
+    const std::string content = CopyBenchmark(30);
+    std::ofstream(filePath) << content;
+    std::ofstream(blockFilePath) << "save = {\n" << content << "\n}\n";
+
+    std::cout << "Starting edit benchmarks..." << std::endl;
+    std::cout << std::left << std::setw(40) << "file" << std::right << std::setw(15) << "parse" << std::setw(15) << "first edit" << std::setw(15) << "avg edit" << std::endl;
+    std::cout << "-------------------------------------------------------------------------------------" << std::endl;
+    BenchmarkDocument("tests/00_benchmark_1MB.txt");
+    BenchmarkDocument(filePath);
+    BenchmarkDocument(blockFilePath);
+    std::filesystem::remove(filePath);
+    std::filesystem::remove(blockFilePath);
+}
+
+void BenchmarkConversions() {
+    std::string content;
+    for (int i = 0; i < 100000; i++) {
+        content += "character_" + std::to_string(i) + " = { age = " + std::to_string(i % 90) + " weight = " + std::to_string(i % 100) + "." + std::to_string(i % 7)
+            + " birth = " + std::to_string(1000 + i % 500) + "." + std::to_string(i % 12 + 1) + "." + std::to_string(i % 28 + 1) + " alive = yes name = name_" + std::to_string(i) + " }\n";
+    }
+    std::shared_ptr<Object> object = ParseString(content);
+    std::vector<std::shared_ptr<Object>> scalars;
+    for (auto& [key, pair] : object->GetMap()) {
+        for (auto& [childKey, childPair] : pair.second->GetMap())
+            scalars.push_back(childPair.second);
+    }
+
+    // Each scalar is converted to the type found when parsing, and the text conversions
+    // are those the scalars went through before they were classified.
+    const auto BenchmarkType = [&](const std::string& name, ScalarType type, const auto& convert, const auto& convertText) {
+        std::vector<std::shared_ptr<Object>> values;
+        for (const std::shared_ptr<Object>& scalar : scalars) {
+            if (scalar->GetScalarType() == type)
+                values.push_back(scalar);
+        }
+        const int iterations = 100;
+        double sum = 0;
+        auto start = std::chrono::high_resolution_clock::now();
+        for (int i = 0; i < iterations; i++) {
+            for (const std::shared_ptr<Object>& value : values)
+                sum += convert(*value);
+        }
+        std::chrono::duration<double, std::nano> typed = (std::chrono::high_resolution_clock::now() - start) / (iterations * std::max<size_t>(values.size(), 1));
+        start = std::chrono::high_resolution_clock::now();
+        for (int i = 0; i < iterations; i++) {
+            for (const std::shared_ptr<Object>& value : values)
+                sum -= convertText(std::string(value->GetScalar()));
+        }
+        std::chrono::duration<double, std::nano> text = (std::chrono::high_resolution_clock::now() - start) / (iterations * std::max<size_t>(values.size(), 1));
+        std::cout << std::left << std::setw(15) << name << std::right << std::setw(15) << values.size() << std::setw(15) << (std::to_string(typed.count()) + "ns") << std::setw(15) << (std::to_string(text.count()) + "ns") << std::endl;
+
+        // Keep the conversions from being optimized out.
+        volatile double sink = sum;
+        (void) sink;
+    };
+
+    std::cout << "Starting conversion benchmarks..." << std::endl;
+    std::cout << std::left << std::setw(15) << "type" << std::right << std::setw(15) << "scalars" << std::setw(15) << "typed" << std::setw(15) << "from text" << std::endl;
+    std::cout << "------------------------------------------------------------" << std::endl;
+    BenchmarkType("int", ScalarType::INT, [](const Object& value) { return value.As<int>(); }, [](const std::string& text) { return std::stoi(text); });
+    BenchmarkType("float", ScalarType::FLOAT, [](const Object& value) { return value.As<double>(); }, [](const std::string& text) { return std::stod(text); });
+    BenchmarkType("date", ScalarType::DATE, [](const Object& value) { return value.As<Date>().day; }, [](const std::string& text) { return Date(text).day; });
+    BenchmarkType("bool", ScalarType::BOOL, [](const Object& value) { return (int) value.As<bool>(); }, [](const std::string& text) { return (int) (text == "yes"); });
+}
+
+void BenchmarkMisses() {
+    // One key in ten is found, and half of the found values are not integers.
+    std::string content;
+    for (int i = 0; i < 1000; i++)
+        content += "key_" + std::to_string(i * 10) + " = " + (i % 2 == 0 ? std::to_string(i) : "value_" + std::to_string(i)) + "\n";
+    std::shared_ptr<Object> object = ParseString(content);
+    std::vector<std::string> keys;
+    for (int i = 0; i < 10000; i++)
+        keys.push_back("key_" + std::to_string(i));
+
+    const auto BenchmarkLookups = [&](const std::string& name, const auto& lookup) {
+        const int iterations = 20;
+        int64_t sum = 0;
+        auto start = std::chrono::high_resolution_clock::now();
+        for (int i = 0; i < iterations; i++) {
+            for (const std::string& key : keys)
+                sum += lookup(key);
+        }
+        std::chrono::duration<double, std::nano> duration = (std::chrono::high_resolution_clock::now() - start) / (iterations * keys.size());
+        std::cout << std::left << std::setw(30) << name << std::right << std::setw(15) << (std::to_string(duration.count()) + "ns") << std::endl;
+
+        // Keep the lookups from being optimized out.
+        volatile int64_t sink = sum;
+        (void) sink;
+    };
+
+    std::cout << "Starting miss benchmarks..." << std::endl;
+    std::cout << std::left << std::setw(30) << "method" << std::right << std::setw(15) << "avg lookup" << std::endl;
+    std::cout << "---------------------------------------------" << std::endl;
+    // Former implementation of As with a default value.
+    BenchmarkLookups("Get + As<int> + catch", [&](const std::string& key) {
+        try {
+            return object->Get(key)->As<int>();
+        }
+        catch (std::exception& e) {}
+        return -1;
+    });
+    BenchmarkLookups("Get + As<int>(-1)", [&](const std::string& key) { return object->Get(key)->As<int>(-1); });
+    BenchmarkLookups("TryGet + TryAs<int>", [&](const std::string& key) {
+        int value = -1;
+        std::shared_ptr<Object> found = object->TryGet(key);
+        if (found != nullptr)
+            found->TryAs(value);
+        return value;
+    });
+}
+
+void BenchmarkErrors() {
+    // A missing operator is added to one line in a thousand of the copies of the benchmark.
+    const std::string content = CopyBenchmark(10);
+    std::string invalid;
+    size_t lines = 0;
+    size_t lineStart = 0;
+    while (lineStart < content.size()) {
+        size_t lineEnd = content.find('\n', lineStart);
+        lineEnd = (lineEnd == std::string::npos ? content.size() : lineEnd + 1);
+        std::string_view line(content.data() + lineStart, lineEnd - lineStart);
+        size_t op = line.find(" = ");
+        if (++lines % 1000 == 0 && op != std::string_view::npos && line.find_first_of("{}\"") == std::string_view::npos)
+            invalid += std::string(line.substr(0, op)) + " = =" + std::string(line.substr(op + 2));
+        else
+            invalid += line;
+        lineStart = lineEnd;
+    }
+
+    const auto Measure = [](const std::function<void()>& function) {
+        auto start = std::chrono::high_resolution_clock::now();
+        function();
+        return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+    };
+
+    Parser parser;
+    parser.SetMaxErrors(1000);
+    ParseResult result;
+    parser.ParseString(content);
+    double valid = Measure([&]() { parser.ParseString(content); });
+    double validResult = Measure([&]() { result = parser.ParseResultString(content); });
+    double first = Measure([&]() {
+        try {
+            parser.ParseString(invalid);
+        }
+        catch (std::exception& e) {}
+    });
+    double all = Measure([&]() { result = parser.ParseResultString(invalid); });
+    double format = Measure([&]() {
+        for (size_t i = 0; i < result.GetErrors().size(); i++)
+            result.FormatError(i);
+    });
+
+    std::cout << "Starting error benchmarks (" << result.GetErrors().size() << " errors in " << content.size() / (1024 * 1024) << "MB)..." << std::endl;
+    std::cout << std::left << std::setw(45) << "method" << std::right << std::setw(15) << "time" << std::endl;
+    std::cout << "------------------------------------------------------------" << std::endl;
+    std::cout << std::left << std::setw(45) << "ParseString (valid)" << std::right << std::setw(15) << (std::to_string(valid) + "ms") << std::endl;
+    std::cout << std::left << std::setw(45) << "ParseResultString (valid)" << std::right << std::setw(15) << (std::to_string(validResult) + "ms") << std::endl;
+    std::cout << std::left << std::setw(45) << "ParseString (first error)" << std::right << std::setw(15) << (std::to_string(first) + "ms") << std::endl;
+    std::cout << std::left << std::setw(45) << "ParseResultString (all errors)" << std::right << std::setw(15) << (std::to_string(all) + "ms") << std::endl;
+    std::cout << std::left << std::setw(45) << "FormatError (all errors)" << std::right << std::setw(15) << (std::to_string(format) + "ms") << std::endl;
+}
+
+void BenchmarkPackedArrays() {
+    // Long arrays of ids as in saves, and colors as in the landed titles.
+    std::string content;
+    for (int i = 0; i < 200; i++) {
+        content += "ids_" + std::to_string(i) + " = {";
+        for (int j = 0; j < 5000; j++)
+            content += " " + std::to_string((i * 7919 + j * 104729) % 1000000);
+        content += " }\n";
+    }
+    for (int i = 0; i < 100000; i++)
+        content += "color_" + std::to_string(i) + " = rgb { " + std::to_string(i % 256) + " " + std::to_string(i * 7 % 256) + " " + std::to_string(i * 13 % 256) + " }\n";
+
+    const auto Measure = [](const std::function<void()>& function) {
+        auto start = std::chrono::high_resolution_clock::now();
+        function();
+        return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+    };
+
+    std::shared_ptr<Object> packed;
+    double parse = Measure([&]() { packed = ParseString(content); });
+    // The copy keeps the arrays packed, which are then boxed by accessing their elements.
+    std::shared_ptr<Object> boxed = packed->Copy();
+    double box = Measure([&]() {
+        for (auto& [key, pair] : boxed->GetMap())
+            pair.second->GetArray();
+    });
+
+    int64_t sum = 0;
+    const auto BenchmarkReads = [&](const std::shared_ptr<Object>& object, const auto& read) {
+        return Measure([&]() {
+            for (int i = 0; i < 10; i++) {
+                for (auto& [key, pair] : object->GetMap())
+                    sum += read(*pair.second);
+            }
+        });
+    };
+    const auto ReadIds = [](const Object& value) -> int64_t {
+        if (!value.HasFlag(Flags::RGB))
+            return value.AsArray<int>().back();
+        return 0;
+    };
+    const auto ReadColors = [](const Object& value) -> int64_t {
+        if (value.HasFlag(Flags::RGB))
+            return value.As<sf::Color>().g;
+        return 0;
+    };
+    const auto ReadSpans = [](const Object& value) -> int64_t {
+        int64_t total = 0;
+        for (int id : value.GetPacked<int>().value_or(std::span<const int>()))
+            total += id;
+        return total;
+    };
+    double packedIds = BenchmarkReads(packed, ReadIds);
+    double boxedIds = BenchmarkReads(boxed, ReadIds);
+    double packedColors = BenchmarkReads(packed, ReadColors);
+    double boxedColors = BenchmarkReads(boxed, ReadColors);
+    double spans = BenchmarkReads(packed, ReadSpans);
+
+    std::cout << "Starting packed array benchmarks (" << content.size() / (1024 * 1024) << "MB, 10 passes)..." << std::endl;
+    std::cout << std::left << std::setw(30) << "method" << std::right << std::setw(15) << "packed" << std::setw(15) << "boxed" << std::endl;
+    std::cout << "------------------------------------------------------------" << std::endl;
+    std::cout << std::left << std::setw(30) << "ParseString / box" << std::right << std::setw(15) << (std::to_string(parse) + "ms") << std::setw(15) << (std::to_string(box) + "ms") << std::endl;
+    std::cout << std::left << std::setw(30) << "AsArray<int> (ids)" << std::right << std::setw(15) << (std::to_string(packedIds) + "ms") << std::setw(15) << (std::to_string(boxedIds) + "ms") << std::endl;
+    std::cout << std::left << std::setw(30) << "As<sf::Color> (colors)" << std::right << std::setw(15) << (std::to_string(packedColors) + "ms") << std::setw(15) << (std::to_string(boxedColors) + "ms") << std::endl;
+    std::cout << std::left << std::setw(30) << "GetPacked<int> (ids)" << std::right << std::setw(15) << (std::to_string(spans) + "ms") << std::setw(15) << "-" << std::endl;
+
+    // Keep the reads from being optimized out.
+    volatile int64_t sink = sum;
+    (void) sink;
 }
 
 std::string SerializeVector(const std::vector<std::string>& vec) {
@@ -559,6 +1327,1423 @@ TEST_CASE("[30_exceptions_array_unexpected_operator.txt] unexpected operator in
     }
 }
 
+TEST_CASE("[32_bom] utf8 byte order mark and mapped input") {
+    std::shared_ptr<Object> object = ParseFile("tests/32_bom.txt");
+
+    CHECK(object->GetMap().size() == 1);
+    CHECK(object->GetMap().keys().at(0) == "key");
+    CHECK(object->Get("key")->As<std::string>() == "value");
+
+    Reader reader;
+    reader.OpenFile("tests/32_bom.txt");
+    REQUIRE(reader.GetBuffer() != nullptr);
+    CHECK(reader.GetView() == "key = value\n");
+    CHECK(reader.GetBuffer()->GetView().size() == reader.GetView().size() + 3);
+#if defined(__unix__) || defined(__APPLE__)
+    CHECK(reader.GetBuffer()->IsMapped());
+#endif
+
+    // Copying the file into memory reads the same bytes, and fails on inputs without a size.
+    Buffer buffer;
+    CHECK(buffer.ReadFile("tests/32_bom.txt"));
+    CHECK(buffer.GetView() == reader.GetBuffer()->GetView());
+    CHECK(!buffer.ReadFile("tests"));
+    CHECK(buffer.GetView().empty());
+    CHECK(!buffer.ReadFile("tests/missing.txt"));
+}
+
+TEST_CASE("[33_exceptions_max_depth] blocks nested deeper than the maximum depth") {
+    Parser parser;
+    parser.SetMaxDepth(3);
+    CHECK(parser.GetMaxDepth() == 3);
+    CHECK_THROWS_AS(parser.ParseFile("tests/33_exceptions_max_depth.txt"), std::runtime_error);
+
+    try {
+        parser.ParseFile("tests/33_exceptions_max_depth.txt");
+    }
+    catch (std::exception& e) {
+        CHECK(std::string(e.what()).substr(19) == ": an exception has been raised.\ntests/33_exceptions_max_depth.txt:3:13: error: blocks nested deeper than the maximum depth of 3\n\t3 | \t\tb = { c = { } }\n\t  |             ^\n\t  |             |\n\t  |             too deeply nested");
+    }
+
+    // Nesting up to the maximum depth is accepted by every engine.
+    parser.SetMaxDepth(Parser::s_DefaultMaxDepth);
+    std::string content = "key = ";
+    for (int i = 0; i < Parser::s_DefaultMaxDepth; i++)
+        content += "{ a = ";
+    content += "b" + std::string(Parser::s_DefaultMaxDepth, '}');
+    for (Engine engine : { Engine::STATE_MACHINE, Engine::STRUCTURAL_INDEX }) {
+        parser.SetEngine(engine);
+        std::shared_ptr<Object> object = parser.ParseString(content);
+        for (int i = 0; i < Parser::s_DefaultMaxDepth; i++)
+            object = object->Get(i == 0 ? "key" : "a");
+        CHECK(object->Get("a")->As<std::string>() == "b");
+    }
+    CHECK(parser.ParseTapeString(content)->GetRoot().Get("key").Get("a").Get("a").Is(Type::OBJECT));
+
+    // Deeper inputs are reported instead of overflowing the stack.
+    content = std::string(1000000, '{') + std::string(1000000, '}');
+    for (Engine engine : { Engine::STATE_MACHINE, Engine::STRUCTURAL_INDEX }) {
+        parser.SetEngine(engine);
+        CHECK_THROWS_AS(parser.ParseString(content), std::runtime_error);
+    }
+    CHECK_THROWS_AS(parser.ParseTapeString(content), std::runtime_error);
+    CHECK_THROWS_AS(parser.ParseDocumentString(content), std::runtime_error);
+}
+
+TEST_CASE("[34_parallel] parse top-level entries on several threads") {
+    const auto ParseWith = [](const std::string& filePath, unsigned int threads) {
+        try {
+            if (threads == 0)
+                return ParseFile(filePath)->Serialize();
+            return ParseFileParallel(filePath, threads)->Serialize();
+        }
+        catch (std::exception& e) {
+            return std::string(e.what());
+        }
+    };
+
+    // Entries must be merged in source order, with the same objects and errors as a sequential parse.
+    for (const auto& entry : std::filesystem::directory_iterator("tests")) {
+        std::string filePath = entry.path().string();
+        CAPTURE(filePath);
+        std::string expected = ParseWith(filePath, 0);
+        for (unsigned int threads : { 2, 3, 8 })
+            CHECK(ParseWith(filePath, threads) == expected);
+    }
+
+    std::shared_ptr<Object> object = ParseFileParallel("tests/34_parallel.txt", 4);
+    CHECK(object->Get("title")->Is(Type::ARRAY));
+    CHECK(object->Get("title")->GetArray().size() == 3);
+    CHECK(object->Get("title")->GetArray().at(1)->Get("name")->As<std::string>() == "\"second } title\"");
+    CHECK(object->Get("counter")->AsArray<int>() == std::vector<int>{ 1, 2, 3, 4 });
+    CHECK(object->Get("values")->AsArray<int>() == std::vector<int>{ 1, 2, 3, 4, 5 });
+    CHECK(object->Get("range_values")->AsArray<int>() == std::vector<int>{ 1, 2, 3 });
+    CHECK(object->Get("color")->HasFlag(Flags::HSV));
+    CHECK(object->Get("nested")->Get("a")->Get("b")->Get("c")->As<std::string>() == "\"}\"");
+    CHECK(object->GetOperator("last") == Operator::NOT_NULL);
+}
+
+TEST_CASE("[streaming] parse non-seekable streams through a small refill window") {
+    const std::vector<std::string> filePaths = {
+        "tests/01_basic.txt", "tests/04_nested_objects.txt", "tests/05_scalars.txt",
+        "tests/06_keys.txt", "tests/09_arrays_complex.txt", "tests/11_arrays_flags.txt",
+        "tests/12_comments.txt", "tests/13_utf8.txt", "tests/31_flatten.txt",
+        "tests/32_bom.txt", "tests/00_benchmark_10KB.txt"
+    };
+
+    for (const std::string& filePath : filePaths) {
+        CAPTURE(filePath);
+        std::ifstream file(filePath, std::ios::binary);
+        std::string content((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        std::string expected = ParseFile(filePath)->Serialize();
+
+        // Tokens longer than the window must make it grow.
+        PipeStreamBuffer streamBuffer(content);
+        std::istream stream(&streamBuffer);
+        Parser parser;
+        CHECK(parser.ParseStream(stream, 16)->Serialize() == expected);
+
+        PipeStreamBuffer wholeBuffer(content);
+        std::istream whole(&wholeBuffer);
+        Reader reader;
+        reader.Open(whole);
+        std::string_view source = content;
+        if (source.starts_with("\xEF\xBB\xBF"))
+            source.remove_prefix(3);
+        CHECK(reader.GetView() == source);
+
+#if defined(__unix__) || defined(__APPLE__)
+        int fd = ::open(filePath.c_str(), O_RDONLY);
+        REQUIRE(fd >= 0);
+        CHECK(parser.ParseDescriptor(fd, 16)->Serialize() == expected);
+        ::close(fd);
+#endif
+    }
+
+    PipeStreamBuffer streamBuffer("key =");
+    std::istream stream(&streamBuffer);
+    CHECK_THROWS_AS(ParseStream(stream), std::runtime_error);
+
+    // Read errors are raised instead of being taken for the end of the input.
+    std::istream invalidStream(nullptr);
+    CHECK_THROWS_WITH(Parser().ParseStream(invalidStream, 16), "Reader::OpenStream: failed to read the stream.");
+    Reader reader;
+    CHECK_THROWS_WITH(reader.Open(invalidStream), "Reader::Open: failed to read the stream.");
+#if defined(__unix__) || defined(__APPLE__)
+    CHECK_THROWS_WITH(Parser().ParseDescriptor(-1), "Reader::OpenDescriptor: failed to read file descriptor -1 (Bad file descriptor).");
+#endif
+}
+
+// Parsed by a static initializer, which may run before those of the library.
+static const std::string s_StaticInitializerScalar = ParseString("key = { value }")->Get("key")->Serialize();
+
+TEST_CASE("[scanner] vectorized delimiter scanning") {
+    CHECK(s_StaticInitializerScalar == "{ value }");
+
+    const auto ScanReference = [](const char* begin, const char* end) {
+        while (begin < end && std::string_view(" \t\r\n=<>!?{}#").find(*begin) == std::string_view::npos)
+            begin++;
+        return begin;
+    };
+
+    // Check every delimiter at every position of blocks of various lengths,
+    // so that both the vectorized loops and the scalar tails are covered.
+    std::string text(100, 'a');
+    for (char delimiter : std::string_view(" \t\r\n=<>!?{}#")) {
+        for (size_t position = 0; position < text.size(); position++) {
+            std::string buffer = text;
+            buffer[position] = delimiter;
+            for (size_t offset : { 0, 1, 7 }) {
+                const char* begin = buffer.data() + offset;
+                const char* end = buffer.data() + buffer.size();
+                CHECK(ScanDelimiter(begin, end) == ScanReference(begin, end));
+            }
+        }
+    }
+    CHECK(ScanDelimiter(text.data(), text.data() + text.size()) == text.data() + text.size());
+    CHECK(ScanChar(text.data(), text.data(), '"') == text.data());
+    CHECK(!GetScannerName().empty());
+}
+
+TEST_CASE("[lexer] pull tokens") {
+    const auto GetTokens = [](std::string_view input) {
+        std::vector<std::pair<TokenType, std::string>> tokens;
+        Lexer lexer(input);
+        for (Token token = lexer.Next(); token.type != TokenType::END; token = lexer.Next())
+            tokens.emplace_back(token.type, std::string(token.text));
+        return tokens;
+    };
+    using Tokens = std::vector<std::pair<TokenType, std::string>>;
+
+    CHECK(GetTokens("").empty());
+    CHECK(GetTokens(" \t\r\n").empty());
+    CHECK(GetTokens("key = value") == Tokens{ { TokenType::SCALAR, "key" }, { TokenType::OPERATOR, "=" }, { TokenType::SCALAR, "value" } });
+    CHECK(GetTokens("a<=b c>d e!=f g?=h i==j") == Tokens{
+        { TokenType::SCALAR, "a" }, { TokenType::OPERATOR, "<=" }, { TokenType::SCALAR, "b" },
+        { TokenType::SCALAR, "c" }, { TokenType::OPERATOR, ">" }, { TokenType::SCALAR, "d" },
+        { TokenType::SCALAR, "e" }, { TokenType::OPERATOR, "!=" }, { TokenType::SCALAR, "f" },
+        { TokenType::SCALAR, "g" }, { TokenType::OPERATOR, "?=" }, { TokenType::SCALAR, "h" },
+        { TokenType::SCALAR, "i" }, { TokenType::OPERATOR, "=" }, { TokenType::OPERATOR, "=" }, { TokenType::SCALAR, "j" } });
+    CHECK(GetTokens("name = \"a { b } # c\" # comment { }\n}") == Tokens{
+        { TokenType::SCALAR, "name" }, { TokenType::OPERATOR, "=" }, { TokenType::STRING, "\"a { b } # c\"" },
+        { TokenType::COMMENT, "# comment { }" }, { TokenType::CLOSE_BRACE, "}" } });
+    CHECK(GetTokens("a ! b ? \"c") == Tokens{ { TokenType::SCALAR, "a" }, { TokenType::INVALID, "!" }, { TokenType::SCALAR, "b" }, { TokenType::INVALID, "?" }, { TokenType::INVALID, "\"c" } });
+    CHECK(GetTokens("\xEF\xBB\xBFkey={}") == Tokens{ { TokenType::SCALAR, "key" }, { TokenType::OPERATOR, "=" }, { TokenType::OPEN_BRACE, "{" }, { TokenType::CLOSE_BRACE, "}" } });
+
+    // Flag keywords are only flags where the parser reads them as flags.
+    CHECK(GetTokens("rgb = RGB # x\n { list } range = list RANGE {}") == Tokens{
+        { TokenType::SCALAR, "rgb" }, { TokenType::OPERATOR, "=" }, { TokenType::FLAG, "RGB" }, { TokenType::COMMENT, "# x" },
+        { TokenType::OPEN_BRACE, "{" }, { TokenType::SCALAR, "list" }, { TokenType::CLOSE_BRACE, "}" },
+        { TokenType::SCALAR, "range" }, { TokenType::OPERATOR, "=" }, { TokenType::FLAG, "list" }, { TokenType::FLAG, "RANGE" },
+        { TokenType::OPEN_BRACE, "{" }, { TokenType::CLOSE_BRACE, "}" } });
+    Lexer flags("a = hsv { } b = rangee");
+    CHECK(flags.Next().op == Operator::EQUAL);
+    CHECK(flags.Next().op == Operator::EQUAL);
+    CHECK(flags.Next().flag == Flags::HSV);
+    flags.Next();
+    flags.Next();
+    flags.Next();
+    CHECK(flags.Next().op == Operator::EQUAL);
+    Token last = flags.Next();
+    CHECK(last.type == TokenType::SCALAR);
+    CHECK(last.flag == Flags::NONE);
+    CHECK(last.offset == 16);
+    CHECK(flags.Next().type == TokenType::END);
+    CHECK(flags.Next().type == TokenType::END);
+    CHECK(flags.GetOffset() == 22);
+
+    // Tokens are views of the input at their offsets, separated only by blanks.
+    for (const auto& entry : std::filesystem::directory_iterator("tests")) {
+        std::string filePath = entry.path().string();
+        CAPTURE(filePath);
+        std::ifstream file(filePath, std::ios::binary);
+        std::string content((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        Lexer lexer(content);
+        size_t offset = lexer.GetOffset();
+        bool separated = true;
+        for (Token token = lexer.Next(); token.type != TokenType::END; token = lexer.Next()) {
+            separated &= (token.text.data() == content.data() + token.offset);
+            for (; offset < token.offset; offset++)
+                separated &= (std::isspace((unsigned char) content[offset]) != 0);
+            offset = token.offset + token.text.size();
+        }
+        CHECK(separated);
+    }
+}
+
+TEST_CASE("[structural_index] two-stage parsing engine") {
+    const auto ParseWith = [](Engine engine, const std::string& filePath, bool isFile = true) {
+        Parser parser;
+        parser.SetEngine(engine);
+        try {
+            return (isFile ? parser.ParseFile(filePath) : parser.ParseString(filePath))->Serialize();
+        }
+        catch (std::exception& e) {
+            return std::string(e.what());
+        }
+    };
+
+    // Both engines must produce the same objects and the same errors on every test file.
+    for (const auto& entry : std::filesystem::directory_iterator("tests")) {
+        std::string filePath = entry.path().string();
+        CAPTURE(filePath);
+        CHECK(ParseWith(Engine::STRUCTURAL_INDEX, filePath) == ParseWith(Engine::STATE_MACHINE, filePath));
+    }
+
+    // Invalid ranges are reported by the state machine, with their location.
+    for (std::string content : { "a = RANGE { x 3 }", "a = RANGE { 1 99999999999 }", "a = RANGE { { b } 3 }", "a = RANGE { 1.5 3 }" }) {
+        CAPTURE(content);
+        CHECK(ParseWith(Engine::STRUCTURAL_INDEX, content, false) == ParseWith(Engine::STATE_MACHINE, content, false));
+    }
+
+    // Tokens are indexed by their first character, skipping comments and quoted strings.
+    StructuralIndex index;
+    std::string content = "key = \"a # {b}\" # comment = {\nlist<=\"x\"\"y\"z\"w\"";
+    CHECK(index.Build(content));
+    std::vector<std::string_view> tokens;
+    for (uint32_t position : index.GetPositions())
+        tokens.push_back(index.GetToken(position));
+    CHECK(tokens == std::vector<std::string_view>{ "key", "=", "\"a # {b}\"", "list", "<", "=", "\"x\"", "\"y\"", "z\"w\"" });
+
+    // Tokens crossing 64-byte blocks.
+    content = std::string(60, ' ') + "key = \"" + std::string(100, '{') + "\" " + std::string(70, 'b') + " = c";
+    CHECK(index.Build(content));
+    CHECK(index.GetPositions().size() == 6);
+    CHECK(index.GetToken(index.GetPositions().at(2)).size() == 102);
+    CHECK(index.GetToken(index.GetPositions().at(3)).size() == 70);
+
+    Parser parser;
+    parser.SetEngine(Engine::STRUCTURAL_INDEX);
+    CHECK(parser.GetEngine() == Engine::STRUCTURAL_INDEX);
+    std::shared_ptr<Object> object = parser.ParseString(content);
+    CHECK(object->Get("key")->As<std::string>() == "\"" + std::string(100, '{') + "\"");
+    CHECK(object->Get(std::string(70, 'b'))->As<std::string>() == "c");
+}
+
+TEST_CASE("[tape_document] flat read-only document") {
+    const auto ParseBoth = [](const std::string& filePath) {
+        std::pair<std::string, std::string> result;
+        try {
+            result.first = ParseTapeFile(filePath)->GetRoot().ToObject()->Serialize();
+        }
+        catch (std::exception& e) {
+            result.first = e.what();
+        }
+        try {
+            result.second = ParseFile(filePath)->Serialize();
+        }
+        catch (std::exception& e) {
+            result.second = e.what();
+        }
+        return result;
+    };
+
+    // The tape holds the same data as the object tree, and fails with the same errors.
+    for (const auto& entry : std::filesystem::directory_iterator("tests")) {
+        std::string filePath = entry.path().string();
+        CAPTURE(filePath);
+        auto [tape, tree] = ParseBoth(filePath);
+        CHECK(tape == tree);
+    }
+
+    // Duplicate keys are merged like in the object tree.
+    std::string content =
+        "a = 1 a = 2 a = { 3 }\n"
+        "b = { x = 1 } b = {} b = { y = 2 }\n"
+        "c = LIST { 1 2 } c = { 3 } c = LIST { 4 }\n"
+        "d = RANGE { 1 3 } d = { 5 }\n"
+        "e = rgb { 1 2 3 } e = hsv { 0.1 0.2 0.3 }\n"
+        "f = {} f = {}\n";
+    std::shared_ptr<TapeDocument> document = ParseTapeString(content);
+    TapeCursor root = document->GetRoot();
+    std::shared_ptr<Object> object = ParseString(content);
+    CHECK(root.ToObject()->Serialize() == object->Serialize());
+    for (TapeCursor entry : root) {
+        CAPTURE(entry.GetKey());
+        CHECK(entry.GetType() == object->Get(entry.GetKey())->GetType());
+        CHECK(entry.GetFlags() == object->Get(entry.GetKey())->GetFlags());
+        CHECK(entry.GetSize() == object->Get(entry.GetKey())->GetArray().size());
+    }
+
+    // Cursors mirror the lookups of objects.
+    content = "color = rgb { 10 20 30 }\ndate = 1066.9.15\nflag = yes\nvalue > 2.5\nname = \"Harold\"\nlist = { a b c }\n";
+    for (int i = 0; i < 40; i++)
+        content += "key_" + std::to_string(i) + " = " + std::to_string(i) + "\n";
+    document = ParseTapeString(content);
+    root = document->GetRoot();
+    CHECK(root.Is(Type::OBJECT));
+    CHECK(root.GetSize() == 46);
+    CHECK(root.Get("color").As<sf::Color>() == sf::Color(10, 20, 30));
+    CHECK(root.Get("date").As<Date>() == Date(1066, 9, 15));
+    CHECK(root.Get("flag").As<bool>());
+    CHECK(root.Get("value").As<double>() == 2.5);
+    CHECK(root.GetOperator("value") == Operator::GREATER);
+    CHECK(root.Get("name").As<std::string>() == "\"Harold\"");
+    CHECK(root.Get("list").AsArray<std::string>() == std::vector<std::string>{ "a", "b", "c" });
+    CHECK(root.GetFirst("list").As<std::string>() == "a");
+    CHECK(root.GetFirst("flag").As<bool>());
+    CHECK(root.Get("key_27").As<int>() == 27);
+    CHECK(root.Contains("key_39"));
+    CHECK(!root.Contains("key_40"));
+    CHECK(root.Get("missing").Is(Type::NONE));
+    CHECK(root.Get("missing").Get("missing").Is(Type::NONE));
+    CHECK(root.Get("name").As<int>(-1) == -1);
+    CHECK(!root.Get("name").AsOpt<int>().has_value());
+    CHECK_THROWS(root.Get("date").Get("key"));
+    CHECK_THROWS(root.Get("list").Get("key"));
+
+    std::vector<std::string_view> keys;
+    for (TapeCursor entry : root)
+        keys.push_back(entry.GetKey());
+    CHECK(keys.at(0) == "color");
+    CHECK(keys.at(45) == "key_39");
+}
+
+TEST_CASE("[document] arena-backed document") {
+    const auto Parse = [](bool document, const std::string& filePath) {
+        try {
+            return document ? ParseDocumentFile(filePath)->GetRoot()->Serialize() : ParseFile(filePath)->Serialize();
+        }
+        catch (std::exception& e) {
+            return std::string(e.what());
+        }
+    };
+
+    // Documents hold the same data as regular trees, and fail with the same errors.
+    for (const auto& entry : std::filesystem::directory_iterator("tests")) {
+        std::string filePath = entry.path().string();
+        CAPTURE(filePath);
+        CHECK(Parse(true, filePath) == Parse(false, filePath));
+    }
+
+    // Every object of the document comes from its arena.
+    std::shared_ptr<Document> document = ParseDocumentString("a = { b = { 1 2 3 } c = \"a long string which does not fit in place\" } a = 2 d = RANGE { 1 4 }");
+    std::shared_ptr<Object> root = document->GetRoot();
+    Arena* arena = &document->GetArena();
+    CHECK(root->GetResource() == arena);
+    CHECK(root->Get("a")->GetResource() == arena);
+    CHECK(root->Get("a")->GetArray().at(0)->Get("b")->GetArray().at(2)->GetResource() == arena);
+    CHECK(root->Get("a")->GetArray().at(0)->Get("c")->GetResource() == arena);
+    CHECK(root->Get("d")->AsArray<int>() == std::vector<int>{ 1, 2, 3, 4 });
+    CHECK(root->Get("a")->GetArray().at(0).use_count() == 0);
+    CHECK(arena->GetAllocatedSize() > 0);
+
+    // Objects added to a document are created in its arena or kept alive by it.
+    root->Put("e", "value");
+    root->Put("f", std::vector<int>{ 1, 2 });
+    root->Get("a")->Push(std::make_shared<Object>(ObjectMap{{ std::make_pair("g", std::make_pair(Operator::EQUAL, std::make_shared<Object>(3))) }}));
+    root->Get("d")->Set(sf::Color(1, 2, 3));
+    CHECK(root->Get("e")->GetResource() == arena);
+    CHECK(root->Get("f")->GetArray().at(1)->GetResource() == arena);
+    CHECK(root->Get("a")->GetArray().at(2)->Get("g")->As<int>() == 3);
+    CHECK(root->Get("d")->As<sf::Color>() == sf::Color(1, 2, 3));
+
+    // Copies are detached from the document, and the root keeps it alive.
+    std::shared_ptr<Object> copy = root->Get("a")->Copy();
+    CHECK(copy->GetResource() == std::pmr::get_default_resource());
+    CHECK(copy->GetArray().at(0)->GetResource() == std::pmr::get_default_resource());
+    std::string serialized = root->Serialize();
+    document.reset();
+    CHECK(root->Serialize() == serialized);
+    root.reset();
+    CHECK(copy->GetArray().at(1)->As<int>() == 2);
+
+    CHECK_THROWS(ParseDocumentString("a = { b = 1"));
+}
+
+TEST_CASE("[document_views] zero-copy scalars") {
+    std::shared_ptr<Document> document = ParseDocumentString("key = value list = { 1 2 } names = { a b } range = RANGE { 1 3 } quoted = \"a long string which does not fit in place\"");
+    std::shared_ptr<Object> root = document->GetRoot();
+    std::string_view source = document->GetSource();
+    const auto IsInSource = [&](std::string_view view) {
+        return view.data() >= source.data() && view.data() + view.size() <= source.data() + source.size();
+    };
+
+    // Scalars reference the source of the document, keys the symbol table of its arena.
+    for (const auto& [key, pair] : root->GetMap())
+        CHECK(key.GetName().data() == document->GetArena().GetSymbols()->Find(key.GetName())->GetName().data());
+    CHECK(IsInSource(root->Get("key")->GetScalar()));
+    CHECK(IsInSource(root->Get("names")->GetArray().at(1)->GetScalar()));
+    // Numbers of arrays are packed instead, and boxed into owned scalars when they are accessed.
+    CHECK(root->Get("list")->IsPacked());
+    CHECK(!IsInSource(root->Get("list")->GetArray().at(1)->GetScalar()));
+    CHECK(!root->Get("list")->IsPacked());
+    CHECK(IsInSource(root->Get("quoted")->GetScalar()));
+    CHECK(root->Get("quoted")->As<std::string>() == "\"a long string which does not fit in place\"");
+
+    // Scalars that are not in the source, such as the values of ranges, are owned.
+    CHECK(!IsInSource(root->Get("range")->GetArray().at(1)->GetScalar()));
+    CHECK(root->Get("range")->AsArray<int>() == std::vector<int>{ 1, 2, 3 });
+
+    // Modified scalars are copied into the document.
+    root->Get("key")->Set("other");
+    root->Get("list")->GetArray().at(0)->GetString().append("0");
+    std::string key = "new_key";
+    root->Put(key, 5);
+    key = "changed";
+    CHECK(!IsInSource(root->Get("key")->GetScalar()));
+    CHECK(root->Get("key")->As<std::string>() == "other");
+    CHECK(root->Get("list")->AsArray<int>() == std::vector<int>{ 10, 2 });
+    CHECK(root->Get("new_key")->As<int>() == 5);
+    CHECK(root->GetMap().keys().back() == "new_key");
+    CHECK(source == "key = value list = { 1 2 } names = { a b } range = RANGE { 1 3 } quoted = \"a long string which does not fit in place\"");
+
+    // Copies own their scalars.
+    std::shared_ptr<Object> copy = root->Copy();
+    CHECK(!IsInSource(copy->Get("quoted")->GetScalar()));
+    std::string serialized = root->Serialize();
+    document.reset();
+    root.reset();
+    CHECK(copy->Serialize() == serialized);
+}
+
+TEST_CASE("[symbols] interned keys") {
+    // Symbols of the same name share their id and their storage.
+    SymbolTable table;
+    Symbol holder = table.Intern("holder");
+    CHECK(table.Intern("holder") == holder);
+    CHECK(table.Intern("holder").GetName().data() == holder.GetName().data());
+    CHECK(table.Intern("liege") != holder);
+    CHECK(holder == "holder");
+    CHECK(table.Find("holder").value() == holder);
+    CHECK(table.GetSize() == 2);
+    CHECK(table.GetNamesSize() == 11);
+
+    // Symbols of different tables are equal if their names are.
+    CHECK(Symbol("holder") == holder);
+    CHECK(Symbol("holder").GetName().data() == Symbol("holder").GetName().data());
+    CHECK(table.Contains(holder));
+    CHECK(!table.Contains(Symbol("holder")));
+
+    // Looking up a key does not intern it.
+    std::shared_ptr<Object> object = ParseString("a = { holder = 1 } b = { holder = 2 liege > 3 } c = { 4 5 }");
+    SymbolTable& symbols = object->GetMap().symbols();
+    size_t size = symbols.GetSize();
+    CHECK(object->Get("never_interned_key")->Is(Type::NONE));
+    CHECK(!object->Contains("never_interned_key"));
+    CHECK(!symbols.Find("never_interned_key").has_value());
+    CHECK(symbols.GetSize() == size);
+
+    // Lookups by symbol match the lookups by name.
+    Symbol liege("liege");
+    CHECK(object->Get(Symbol("a"))->Get(holder)->As<int>() == 1);
+    CHECK(object->Get(Symbol("b"))->Get(holder)->As<int>() == 2);
+    CHECK(object->Get(Symbol("b"))->GetOperator(liege) == Operator::GREATER);
+    CHECK(object->Get(Symbol("b"))->Contains(liege));
+    CHECK(!object->Get(Symbol("a"))->Contains(liege));
+    CHECK(object->GetFirst(Symbol("c"))->As<int>() == 4);
+    CHECK(object->Get(Symbol("d"))->Is(Type::NONE));
+
+    // The maps of a tree share its table, and other trees have their own.
+    CHECK(&object->Get("a")->GetMap().symbols() == &symbols);
+    CHECK(object->Get("a")->GetMap().begin()->first.GetName().data() == object->Get("b")->GetMap().begin()->first.GetName().data());
+    CHECK(&ParseString("holder = 1")->GetMap().symbols() != &symbols);
+    std::shared_ptr<Object> copy = object->Copy();
+    CHECK(&copy->Get("a")->GetMap().symbols() == &copy->GetMap().symbols());
+    CHECK(&copy->GetMap().symbols() != &symbols);
+
+    // Keys of another table are interned in the table of the map, which is released with its last map.
+    std::shared_ptr<SymbolTable> owned = std::make_shared<SymbolTable>();
+    std::weak_ptr<SymbolTable> released = owned;
+    {
+        ObjectMap map(std::pmr::get_default_resource(), std::move(owned));
+        map.insert(liege, ObjectMap::Value(Operator::EQUAL, std::make_shared<Object>(1)));
+        map.insert(std::string_view("holder"), ObjectMap::Value(Operator::EQUAL, std::make_shared<Object>(2)));
+        CHECK(map.begin()->first.GetName().data() != liege.GetName().data());
+        CHECK(map.symbols().Contains(map.begin()->first));
+        CHECK(map.at(liege).second->As<int>() == 1);
+        CHECK(map.at(holder).second->As<int>() == 2);
+        ObjectMap copy = map;
+        CHECK(&copy.symbols() == &map.symbols());
+    }
+    CHECK(released.expired());
+
+    // Threads intern the same names to the same symbols.
+    std::vector<std::thread> threads;
+    std::vector<std::vector<uint32_t>> ids(4);
+    for (int i = 0; i < 4; i++) {
+        threads.emplace_back([&ids, i]() {
+            for (int j = 0; j < 1000; j++)
+                ids[i].push_back(Symbol("thread_symbol_" + std::to_string(j)).GetId());
+        });
+    }
+    for (std::thread& thread : threads)
+        thread.join();
+    for (int i = 1; i < 4; i++)
+        CHECK(ids[i] == ids[0]);
+}
+
+TEST_CASE("[object_map] flat ordered map") {
+    ObjectMap map;
+    for (int i = 0; i < 100; i++)
+        map.insert(std::format("key_{}", i), ObjectMap::Value(Operator::EQUAL, std::make_shared<Object>(i)));
+    REQUIRE(map.size() == 100);
+    CHECK(map.at("key_42").second->As<int>() == 42);
+
+    // Replacing a value keeps its position.
+    map.insert(std::string("key_0"), ObjectMap::Value(Operator::LESS, std::make_shared<Object>(-1)));
+    CHECK(map.begin()->first == "key_0");
+    CHECK(map.begin()->second.first == Operator::LESS);
+
+    // Erased keys are skipped by iteration and lookups, until the map is compacted.
+    for (int i = 0; i < 100; i += 3)
+        map.erase(std::format("key_{}", i));
+    CHECK(map.size() == 66);
+    CHECK_FALSE(map.contains("key_3"));
+    CHECK(map.find("key_3") == map.end());
+    CHECK_THROWS(map.at("key_3"));
+    CHECK(map.begin()->first == "key_1");
+    int count = 0;
+    int previous = -1;
+    for (const auto& [key, value] : map) {
+        int i = value.second->As<int>();
+        CHECK(i % 3 != 0);
+        CHECK(i > previous);
+        previous = i;
+        count++;
+    }
+    CHECK(count == 66);
+
+    for (int i = 1; i < 100; i += 3)
+        map.erase(std::format("key_{}", i));
+    CHECK(map.size() == 33);
+    CHECK(map.keys().front() == "key_2");
+    CHECK(map.keys().back() == "key_98");
+
+    // A key erased then inserted again goes to the end.
+    map.insert(std::string("key_0"), ObjectMap::Value(Operator::EQUAL, std::make_shared<Object>(0)));
+    CHECK(map.keys().back() == "key_0");
+    CHECK(map.contains("key_0"));
+    map["key_new"].second = std::make_shared<Object>("new");
+    CHECK(map.keys().back() == "key_new");
+    CHECK(map.at(Symbol("key_new")).second->As<std::string>() == "new");
+
+    ObjectMap copy = map;
+    map.erase("key_2");
+    CHECK(copy.size() == 35);
+    CHECK(copy.contains("key_2"));
+    ObjectMap moved = std::move(copy);
+    CHECK(moved.size() == 35);
+    CHECK(copy.empty());
+    CHECK(moved.begin()->first == "key_2");
+
+    while (!moved.empty())
+        moved.erase(moved.begin()->first);
+    CHECK(moved.begin() == moved.end());
+    moved.insert(std::string("key_2"), ObjectMap::Value(Operator::EQUAL, std::make_shared<Object>(2)));
+    CHECK(moved.size() == 1);
+
+    // Small maps are searched linearly until they grow past the threshold.
+    ObjectMap small;
+    for (int i = 0; i < 12; i++) {
+        small.insert(std::format("small_{}", i), ObjectMap::Value(Operator::EQUAL, std::make_shared<Object>(i)));
+        for (int j = 0; j <= i; j++)
+            CHECK(small.at(std::format("small_{}", j)).second->As<int>() == j);
+        CHECK_FALSE(small.contains(std::format("small_{}", i + 1)));
+        CHECK_FALSE(small.contains("never_interned_small_key"));
+    }
+    small.erase(Symbol("small_0"));
+    small.erase("small_5");
+    CHECK(small.size() == 10);
+    while (small.size() > 4)
+        small.erase(small.begin()->first);
+    CHECK(small.keys() == std::vector<std::string_view>{ "small_8", "small_9", "small_10", "small_11" });
+    CHECK(small.at(Symbol("small_9")).second->As<int>() == 9);
+    small.erase("small_9");
+    CHECK(small.keys() == std::vector<std::string_view>{ "small_8", "small_10", "small_11" });
+    CHECK(small.find("small_9") == small.end());
+    small[Symbol("small_9")].second = std::make_shared<Object>(90);
+    CHECK(small.keys().back() == "small_9");
+}
+
+TEST_CASE("[parse_directory] parse a directory tree on several threads") {
+    // Every file is parsed like ParseFile would, and errors are kept by file instead of stopping the others.
+    for (unsigned int threads : { 1, 3, 16 }) {
+        CAPTURE(threads);
+        DirectoryResult result = ParseDirectory("tests", "*.txt", threads);
+        size_t fileCount = 0;
+        for (const auto& entry : std::filesystem::directory_iterator("tests")) {
+            std::string filePath = entry.path().string();
+            if (entry.path().extension() != ".txt")
+                continue;
+            CAPTURE(filePath);
+            fileCount++;
+            try {
+                std::string expected = ParseFile(filePath)->Serialize();
+                REQUIRE(result.objects.contains(filePath));
+                CHECK(result.objects.at(filePath)->Serialize() == expected);
+            }
+            catch (std::runtime_error& e) {
+                REQUIRE(result.errors.contains(filePath));
+                CHECK(result.errors.at(filePath) == e.what());
+            }
+        }
+        CHECK(result.objects.size() + result.errors.size() == fileCount);
+        CHECK(result.errors.size() > 0);
+    }
+
+    // Patterns without separators match file names, and patterns with separators relative paths.
+    DirectoryResult result = ParseDirectory("tests", "3?_*.txt");
+    CHECK(result.objects.size() == 4);
+    CHECK(result.objects.contains("tests/32_bom.txt"));
+    CHECK(result.errors.size() == 1);
+    CHECK(result.errors.contains("tests/30_exceptions_array_unexpected_operator.txt"));
+    result = ParseDirectory("tests", "*_exceptions_*");
+    CHECK(result.errors.size() == 18);
+    for (const auto& [filePath, error] : result.errors)
+        CHECK(filePath.find("_exceptions_") != std::string::npos);
+    CHECK(ParseDirectory("tests", "nothing_*.txt").objects.empty());
+
+    std::filesystem::path directory = std::filesystem::temp_directory_path() / "jomini_parse_directory";
+    std::filesystem::remove_all(directory);
+    std::filesystem::create_directories(directory / "common" / "titles");
+    std::filesystem::create_directories(directory / "events");
+    std::ofstream(directory / "root.txt") << "a = 1";
+    std::ofstream(directory / "common" / "titles" / "00_titles.txt") << "b = 2";
+    std::ofstream(directory / "common" / "notes.md") << "c = 3";
+    std::ofstream(directory / "events" / "events.txt") << "d = { 4";
+    result = ParseDirectory(directory.string());
+    CHECK(result.objects.size() == 2);
+    CHECK(result.objects.at((directory / "common" / "titles" / "00_titles.txt").string())->Get("b")->As<int>() == 2);
+    CHECK(result.errors.size() == 1);
+    CHECK(result.errors.contains((directory / "events" / "events.txt").string()));
+    CHECK(ParseDirectory(directory.string(), "common/*.txt").objects.empty());
+    CHECK(ParseDirectory(directory.string(), "common/*/*.txt").objects.size() == 1);
+    CHECK(ParseDirectory(directory.string(), "common/**").objects.size() == 2);
+    CHECK(ParseDirectory(directory.string(), "**/titles/??_*.txt").objects.size() == 1);
+    CHECK(ParseDirectory(directory.string(), "*/*").objects.size() == 1);
+
+    // Files which cannot be read are errors, like for Loader, and not empty objects.
+    std::filesystem::permissions(directory / "root.txt", std::filesystem::perms::none);
+    bool readable = std::ifstream(directory / "root.txt").is_open();
+    result = ParseDirectory(directory.string());
+    DirectoryResult loaded = Loader().LoadDirectory(directory.string());
+    CHECK(result.objects.size() == loaded.objects.size());
+    CHECK(result.errors.size() == loaded.errors.size());
+    for (const auto& [filePath, error] : result.errors)
+        CHECK(loaded.errors.at(filePath) == error);
+    if (!readable) {
+        CHECK(result.objects.size() == 1);
+        CHECK(result.errors.at((directory / "root.txt").string()) == "Failed to read file " + (directory / "root.txt").string() + ".");
+    }
+    std::filesystem::remove_all(directory);
+
+    CHECK_THROWS(ParseDirectory("tests/00_empty.txt"));
+    CHECK_THROWS(ParseDirectory("tests/missing"));
+}
+
+TEST_CASE("[loader] pipelined reads and parsing") {
+    std::map<std::string, std::string> expected;
+    size_t totalSize = 0;
+    size_t largestSize = 0;
+    for (const auto& entry : std::filesystem::directory_iterator("tests")) {
+        std::string filePath = entry.path().string();
+        if (entry.path().extension() != ".txt")
+            continue;
+        totalSize += entry.file_size();
+        largestSize = std::max<size_t>(largestSize, entry.file_size());
+        try {
+            expected[filePath] = ParseFile(filePath)->Serialize();
+        }
+        catch (std::runtime_error& e) {
+            expected[filePath] = e.what();
+        }
+    }
+
+    // The files are parsed like ParseFile would whatever the threads and budget.
+    for (auto [readThreads, parseThreads, bufferBudget] : std::vector<std::tuple<unsigned int, unsigned int, size_t>>{ { 1, 1, 1 }, { 2, 3, 200000 }, { 4, 2, 1 << 30 } }) {
+        CAPTURE(readThreads);
+        CAPTURE(parseThreads);
+        CAPTURE(bufferBudget);
+        Loader loader(readThreads, parseThreads, bufferBudget);
+        DirectoryResult result = loader.LoadDirectory("tests");
+        CHECK(result.objects.size() + result.errors.size() == expected.size());
+        for (const auto& [filePath, object] : result.objects)
+            CHECK(object->Serialize() == expected.at(filePath));
+        for (const auto& [filePath, error] : result.errors)
+            CHECK(error == expected.at(filePath));
+
+        const LoaderStats& stats = loader.GetStats();
+        CHECK(stats.files == expected.size());
+        CHECK(stats.bytesRead == totalSize);
+        CHECK(stats.maxBytesInFlight >= largestSize);
+        CHECK(stats.maxBytesInFlight <= std::max(bufferBudget, largestSize));
+        CHECK(stats.maxQueueDepth >= 1);
+        CHECK(stats.averageQueueDepth >= 1.0);
+        CHECK(stats.readStall.count() >= 0.0);
+        CHECK(stats.parseStall.count() >= 0.0);
+    }
+
+    // With a budget of one byte, files are read one at a time.
+    Loader loader(2, 2, 1);
+    loader.LoadDirectory("tests", "00_benchmark_*.txt");
+    CHECK(loader.GetStats().maxQueueDepth == 1);
+    CHECK(loader.GetStats().maxBytesInFlight == largestSize);
+
+    DirectoryResult result = Loader().Load({ "tests/01_basic.txt", "tests/missing.txt" });
+    CHECK(result.objects.size() == 1);
+    CHECK(result.errors.contains("tests/missing.txt"));
+    CHECK_THROWS(Loader().LoadDirectory("tests/missing"));
+}
+
+TEST_CASE("[events] event parsing without objects") {
+    // Builds objects back from the events, merging keys and converting flagged blocks like the parser.
+    struct TreeHandler : EventHandler {
+        struct Block {
+            std::shared_ptr<Object> object;
+            std::string key;
+            Operator op;
+            Flags flags;
+        };
+        std::vector<Block> blocks = { Block{ std::make_shared<Object>(Type::OBJECT), "", Operator::EQUAL, Flags::NONE } };
+        std::string key;
+        Operator op = Operator::EQUAL;
+        Flags flags = Flags::NONE;
+
+        EventAction OnKey(std::string_view k, Operator o) override { key = k; op = o; return EventAction::CONTINUE; }
+        void OnScalar(std::string_view scalar) override { this->Add(std::make_shared<Object>(scalar), Flags::NONE); }
+        void OnFlag(Flags flag) override { flags = flag; }
+        EventAction OnObjectBegin() override { this->Open(Type::OBJECT); return EventAction::CONTINUE; }
+        void OnObjectEnd() override { this->Close(); }
+        EventAction OnArrayBegin() override { this->Open(Type::ARRAY); return EventAction::CONTINUE; }
+        void OnArrayEnd() override { this->Close(); }
+
+        void Open(Type type) {
+            blocks.push_back(Block{ std::make_shared<Object>(type), key, op, flags });
+            flags = Flags::NONE;
+        }
+        void Close() {
+            Block block = blocks.back();
+            blocks.pop_back();
+            key = block.key;
+            op = block.op;
+            if (block.object->Is(Type::OBJECT) && (bool) (block.flags & (Flags::LIST | Flags::RANGE)))
+                block.object->ConvertToArray();
+            if ((bool) (block.flags & Flags::RANGE)) {
+                std::vector<int> bounds = block.object->AsArray<int>();
+                block.object->GetArray().clear();
+                for (int i = bounds[0]; i != bounds[1] + (bounds[0] <= bounds[1] ? 1 : -1); i += (bounds[0] <= bounds[1] ? 1 : -1))
+                    block.object->Push(std::make_shared<Object>(std::to_string(i)));
+            }
+            this->Add(block.object, block.flags);
+        }
+        void Add(std::shared_ptr<Object> object, Flags objectFlags) {
+            std::shared_ptr<Object> parent = blocks.back().object;
+            if (parent->Is(Type::ARRAY)) {
+                parent->Push(object);
+                return;
+            }
+            parent->MergeUnsafe(key, object, op);
+            parent->Get(key)->SetFlag(objectFlags, true);
+        }
+    };
+
+    // The events describe the same objects as the parser, and raise the same errors.
+    for (const auto& entry : std::filesystem::directory_iterator("tests")) {
+        std::string filePath = entry.path().string();
+        if (entry.path().extension() != ".txt")
+            continue;
+        CAPTURE(filePath);
+        std::string expected = GetError([&]() { ParseFile(filePath); }, true);
+        TreeHandler handler;
+        std::string error = GetError([&]() { ParseEventsFile(filePath, handler); }, true);
+        CHECK(error == expected);
+        if (expected.empty())
+            CHECK(handler.blocks.at(0).object->Serialize() == ParseFile(filePath)->Serialize());
+    }
+
+    // Events are reported in source order, without merging keys.
+    struct RecordHandler : EventHandler {
+        std::string events;
+        std::set<std::string> skippedKeys;
+        bool skipObjects = false;
+        bool skipArrays = false;
+
+        EventAction OnKey(std::string_view key, Operator op) override {
+            events += std::string(key) + OperatorsLabels.at(op) + " ";
+            return skippedKeys.contains(std::string(key)) ? EventAction::SKIP : EventAction::CONTINUE;
+        }
+        void OnScalar(std::string_view scalar) override { events += std::string(scalar) + " "; }
+        void OnFlag(Flags flag) override { events += "flag" + std::to_string((int) flag) + " "; }
+        EventAction OnObjectBegin() override { events += "{ "; return skipObjects ? EventAction::SKIP : EventAction::CONTINUE; }
+        void OnObjectEnd() override { events += "} "; }
+        EventAction OnArrayBegin() override { events += "[ "; return skipArrays ? EventAction::SKIP : EventAction::CONTINUE; }
+        void OnArrayEnd() override { events += "] "; }
+    };
+    const std::string content =
+        "a = 1\n"
+        "b = { c > 2 d = \"x } y\" }\n"
+        "a = { 1 2 3 } # comment }\n"
+        "e = { { f = 1 } { } }\n"
+        "g = rgb { 1 2 3 }\n"
+        "h = list { }\n"
+        "i = { j { k = 1 } }\n"
+        "l ?= {}\n";
+    RecordHandler record;
+    ParseEventsString(content, record);
+    CHECK(record.events == "a= 1 b= { c> 2 d= \"x } y\" } a= [ 1 2 3 ] e= [ { f= 1 } { } ] g= flag1 [ 1 2 3 ] h= flag4 [ ] i= [ j { k= 1 } ] l?= { } ");
+
+    std::istringstream stream(content);
+    RecordHandler streamRecord;
+    Parser().ParseEventsStream(stream, streamRecord, 16);
+    CHECK(streamRecord.events == record.events);
+
+    // Skipped keys and blocks are fast-forwarded, ignoring braces in strings and comments.
+    RecordHandler skipKeys;
+    skipKeys.skippedKeys = { "a", "b", "g", "i" };
+    ParseEventsString(content, skipKeys);
+    CHECK(skipKeys.events == "a= b= a= e= [ { f= 1 } { } ] g= h= flag4 [ ] i= l?= { } ");
+
+    RecordHandler skipObjects;
+    skipObjects.skipObjects = true;
+    ParseEventsString(content + "m = { n = { \"}\" } # }\n }\no = 1", skipObjects);
+    CHECK(skipObjects.events == "a= 1 b= { a= [ 1 2 3 ] e= [ { { ] g= flag1 [ 1 2 3 ] h= flag4 [ ] i= [ j { ] l?= { m= { o= 1 ");
+
+    RecordHandler skipArrays;
+    skipArrays.skipArrays = true;
+    ParseEventsString(content, skipArrays);
+    CHECK(skipArrays.events == "a= 1 b= { c> 2 d= \"x } y\" } a= [ e= [ g= flag1 [ h= flag4 [ i= [ l?= { } ");
+
+    CHECK_THROWS(ParseEventsString("a = { b = { c = 1 }", skipObjects));
+    CHECK_THROWS(ParseEventsString("a = b } c = 1", record));
+    CHECK_THROWS(ParseEventsString("a = range { 1 2 3 }", record));
+    Parser parser;
+    parser.SetMaxDepth(2);
+    CHECK_THROWS(parser.ParseEventsString("a = { b = { c = { } } }", record));
+    CHECK_NOTHROW(parser.ParseEventsString("a = { b = { c = { } } }", skipObjects));
+}
+
+TEST_CASE("[lazy] blocks parsed on first access") {
+    // Lazy trees are the same once accessed, and errors are raised at the same
+    // location, either by the parse or by the first access to their block.
+    for (const auto& entry : std::filesystem::directory_iterator("tests")) {
+        std::string filePath = entry.path().string();
+        if (entry.path().extension() != ".txt")
+            continue;
+        CAPTURE(filePath);
+        std::string expected = GetError([&]() { ParseFile(filePath); });
+        std::string error = GetError([&]() { ParseLazyFile(filePath)->Serialize(); });
+        CHECK(error == expected);
+        if (expected.empty())
+            CHECK(ParseLazyFile(filePath)->Serialize() == ParseFile(filePath)->Serialize());
+    }
+
+    Parser parser;
+    parser.SetLazy(true);
+    CHECK(parser.IsLazy());
+    std::shared_ptr<Object> root = parser.ParseString(
+        "a = { b = 1 c = { d = \"}\" } } # }\n"
+        "e = { 1 2 3 }\n"
+        "f = { { g = 1 } }\n"
+        "h = { i = } j = 2\n"
+        "k = { l = 1 } k = { m = 2 }\n"
+        "n = rgb { 1 2 3 }\n"
+        "o = { }\n"
+    );
+
+    // The types of the blocks are known before they are parsed.
+    CHECK(root->Get("a")->Is(Type::OBJECT));
+    CHECK(root->Get("e")->Is(Type::ARRAY));
+    CHECK(root->Get("f")->Is(Type::ARRAY));
+    CHECK(root->Get("h")->Is(Type::OBJECT));
+    CHECK(root->Get("k")->Is(Type::ARRAY));
+    CHECK(root->Get("n")->As<sf::Color>() == sf::Color(1, 2, 3));
+    CHECK(root->Get("o")->GetMap().empty());
+
+    CHECK(root->Get("a")->Get("c")->Get("d")->As<std::string>() == "\"}\"");
+    CHECK(root->Get("e")->AsArray<int>() == std::vector<int>{ 1, 2, 3 });
+    CHECK(root->Get("f")->GetArray().at(0)->Get("g")->As<int>() == 1);
+    CHECK(root->Get("j")->As<int>() == 2);
+    CHECK(root->Get("k")->GetArray().size() == 2);
+    CHECK(root->Get("k")->GetArray().at(1)->Get("m")->As<int>() == 2);
+
+    // Errors inside a block are raised when it is accessed, and each time until it is valid.
+    CHECK(GetError([&]() { root->Get("h")->Get("i"); }) == ":4:11: error: unexpected closing brace '}' after operator inside key-value block");
+    CHECK_THROWS(root->Get("h")->Serialize());
+
+    // Copies share the source of the blocks, and are still independent.
+    std::shared_ptr<Object> copy = ParseLazyFile("tests/04_nested_object.txt")->Copy();
+    CHECK(copy->Serialize() == ParseFile("tests/04_nested_object.txt")->Serialize());
+    std::shared_ptr<Object> a = root->Get("a")->Copy();
+    a->Get("c")->Put("x", 1);
+    CHECK(!root->Get("a")->Get("c")->Contains("x"));
+
+    // The maximum depth counts the blocks enclosing a lazy block.
+    parser.SetMaxDepth(2);
+    std::shared_ptr<Object> deep = parser.ParseString("a = { b = { c = { } } }");
+    CHECK_NOTHROW(deep->Get("a")->Get("b"));
+    CHECK_THROWS(deep->Get("a")->Get("b")->Get("c"));
+}
+
+TEST_CASE("[projection] build only the entries matching paths") {
+    // A projection matching everything builds the same objects as a full parse.
+    for (const auto& entry : std::filesystem::directory_iterator("tests")) {
+        std::string filePath = entry.path().string();
+        if (entry.path().extension() != ".txt" || filePath.find("_exceptions_") != std::string::npos)
+            continue;
+        CAPTURE(filePath);
+        CHECK(ParseProjectedFile(filePath, { "**" })->Serialize() == ParseFile(filePath)->Serialize());
+    }
+
+    const std::string content =
+        "c_a = { 1066.1.1 = { holder = 1 name = x } 1070.1.1 = { holder = 2 } 1080.1.1 = { name = y } }\n"
+        "c_b = { 1066.1.1 = { holder = 3 } }\n"
+        "d_c = { 1066.1.1 = { holder = 4 } }\n"
+        "k_disputed_lands = { a = { b = 1 } c = { 1 2 } d = rgb { 1 2 3 } }\n"
+        "k_other = { a = 1 holder = 6 }\n"
+        "e = { { holder = 5 } { name = z } }\n"
+        "holder = 7\n";
+    const auto Project = [&](const std::vector<std::string>& patterns) {
+        Parser parser;
+        parser.SetProjection(patterns);
+        return parser.ParseString(content)->Serialize();
+    };
+
+    // Blocks leading to the matching entries are built, and those left empty are removed.
+    CHECK(Project({ "c_*/*/holder", "k_disputed_lands/**" }) == ParseString(
+        "c_a = { 1066.1.1 = { holder = 1 } 1070.1.1 = { holder = 2 } }\n"
+        "c_b = { 1066.1.1 = { holder = 3 } }\n"
+        "k_disputed_lands = { a = { b = 1 } c = { 1 2 } d = rgb { 1 2 3 } }\n"
+    )->Serialize());
+    CHECK(Project({ "k_disputed_lands" }) == ParseString("k_disputed_lands = { a = { b = 1 } c = { 1 2 } d = rgb { 1 2 3 } }")->Serialize());
+    CHECK(Project({ "k_disputed_lands/?" }) == ParseString("k_disputed_lands = { a = { b = 1 } c = { 1 2 } d = rgb { 1 2 3 } }")->Serialize());
+    CHECK(Project({ "k_disputed_lands/a/b" }) == ParseString("k_disputed_lands = { a = { b = 1 } }")->Serialize());
+
+    // Elements of arrays have the path of their array, and '**' matches any number of keys.
+    CHECK(Project({ "e/holder" }) == ParseString("e = { { holder = 5 } }")->Serialize());
+    CHECK(Project({ "**/holder" }) == ParseString(
+        "c_a = { 1066.1.1 = { holder = 1 } 1070.1.1 = { holder = 2 } }\n"
+        "c_b = { 1066.1.1 = { holder = 3 } }\n"
+        "d_c = { 1066.1.1 = { holder = 4 } }\n"
+        "k_other = { holder = 6 }\n"
+        "e = { { holder = 5 } }\n"
+        "holder = 7\n"
+    )->Serialize());
+    CHECK(Project({ "nothing" }).empty());
+    CHECK(Project({}) == ParseString(content)->Serialize());
+
+    // Duplicate keys are merged as usual, without the blocks which were removed.
+    Parser parser;
+    parser.SetProjection({ "a/b" });
+    CHECK(parser.ParseString("a = { b = 1 } a = { c = 2 } a = { b = 3 }")->Serialize() == ParseString("a = { b = 1 } a = { b = 3 }")->Serialize());
+
+    // Skipped entries are only brace-matched, while the others are checked as usual.
+    parser.SetProjection({ "c" });
+    CHECK(parser.ParseString("a = { b = } c = 1")->Get("c")->As<int>() == 1);
+    CHECK_THROWS(parser.ParseString("a = { b = } c = { = }"));
+    CHECK_THROWS(parser.ParseString("a = { b = 1 c = 1"));
+
+    // Lazy parses defer the blocks which matched a whole pattern.
+    parser.SetProjection({ "c_*/*/holder", "k_disputed_lands/**" });
+    parser.SetLazy(true);
+    CHECK(parser.ParseString(content)->Serialize() == Project({ "c_*/*/holder", "k_disputed_lands/**" }));
+}
+
+TEST_CASE("[apply_edit] reparse only the edited block") {
+    std::shared_ptr<Document> document = ParseDocumentString(
+        "a = { b = 1 c = { d = 2 e = { 1 2 } } f = 3 }\n"
+        "g = { h = { i = 1 } h = { i = 2 } }\n"
+        "j = 4 # a = { }\n"
+        "k = rgb { 1 2 3 }\n"
+    );
+    std::shared_ptr<Object> root = document->GetRoot();
+    std::shared_ptr<Object> a = root->Get("a");
+
+    // Each edit gives the same tree as parsing the edited source.
+    const auto Edit = [&](const std::string& before, const std::string& after) {
+        size_t offset = std::string(document->GetSource()).find(before);
+        std::shared_ptr<Object> value = document->ApplyEdit(offset, before.size(), after);
+        CHECK(root->Serialize() == ParseString(std::string(document->GetSource()))->Serialize());
+        return value;
+    };
+
+    // Only the innermost block is replaced, in place in its parent.
+    std::shared_ptr<Object> value = Edit("d = 2", "d = 5");
+    CHECK(value == root->Get("a")->Get("c"));
+    CHECK(root->Get("a") == a);
+    CHECK(a->GetMap().keys() == std::vector<std::string_view>{ "b", "c", "f" });
+    CHECK(value->Get("d")->As<int>() == 5);
+    value = Edit("1 2", "1 2 3");
+    CHECK(value == a->Get("c")->Get("e"));
+    CHECK(value->AsArray<int>() == std::vector<int>{ 1, 2, 3 });
+    value = Edit(" 1 2 3", "");
+    CHECK(value == a->Get("c")->Get("e"));
+    CHECK(value->GetMap().empty());
+    value = Edit("1 2 3", "4 5 6");
+    CHECK(value == root->Get("k"));
+    CHECK(value->As<sf::Color>() == sf::Color(4, 5, 6));
+
+    // Blocks of duplicated keys are merged, so the block containing them is parsed again.
+    value = Edit("i = 1", "i = 3");
+    CHECK(value == root->Get("g"));
+    CHECK(value->Get("h")->GetArray().at(0)->Get("i")->As<int>() == 3);
+
+    // An edit closing a block early is parsed again with the parent block.
+    value = Edit("d = 5 ", "d = 5 } x = { ");
+    CHECK(value == root->Get("a"));
+    CHECK(value->GetMap().keys() == std::vector<std::string_view>{ "b", "c", "x", "f" });
+
+    // Edits out of the blocks parse the whole source again.
+    CHECK(Edit("j = 4", "j = 5") == root);
+    CHECK(root->Get("j")->As<int>() == 5);
+    CHECK(Edit("# a = { }", "") == root);
+
+    // Invalid edits leave the document unchanged, with errors located in the whole source.
+    std::string source(document->GetSource());
+    std::string serialized = root->Serialize();
+    size_t offset = source.find("f = 3");
+    std::string expected = GetError([&]() { ParseString(source.substr(0, offset) + "f = }" + source.substr(offset + 5)); });
+    CHECK(!expected.empty());
+    CHECK(GetError([&]() { document->ApplyEdit(offset, 5, "f = }"); }) == expected);
+    CHECK(document->GetSource() == source);
+    CHECK(root->Serialize() == serialized);
+    CHECK_THROWS(document->ApplyEdit(source.size(), 1, ""));
+    value = Edit("f = 3", "f = 6");
+    CHECK(value == root->Get("a"));
+
+    // The byte order mark of a source is kept in it, but never parsed as part of its first key.
+    std::shared_ptr<Document> bom = ParseDocumentString("\xEF\xBB\xBF" "a = 1\nb = { c = 2 }");
+    CHECK(bom->ApplyEdit(bom->GetSource().find("1"), 1, "3") == bom->GetRoot());
+    CHECK(bom->GetSource() == "\xEF\xBB\xBF" "a = 3\nb = { c = 2 }");
+    CHECK(bom->GetRoot()->GetMap().keys() == std::vector<std::string_view>{ "a", "b" });
+    CHECK(bom->GetRoot()->Get("a")->As<int>() == 3);
+    value = bom->ApplyEdit(bom->GetSource().find("2"), 1, "4");
+    CHECK(value == bom->GetRoot()->Get("b"));
+    CHECK(bom->GetRoot()->Serialize() == "a = 3\nb = {\n\tc = 4\n}");
+    std::string bomError = GetError([&]() { bom->ApplyEdit(bom->GetSource().find("a"), 1, "}"); });
+    CHECK(bomError == GetError([]() { ParseString("\xEF\xBB\xBF" "} = 3\nb = { c = 4 }"); }));
+
+    // The root is updated in place, even when the edited source makes it an array.
+    std::shared_ptr<Document> array = ParseDocumentString("a = { 3 } b = 6");
+    root = array->GetRoot();
+    CHECK(array->ApplyEdit(1, 2, " } ") == root);
+    CHECK(root->Is(Type::ARRAY));
+    CHECK(root->Serialize() == array->GetRoot()->Serialize());
+    array->ApplyEdit(0, array->GetSource().size(), "c = { 1 2 }");
+    CHECK(root->Is(Type::OBJECT));
+    CHECK(root->Get("c")->AsArray<int>() == std::vector<int>{ 1, 2 });
+
+    // Replaced objects are released with their arena, so repeated edits don't grow the document.
+    std::string blocks;
+    for (int i = 0; i < 2000; i++)
+        blocks += std::format("block_{} = {{ value = {} }}\n", i, i);
+    std::shared_ptr<Document> large = ParseDocumentString(blocks);
+    offset = blocks.find("value = 7 ") + 8;
+    large->ApplyEdit(offset, 1, "0");
+    size_t allocatedSize = large->GetAllocatedSize();
+    size_t arenaSize = large->GetArena().GetAllocatedSize();
+    for (int i = 0; i < 1000; i++)
+        large->ApplyEdit(offset, 1, std::to_string(i % 10));
+    CHECK(large->GetAllocatedSize() == allocatedSize);
+    CHECK(large->GetArena().GetAllocatedSize() == arenaSize);
+    large->ApplyEdit(0, 0, " ");
+    arenaSize = large->GetArena().GetAllocatedSize();
+    for (int i = 0; i < 20; i++)
+        large->ApplyEdit(0, 1, " ");
+    CHECK(large->GetArena().GetAllocatedSize() == arenaSize);
+    CHECK(large->GetAllocatedSize() == arenaSize);
+    CHECK(large->GetRoot()->Get("block_7")->Get("value")->As<int>() == 9);
+}
+
+TEST_CASE("[positions] lines and columns computed from offsets") {
+    Reader reader;
+    reader.OpenString("a = 1\nbb = \"x\ny\"\n\tc");
+    CHECK(reader.GetPosition(0).line == 0);
+    CHECK(reader.GetPosition(4).cursor == 4);
+    CHECK(reader.GetPosition(6).line == 1);
+    CHECK(reader.GetPosition(6).cursor == 0);
+    reader.SkipTo(18);
+    CHECK(reader.Peek() == 'c');
+    CHECK(reader.GetCurrentLine() == 3);
+    CHECK(reader.GetCurrentCursor() == 2);
+    CHECK(reader.GetLine(2) == "y\"");
+    CHECK(reader.GetLine(3) == "\tc");
+    CHECK(reader.GetLine(4).empty());
+
+    // Parts of a buffer have the positions of the buffer, which may start further in a file.
+    std::shared_ptr<Buffer> buffer = std::make_shared<Buffer>(std::string("a = 1\nb = 2"));
+    reader.OpenBuffer(buffer, buffer->GetView().substr(6), 10, 4);
+    CHECK(reader.GetSourceOffset() == 6);
+    CHECK(reader.GetCurrentLine() == 11);
+    CHECK(reader.GetCurrentCursor() == 0);
+    CHECK(reader.GetPosition(2).line == 10);
+    CHECK(reader.GetPosition(2).cursor == 6);
+
+    // Columns are exact after tokens and lines in quoted strings.
+    CHECK(GetError([]() { ParseString("a = \"x\ny\" b = }"); }) == ":2:8: error: unexpected closing brace '}' after operator inside key-value block");
+    CHECK(GetError([]() { ParseString("key1 = value1 key2 = { a = b c }"); }) == ":1:32: error: unexpected closing brace '}'; expected '=' or another operator");
+
+    // Streams give the same positions through a window smaller than the input.
+    for (const auto& entry : std::filesystem::directory_iterator("tests")) {
+        std::string filePath = entry.path().string();
+        if (filePath.find("exceptions") == std::string::npos)
+            continue;
+        CAPTURE(filePath);
+        std::ifstream file(filePath, std::ios::binary);
+        std::string content((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        PipeStreamBuffer streamBuffer(content);
+        std::istream stream(&streamBuffer);
+        Parser parser;
+        parser.SetMaxDepth(3);
+        std::string expected = GetError([&]() { parser.ParseString(content); });
+        CHECK(!expected.empty());
+        CHECK(GetError([&]() { parser.ParseStream(stream, 16); }) == expected);
+    }
+}
+
+TEST_CASE("[scalar_types] scalars decoded when parsed") {
+    std::shared_ptr<Object> object = ParseString("a = 12 b = -3 c = 1.25 d = -0.5 e = 1444.11.11 f = yes g = no h = text i = 1234567890 j = 1.2.3.4 k = \"7\" l = 1. m = 0.1234567891");
+    CHECK(object->Get("a")->GetScalarType() == ScalarType::INT);
+    CHECK(object->Get("b")->GetScalarType() == ScalarType::INT);
+    CHECK(object->Get("c")->GetScalarType() == ScalarType::FLOAT);
+    CHECK(object->Get("d")->GetScalarType() == ScalarType::FLOAT);
+    CHECK(object->Get("e")->GetScalarType() == ScalarType::DATE);
+    CHECK(object->Get("f")->GetScalarType() == ScalarType::BOOL);
+    CHECK(object->Get("g")->GetScalarType() == ScalarType::BOOL);
+    CHECK(object->Get("h")->GetScalarType() == ScalarType::STRING);
+    CHECK(object->Get("i")->GetScalarType() == ScalarType::STRING);
+    CHECK(object->Get("j")->GetScalarType() == ScalarType::STRING);
+    CHECK(object->Get("k")->GetScalarType() == ScalarType::STRING);
+    CHECK(object->Get("l")->GetScalarType() == ScalarType::STRING);
+    CHECK(object->Get("m")->GetScalarType() == ScalarType::STRING);
+
+    // Decoded values convert like the text.
+    CHECK(object->Get("a")->As<int>() == 12);
+    CHECK(object->Get("b")->As<double>() == -3.0);
+    CHECK(object->Get("c")->As<double>() == 1.25);
+    CHECK(object->Get("c")->As<int>() == 1);
+    CHECK(object->Get("d")->As<double>() == -0.5);
+    CHECK(object->Get("d")->As<int>() == 0);
+    CHECK(object->Get("e")->As<Date>() == Date(1444, 11, 11));
+    CHECK(object->Get("e")->As<int>() == 1444);
+    CHECK(object->Get("f")->As<bool>() == true);
+    CHECK(object->Get("g")->As<bool>() == false);
+    CHECK(object->Get("i")->As<double>() == 1234567890.0);
+    CHECK(object->Get("l")->As<double>() == 1.0);
+    CHECK(object->Get("m")->As<double>() == std::stod("0.1234567891"));
+    CHECK_THROWS(object->Get("e")->As<bool>());
+    CHECK_THROWS(object->Get("h")->As<int>());
+    for (const char* scalar : { "0.1", "0.7", "-12.345", "99999.9999", "3.14159265", "-0" }) {
+        CAPTURE(scalar);
+        double value = std::make_shared<Object>(scalar)->As<double>();
+        double text = std::make_shared<Object>(std::string(scalar) + "0000000000")->As<double>();
+        CHECK(std::memcmp(&value, &text, sizeof(double)) == 0);
+    }
+
+    // Values are decoded again when set, and are no longer read once the string may be modified.
+    std::shared_ptr<Object> scalar = object->Get("a");
+    scalar->Set(2.5);
+    CHECK(scalar->GetScalarType() == ScalarType::FLOAT);
+    scalar->Set(Date(1, 2, 3));
+    CHECK(scalar->As<Date>() == Date(1, 2, 3));
+    scalar->GetString() = "8";
+    CHECK(scalar->GetScalarType() == ScalarType::STRING);
+    CHECK(scalar->As<int>() == 8);
+    CHECK(object->Get("c")->Copy()->GetScalarType() == ScalarType::FLOAT);
+    CHECK(ParseDocumentString("a = 5")->GetRoot()->Get("a")->GetScalarType() == ScalarType::INT);
+}
+
+TEST_CASE("[try_conversions] conversions and lookups without exceptions") {
+    std::shared_ptr<Object> object = ParseString("a = 12 b = text c = 99999999999 d = 1444.11.11 e = { 1 2 3 } f = { 1 x 3 } g = { 255 128 0 } h = { a = 1 } i = \" 7\" j = +5 k = 2.5e3");
+    int integer = -1;
+    CHECK(object->Get("a")->TryAs(integer) == ConversionError::NONE);
+    CHECK(integer == 12);
+    integer = -1;
+    CHECK(object->Get("b")->TryAs(integer) == ConversionError::INVALID_FORMAT);
+    CHECK(object->Get("c")->TryAs(integer) == ConversionError::OUT_OF_RANGE);
+    CHECK(object->Get("e")->TryAs(integer) == ConversionError::INVALID_TYPE);
+    CHECK(object->Get("missing")->TryAs(integer) == ConversionError::MISSING);
+    CHECK(integer == -1);
+    CHECK(object->Get("j")->TryAs(integer) == ConversionError::NONE);
+    CHECK(integer == 5);
+
+    double number = 0.0;
+    CHECK(object->Get("k")->TryAs(number) == ConversionError::NONE);
+    CHECK(number == 2500.0);
+    CHECK(object->Get("b")->TryAs(number) == ConversionError::INVALID_FORMAT);
+    Date date;
+    CHECK(object->Get("d")->TryAs(date) == ConversionError::NONE);
+    CHECK(date == Date(1444, 11, 11));
+    CHECK(object->Get("b")->TryAs(date) == ConversionError::INVALID_FORMAT);
+    sf::Color color;
+    CHECK(object->Get("g")->TryAs(color) == ConversionError::NONE);
+    CHECK(color == sf::Color(255, 128, 0));
+    CHECK(object->Get("f")->TryAs(color) == ConversionError::INVALID_FORMAT);
+
+    std::vector<int> values;
+    CHECK(object->Get("e")->TryAsArray(values) == ConversionError::NONE);
+    CHECK(values == std::vector<int>{ 1, 2, 3 });
+    CHECK(object->Get("f")->TryAsArray(values) == ConversionError::INVALID_FORMAT);
+    CHECK(object->Get("a")->TryAsArray(values) == ConversionError::INVALID_TYPE);
+    CHECK(values == std::vector<int>{ 1, 2, 3 });
+
+    CHECK(object->TryGet("a") == object->Get("a"));
+    CHECK(object->TryGet(Symbol("h")) == object->Get("h"));
+    CHECK(object->TryGet("missing") == nullptr);
+    CHECK(object->Get("a")->TryGet("x") == nullptr);
+    CHECK(object->Get("e")->TryGet("x") == nullptr);
+
+    // The other conversions are built on them.
+    CHECK(object->Get("b")->As<int>(7) == 7);
+    CHECK(object->Get("missing")->As<int>(7) == 7);
+    CHECK(object->Get("a")->AsOpt<int>() == 12);
+    CHECK(object->Get("c")->AsOpt<int>() == std::nullopt);
+    CHECK(object->Get("i")->AsOpt<int>() == std::nullopt);
+    CHECK(object->Get("f")->AsArrayOpt<int>() == std::nullopt);
+    CHECK(object->Get("f")->AsArray<int>({ 0 }) == std::vector<int>{ 0 });
+    CHECK(object->Get("e")->AsArray<double>() == std::vector<double>{ 1.0, 2.0, 3.0 });
+    CHECK_THROWS_WITH(object->Get("b")->As<int>(), "Invalid format. Invalid conversion of object to int.");
+    CHECK_THROWS_WITH(object->Get("b")->As<double>(), "Invalid format. Invalid conversion of object to double.");
+    CHECK_THROWS_WITH(object->Get("b")->As<Date>(), "Invalid format. Invalid conversion of object to date.");
+    CHECK_THROWS_WITH(object->Get("c")->As<int>(), "Out of range. Invalid conversion of object to int.");
+    CHECK_THROWS_WITH(object->Get("h")->As<Date>(), "Invalid object type. Invalid conversion of object to date.");
+}
+
+TEST_CASE("[parse_result] parsing without raising errors") {
+    const std::string source =
+        "a = 1\n"
+        "b = = 2\n"
+        "c = 3\n"
+        "d = { x = 1 } }\n"
+        "e = { y = 2 z }\n"
+        "f = \"}\" = 4\n"
+        "g = 5\n"
+        "h = {\n";
+    ParseResult result = ParseResultString(source);
+    REQUIRE(result.GetErrors().size() == 5);
+    CHECK(!result.IsTruncated());
+    CHECK(result.GetErrors()[0].error == "unexpected '=' after operator inside key-value block");
+    CHECK(result.GetErrors()[1].error == "unexpected closing brace '}'");
+    CHECK(result.GetErrors()[2].error == "unexpected closing brace '}'; expected '=' or another operator");
+    CHECK(result.GetErrors()[3].error == "expected key before '='");
+    CHECK(result.GetErrors()[4].error == "expected closing brace '}'");
+    CHECK(result.GetPosition(0).line == 1);
+    CHECK(result.GetPosition(0).cursor == 4);
+    CHECK(result.GetPosition(2).line == 4);
+    CHECK(result.GetPosition(2).cursor == 14);
+
+    // Entries with an error are left out, and the others are kept.
+    std::shared_ptr<Object> object = result.GetObject();
+    CHECK(object->GetMap().size() == 7);
+    CHECK(!object->Contains("b"));
+    CHECK(object->Get("c")->As<int>() == 3);
+    CHECK(object->Get("d")->Get("x")->As<int>() == 1);
+    CHECK(object->Get("e")->Get("y")->As<int>() == 2);
+    CHECK(object->Get("f")->As<std::string>() == "\"}\"");
+    CHECK(object->Get("g")->As<int>() == 5);
+    CHECK(object->Get("h")->GetMap().empty());
+
+    // The messages are those the parser raises.
+    try {
+        ParseString(source);
+        FAIL("no error raised");
+    }
+    catch (std::runtime_error& e) {
+        CHECK(result.FormatError(0) == e.what());
+    }
+    for (const auto& entry : std::filesystem::directory_iterator("tests")) {
+        std::string filePath = entry.path().string();
+        if (filePath.find("exceptions") == std::string::npos)
+            continue;
+        CAPTURE(filePath);
+        Parser parser;
+        parser.SetEngine(Engine::STATE_MACHINE);
+        parser.SetMaxDepth(3);
+        ParseResult fileResult = parser.ParseResultFile(filePath);
+        REQUIRE(fileResult.HasErrors());
+        CHECK(fileResult.GetObject()->Is(Type::OBJECT));
+        try {
+            parser.ParseFile(filePath);
+            FAIL("no error raised");
+        }
+        catch (std::runtime_error& e) {
+            CHECK(fileResult.FormatError(0) == e.what());
+        }
+    }
+
+    // Parsing stops at the maximum number of errors.
+    Parser parser;
+    parser.SetMaxErrors(2);
+    result = parser.ParseResultString(source);
+    CHECK(result.GetErrors().size() == 2);
+    CHECK(result.IsTruncated());
+    CHECK(result.GetObject()->GetMap().size() == 3);
+    CHECK_THROWS(parser.ParseString(source));
+}
+
+TEST_CASE("[packed_arrays] numbers of arrays stored inline") {
+    std::shared_ptr<Object> object = ParseString("a = rgb { 255 128 0 } b = { 1 0.5 -2 -0.50 } c = { 1066.9.15 1100.1.1 } d = { 007 1 } e = { 1 text } f = { 1 1066.9.15 } g = { 1 { 2 } } h = { 12 }");
+    CHECK(object->Get("a")->IsPacked());
+    CHECK(object->Get("b")->IsPacked());
+    CHECK(object->Get("c")->IsPacked());
+    CHECK(object->Get("h")->IsPacked());
+    CHECK(!object->Get("d")->IsPacked());
+    CHECK(!object->Get("e")->IsPacked());
+    CHECK(!object->Get("f")->IsPacked());
+    CHECK(!object->Get("g")->IsPacked());
+
+    // Elements are read in place.
+    std::optional<std::span<const int>> ints = object->Get("a")->GetPacked<int>();
+    REQUIRE(ints.has_value());
+    CHECK(std::vector<int>(ints->begin(), ints->end()) == std::vector<int>{ 255, 128, 0 });
+    CHECK(object->Get("a")->GetPacked<double>() == std::nullopt);
+    std::optional<std::span<const double>> doubles = object->Get("b")->GetPacked<double>();
+    REQUIRE(doubles.has_value());
+    CHECK(std::vector<double>(doubles->begin(), doubles->end()) == std::vector<double>{ 1.0, 0.5, -2.0, -0.5 });
+    std::optional<std::span<const Date>> dates = object->Get("c")->GetPacked<Date>();
+    REQUIRE(dates.has_value());
+    CHECK((*dates)[0] == Date(1066, 9, 15));
+    CHECK(object->Get("d")->GetPacked<int>() == std::nullopt);
+    CHECK(object->Get("a")->As<sf::Color>() == sf::Color(255, 128, 0));
+
+    // Conversions and serialization are the same as those of the boxed elements, which
+    // keep the text of the scalars.
+    for (const char* key : { "a", "b", "c", "h" }) {
+        CAPTURE(key);
+        std::shared_ptr<Object> packed = object->Get(key);
+        std::shared_ptr<Object> boxed = packed->Copy();
+        CHECK(boxed->IsPacked());
+        boxed->GetArray();
+        CHECK(!boxed->IsPacked());
+        std::vector<std::string> strings[2];
+        std::vector<int> integers[2];
+        std::vector<double> decimals[2];
+        std::vector<bool> booleans[2];
+        std::vector<Date> days[2];
+        sf::Color colors[2];
+        CHECK(packed->TryAsArray(strings[0]) == boxed->TryAsArray(strings[1]));
+        CHECK(packed->TryAsArray(integers[0]) == boxed->TryAsArray(integers[1]));
+        CHECK(packed->TryAsArray(decimals[0]) == boxed->TryAsArray(decimals[1]));
+        CHECK(packed->TryAsArray(booleans[0]) == boxed->TryAsArray(booleans[1]));
+        CHECK(packed->TryAsArray(days[0]) == boxed->TryAsArray(days[1]));
+        CHECK(packed->TryAs(colors[0]) == boxed->TryAs(colors[1]));
+        CHECK(strings[0] == strings[1]);
+        CHECK(integers[0] == integers[1]);
+        CHECK(decimals[0] == decimals[1]);
+        CHECK(days[0] == days[1]);
+        CHECK(colors[0] == colors[1]);
+        CHECK(packed->Serialize() == boxed->Serialize());
+    }
+    CHECK(object->Get("b")->AsArray<std::string>() == std::vector<std::string>{ "1", "0.5", "-2", "-0.50" });
+    CHECK(object->Get("d")->AsArray<std::string>() == std::vector<std::string>{ "007", "1" });
+    CHECK(object->Get("a")->Serialize() == "rgb { 255 128 0 }");
+
+    // Elements are boxed when the array is accessed as objects.
+    std::shared_ptr<Object> array = object->Get("b");
+    CHECK(array->GetArray().at(3)->GetScalar() == "-0.50");
+    CHECK(!array->IsPacked());
+    array->Push(3);
+    CHECK(array->AsArray<int>() == std::vector<int>{ 1, 0, -2, 0, 3 });
+
+    // Arrays of documents are packed in their arena.
+    std::shared_ptr<Document> document = ParseDocumentString("ids = { 1 2 3 }");
+    std::shared_ptr<Object> ids = document->GetRoot()->Get("ids");
+    CHECK(ids->IsPacked());
+    CHECK(ids->GetResource() != std::pmr::get_default_resource());
+    CHECK(ids->Copy()->GetResource() == std::pmr::get_default_resource());
+    CHECK(ids->GetArray().at(2)->As<int>() == 3);
+}
+
 TEST_CASE("[scalar_constructors] scalar object constructors") {
     auto o_string = std::make_shared<Object>("string");
     auto o_int = std::make_shared<Object>(1234);
@@ -713,6 +2898,15 @@ TEST_CASE("[copy] deep-copy an object") {
         REQUIRE(oc->Contains("test2"));
         CHECK(oc->Get("test2")->As<std::string>() == "abcdef");
     }
+
+    SUBCASE("copy constructor") {
+        auto o = ParseString("color = rgb { 1 2 3 }")->Get("color");
+
+        Object oc(*o);
+        CHECK(oc.GetFlags() == Flags::RGB);
+        CHECK(oc.Serialize() == "rgb { 1 2 3 }");
+        CHECK(Object(o).Serialize() == "rgb { 1 2 3 }");
+    }
 }
 
 TEST_CASE("[flatten] flatten an array into an object") {